@@ -0,0 +1,70 @@
+#ifndef HACKLIB_CODEINDEX_H
+#define HACKLIB_CODEINDEX_H
+
+#include "hacklib/Memory.h"
+#include "hacklib/Pattern.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace hl
+{
+/// A suffix array with LCP array over a snapshot of code. Building is linear in the size of the code, after which
+/// pattern queries take O(m log n) instead of a linear scan. This pays off for tools that run many queries
+/// against the same module, like signature tests or uniqueness checks.
+/// The index takes about 13 bytes of memory per byte of code.
+class CodeIndex
+{
+public:
+    /// Indexes the code regions of a module.
+    /// \param moduleName The name of the target module or empty string for main module.
+    explicit CodeIndex(const std::string& moduleName = "");
+    /// Indexes the given memory regions. Their total size must be below 4 GiB.
+    explicit CodeIndex(std::span<const hl::MemoryRegion> regions);
+
+    /// Returns all matches of the pattern in ascending order. Matches do not cross region boundaries.
+    /// Each run of fixed bytes is looked up in the suffix array and the candidates of the rarest run are verified
+    /// against the complete pattern. Patterns without fixed bytes degrade to a linear scan.
+    [[nodiscard]] std::vector<uintptr_t> find(const PatternView& pattern) const;
+    /// \overload
+    /// Uses the format of hl::FindPattern.
+    [[nodiscard]] std::vector<uintptr_t> find(const std::string& pattern) const;
+
+    /// Returns the length of the shortest byte sequence starting at adr that occurs only once in the index or zero
+    /// if there is none within the region of adr.
+    [[nodiscard]] size_t uniqueLength(uintptr_t adr) const;
+
+    /// Returns the number of indexed bytes.
+    [[nodiscard]] size_t size() const { return m_text.size(); }
+
+private:
+    struct Region
+    {
+        size_t offset;
+        uintptr_t base;
+        size_t size;
+    };
+
+    void build(std::span<const hl::MemoryRegion> regions);
+    // Returns the range of suffix array indices of the suffixes that start with the bytes.
+    [[nodiscard]] std::pair<size_t, size_t> equalRange(const uint8_t* bytes, size_t len) const;
+    // Returns the region that contains the text offset.
+    [[nodiscard]] const Region& regionOf(size_t offset) const;
+    // Returns the index of the suffix at the text offset in the suffix array.
+    [[nodiscard]] size_t rankOf(size_t offset) const;
+
+    // Copy of all regions back to back.
+    std::vector<uint8_t> m_text;
+    std::vector<Region> m_regions;
+    // Text offsets of all suffixes in lexicographical order.
+    std::vector<uint32_t> m_suffixes;
+    // The inverse of m_suffixes. m_rank[offset] is the index of the suffix at the text offset.
+    std::vector<uint32_t> m_rank;
+    // m_lcp[i] is the length of the longest common prefix of the suffixes i - 1 and i.
+    std::vector<uint32_t> m_lcp;
+};
+}
+
+#endif
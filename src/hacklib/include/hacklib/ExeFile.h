@@ -18,22 +18,26 @@ public:
     enum class SectionType
     {
         Unknown,
-        Code
+        Code,
+        ReadOnlyData
     };
     struct Section
     {
-        std::vector<uint8_t> data;
+        // Points into the mapped file or the loaded module.
+        std::span<const uint8_t> data;
         std::string name;
         SectionType type = SectionType::Unknown;
+        // The address of the section relative to the image base.
+        uintptr_t rva = 0;
     };
 
 public:
     ExeFile();
     ~ExeFile();
 
-    // Load a module in the current process memory.
+    // Load a module in the current process memory. The memory must stay valid while the sections are used.
     bool loadFromMem(uintptr_t moduleBase);
-    // Load a file from the file system.
+    // Load a file from the file system. The file is mapped into memory until another file is loaded.
     bool loadFromFile(const std::string& path);
 
     bool hasRelocs() const;
@@ -43,6 +47,8 @@ public:
     uintptr_t getExport(const std::string& name) const;
 
     std::span<const Section> getSections() const { return m_sections; }
+    // Returns the preferred load address. Zero for position independent ELF files.
+    uintptr_t getImageBase() const { return m_imageBase; }
 
 private:
     std::unique_ptr<class ExeFileImpl> m_impl;
@@ -50,6 +56,7 @@ private:
     std::vector<uintptr_t> m_relocs;
     std::unordered_map<std::string, uintptr_t> m_exports;
     std::vector<Section> m_sections;
+    uintptr_t m_imageBase = 0;
 };
 }
 
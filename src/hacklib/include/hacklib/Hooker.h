@@ -2,7 +2,9 @@
 #define HACKLIB_HOOKER_H
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <utility>
 #include <vector>
 
 
@@ -74,6 +76,12 @@ class Hooker
 public:
     using HookCallback_t = void (*)(CpuContext*);
 
+    Hooker() = default;
+    Hooker(const Hooker&) = delete;
+    Hooker& operator=(const Hooker&) = delete;
+    /// Removes all hooks in reverse order of creation.
+    ~Hooker();
+
     /// Hook by replacing an object instances virtual table pointer.
     /// This method can only target virtual functions. It should always
     /// be preferred if possible as it is almost impossible to detect.
@@ -89,17 +97,33 @@ public:
     /// to resume execution somehow. A simple return will likely crash the target.
     /// \param location: The location to hook.
     /// \param nextInstructionOffset: The offset from location to the next instruction after
-    ///     the jump that will be written. Currently 5 bytes on 32-bit and 14 bytes on 64-bit are required for the jump.
+    ///     the jump that will be written. A 5 byte relative jump is used if the target is within +-2 GB of the
+    ///     location. On 64-bit, a far target is reached through wrapper code that is allocated near the location.
+    ///     Only if there is no free memory in reach, a 14 byte absolute jump is used and nullptr is returned for
+    ///     smaller offsets.
     /// \param cbHook: The hook target location.
     /// \param jmpBack: Optional output parameter to receive the address of wrapper code that
     ///     executes the overwritten code and jumps back. Do a jump to this address
     ///     at the end of your hook to resume execution.
+    /// The overwritten code is relocated into the wrapper code, see hl::RelocateCode. Returns nullptr if it does not
+    /// consist of whole instructions or can not be relocated.
     const IHook* hookJMP(uintptr_t location, int nextInstructionOffset, uintptr_t cbHook, uintptr_t* jmpBack = nullptr);
+    /// \overload
+    /// Overwrites the fewest whole instructions that fit the jump, see hl::GetPrologueSize. Returns nullptr if the
+    /// code at location is too short, for example because it ends with a RET, or can not be relocated.
+    /// Instructions that are jumped to from outside of the overwritten code can not be detected.
+    const IHook* hookJMP(uintptr_t location, uintptr_t cbHook, uintptr_t* jmpBack = nullptr);
 
     /// Hook by patching the location with a jump like hookJMP, but jumps to
     /// wrapper code that preserves registers, calls the given hook callback and
     /// executes the overwritten instructions for maximum convenience.
+    /// The wrapper code is allocated near the location, so the jump needs the same size as for hookJMP.
+    /// Multiple threads may run the callback at the same time. Changing the instruction pointer in the context is
+    /// only reliable if no other thread runs the callback concurrently.
     const IHook* hookDetour(uintptr_t location, int nextInstructionOffset, HookCallback_t cbHook);
+    /// \overload
+    /// Overwrites the fewest whole instructions that fit the jump like the overload of hookJMP without offset.
+    const IHook* hookDetour(uintptr_t location, HookCallback_t cbHook);
 
     /// Hook by using memory protection and a global exception handler.
     /// This method is very slow.
@@ -107,8 +131,22 @@ public:
     const IHook* hookVEH(uintptr_t location, HookCallback_t cbHook);
 
     /// Removes the hook represented by the given hl::IHook object and releases all associated resources.
+    /// For detour hooks, waits until all other threads have returned from the callback. Safe to call from within
+    /// the callback.
+    /// The wrapper code of a detour hook is released as soon as no thread executes it anymore. This is checked
+    /// again by later calls to this or any other hooker.
     void unhook(const IHook* pHook);
 
+    /// Defers writing the jumps of hookJMP and hookDetour until commit is called. The hooks are returned as usual,
+    /// but have no effect yet. Unhooking a deferred hook discards it.
+    void beginBatch();
+    /// Writes all jumps that were deferred since beginBatch at once. All other threads of the process are suspended
+    /// during the write and the protection of every affected page is only changed once. Suspended threads that are
+    /// inside the overwritten instructions are moved to the copy of these instructions in the wrapper code.
+    /// Threads that do not suspend in time, for example because they block the signal that is used on Linux, are
+    /// only protected as much as with unbatched hooks.
+    void commit();
+
 
     /// \overload
     template <typename T, typename C>
@@ -124,6 +162,13 @@ public:
         return hookJMP((uintptr_t)location, nextInstructionOffset, (uintptr_t)cbHook, jmpBack);
     }
 
+    /// \overload
+    template <typename F, typename C>
+    const IHook* hookJMP(F location, C cbHook, uintptr_t* jmpBack = nullptr)
+    {
+        return hookJMP((uintptr_t)location, (uintptr_t)cbHook, jmpBack);
+    }
+
     /// \overload
     template <typename F>
     const IHook* hookDetour(F location, int nextInstructionOffset, HookCallback_t cbHook)
@@ -131,9 +176,46 @@ public:
         return hookDetour((uintptr_t)location, nextInstructionOffset, cbHook);
     }
 
+    /// \overload
+    template <typename F>
+    const IHook* hookDetour(F location, HookCallback_t cbHook)
+    {
+        return hookDetour((uintptr_t)location, cbHook);
+    }
+
 
 private:
+    // A jump that was not written yet because of a batch.
+    struct PendingPatch
+    {
+        const IHook* pHook;
+        uintptr_t location;
+        std::vector<unsigned char> code;
+        // The instructions inside the overwritten code and their counterparts in the relocated copy that threads
+        // are moved to.
+        std::vector<std::pair<uintptr_t, uintptr_t>> relocatedIps;
+    };
+
+    // Restores the overwritten code if the jump of the hook was written and destroys the hook.
+    void removeHook(const IHook* pHook);
+    // Writes a jump or restores the original code while other threads may execute it. Suspends the other threads if
+    // the first instruction can not be replaced atomically.
+    static void WritePatch(uintptr_t location, const unsigned char* code, int size);
+    // Frees the wrapper code of removed detour hooks that no thread executes anymore.
+    static void PurgeRetiredWrappers();
+    // Writes the jump of a hook or defers it if a batch is active.
+    void applyPatch(const IHook* pHook, uintptr_t location, std::vector<unsigned char> code,
+                    std::vector<std::pair<uintptr_t, uintptr_t>> relocatedIps);
+
+    // Platform specific. Suspends all other threads of the process, calls func and resumes the threads.
+    // relocate is called with the instruction pointer of every suspended thread and returns the one to resume at.
+    // Both functions must not allocate memory, because a suspended thread may hold the lock of the heap.
+    // Returns false if some threads could not be suspended.
+    static bool RunSuspended(const std::function<void()>& func, const std::function<uintptr_t(uintptr_t)>& relocate);
+
     std::vector<std::unique_ptr<IHook>> m_hooks;
+    std::vector<PendingPatch> m_pendingPatches;
+    bool m_batching = false;
 };
 }
 
@@ -0,0 +1,92 @@
+#ifndef HACKLIB_INCREMENTALSCANNER_H
+#define HACKLIB_INCREMENTALSCANNER_H
+
+#include "hacklib/Memory.h"
+#include "hacklib/Pattern.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace hl
+{
+/// Repeatedly scans memory regions of the current process that change over time, like the output of a JIT compiler.
+/// After the first scan, only the pages that changed since the previous scan are scanned again, together with an
+/// overlap of the longest match into their neighbors.
+class IncrementalScanner
+{
+public:
+    enum class Tracking
+    {
+        /// Uses SoftDirty if it is supported and PageHash otherwise.
+        Auto,
+        /// Uses the soft-dirty bits of the Linux page tables. Unchanged pages are not read at all.
+        /// Clearing the bits affects the whole process. When multiple scanners use soft-dirty tracking, each clear
+        /// by another scanner causes a full rescan. Writes through another mapping of the same memory are not
+        /// detected, and writes that race with update may be missed.
+        SoftDirty,
+        /// Compares a hash of every page with the previous scan. Works everywhere and detects all changes, but
+        /// reads all pages.
+        PageHash
+    };
+
+    /// Returns true if the kernel supports soft-dirty tracking for this process.
+    static bool IsSoftDirtySupported();
+
+    /// \param pattern A pattern in the format of hl::FindPattern.
+    /// \param filter Selects the memory regions to scan. The default selects executable anonymous memory.
+    /// Throws std::runtime_error if the requested tracking is not supported.
+    explicit IncrementalScanner(const std::string& pattern, Tracking tracking = Tracking::Auto,
+                                std::function<bool(const hl::MemoryRegion&)> filter = {});
+    /// \overload
+    /// The memory of the pattern must stay valid while the scanner is used.
+    explicit IncrementalScanner(const PatternView& pattern, Tracking tracking = Tracking::Auto,
+                                std::function<bool(const hl::MemoryRegion&)> filter = {});
+
+    /// Rescans the pages that changed since the previous update. The first update scans everything.
+    /// \return The matches that were not present at the previous update in ascending order.
+    std::vector<uintptr_t> update();
+
+    /// Returns all matches as of the last update in ascending order.
+    [[nodiscard]] const std::set<uintptr_t>& matches() const { return m_matches; }
+    /// Returns the tracking that is used. Never Tracking::Auto.
+    [[nodiscard]] Tracking tracking() const { return m_tracking; }
+    /// Returns the number of bytes that were scanned for the pattern by the last update.
+    [[nodiscard]] size_t lastScannedBytes() const { return m_lastScannedBytes; }
+
+private:
+    IncrementalScanner(std::shared_ptr<const CompiledPattern> owner, const PatternView& pattern, Tracking tracking,
+                       std::function<bool(const hl::MemoryRegion&)> filter);
+
+    // Rescans the pages in [begin, end) of the region [regionBase, regionEnd).
+    void rescan(uintptr_t begin, uintptr_t end, uintptr_t regionBase, uintptr_t regionEnd,
+                std::set<uintptr_t>& removed, std::vector<uintptr_t>& added);
+
+    // Platform specific.
+    static bool ProbeSoftDirty();
+    static void ClearSoftDirty();
+    // Sets dirty[i] for every soft-dirty page i starting at the page aligned base.
+    static void ReadSoftDirty(uintptr_t base, size_t numPages, std::vector<uint8_t>& dirty);
+
+    std::shared_ptr<const CompiledPattern> m_owner;
+    PatternView m_pattern;
+    Tracking m_tracking;
+    std::function<bool(const hl::MemoryRegion&)> m_filter;
+
+    bool m_scanned = false;
+    // The soft-dirty generation of the last clear by this scanner.
+    uint64_t m_generation = 0;
+    // Base and size of the regions of the previous update.
+    std::vector<std::pair<uintptr_t, size_t>> m_regions;
+    // Page address to page hash.
+    std::unordered_map<uintptr_t, uint64_t> m_pageHashes;
+    std::set<uintptr_t> m_matches;
+    size_t m_lastScannedBytes = 0;
+};
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef HACKLIB_INSTRUCTIONDECODER_H
+#define HACKLIB_INSTRUCTIONDECODER_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace hl
+{
+/// The kind of operand of an instruction that is relative to the address of the next instruction.
+enum class RelativeType : uint8_t
+{
+    None,
+    /// A RIP-relative memory operand. Only on x86-64.
+    Memory,
+    /// JMP rel8 or JMP rel32.
+    Jump,
+    /// Jcc rel8 or Jcc rel32.
+    ConditionalJump,
+    /// CALL rel32.
+    Call,
+    /// LOOP, LOOPE, LOOPNE, JECXZ or JRCXZ. These have no 32-bit form and can not be relocated.
+    Loop
+};
+
+/// The properties of a decoded instruction that are needed to copy it to another address.
+struct Instruction
+{
+    /// The length in bytes. 0 if the bytes are not a valid or supported instruction.
+    int length = 0;
+    RelativeType relative = RelativeType::None;
+    /// The offset and size of the displacement of the relative operand within the instruction.
+    int relativeOffset = 0;
+    int relativeSize = 0;
+    /// The condition code of a conditional jump.
+    uint8_t condition = 0;
+    /// True if execution does not continue with the next instruction, like for RET, JMP or INT3.
+    bool endsFlow = false;
+
+    /// Returns the target of the relative operand for the instruction at adr.
+    [[nodiscard]] uintptr_t relativeTarget(uintptr_t adr) const;
+};
+
+/// Decodes the x86 or x86-64 instruction at adr, depending on the compilation architecture.
+/// The decoder is table driven and only determines the length and relative operands. It supports the general
+/// purpose, x87, SSE, VEX and EVEX encoded instructions.
+Instruction DecodeInstruction(uintptr_t adr);
+
+/// Returns the size of the whole instructions at location that cover at least minSize bytes.
+/// Returns 0 if an instruction can not be decoded, if the code ends before minSize bytes, for example with a RET,
+/// or if it contains an instruction that can not be relocated.
+int GetPrologueSize(uintptr_t location, int minSize);
+
+/// Returns an upper bound of the size of the code that hl::RelocateCode returns for the same range.
+/// Returns 0 if an instruction can not be decoded.
+int MaxRelocatedSize(uintptr_t from, int size);
+
+/// Copies the whole instructions in [from, from + size) for execution at the address to. Relative operands are
+/// adjusted, short jumps are widened and jumps or calls whose target is out of reach of a 32-bit displacement
+/// become absolute. Jumps into the copied range are redirected into the copy.
+/// \param offsets Optional output of the offset of every instruction in the copied range and the offset of its
+///     counterpart in the copy.
+/// \return The relocated code. Empty if an instruction can not be decoded or relocated, for example because a
+///     RIP-relative memory operand is out of reach from the address to.
+std::vector<unsigned char> RelocateCode(uintptr_t from, int size, uintptr_t to,
+                                        std::vector<std::pair<int, int>>* offsets = nullptr);
+}
+
+#endif
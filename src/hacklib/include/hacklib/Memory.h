@@ -50,6 +50,10 @@ uintptr_t GetPageSize();
 // is adjusted to prevent other data from being affected.
 // PageFree must be used to free the retrieved memory block.
 void* PageAlloc(size_t n, Protection protection);
+// Allocates like PageAlloc, but the whole block lies within maxDistance bytes of adr. The default distance lets code
+// in the block reach adr with a 32-bit relative displacement and vice versa. Free gaps of the memory map are tried
+// from the nearest outwards. Returns nullptr if no free memory is in range.
+void* PageAllocNear(uintptr_t adr, size_t n, Protection protection, uintptr_t maxDistance = 0x7fff0000);
 void PageFree(void* p, size_t n = 0);
 void PageProtect(const void* p, size_t n, Protection protection);
 
@@ -81,6 +85,17 @@ MemoryRegion GetMemoryByAddress(uintptr_t adr, int pid = 0);
 // The resulting memory map only contains regions with Status::Valid.
 // A pid of zero can be passed for the current process.
 std::vector<MemoryRegion> GetMemoryMap(int pid = 0);
+
+// Returns the number of bytes from the start of a region of the current process that can be read without faulting.
+// This is less than the region size for pages that the memory map reports as readable, but that are not backed,
+// like the pages of a file mapping beyond the end of the file. Zero for regions that are not readable or guarded.
+// The memory is not touched.
+size_t GetReadableSize(const MemoryRegion& region);
+
+// Returns one entry per page of [adr, adr + size) of the current process that is zero if the page was never
+// populated, like anonymous memory that was never written. Reading such a page would fault it in. Swapped out pages
+// are populated. Where this is not known, like on Windows, all pages are reported as populated.
+std::vector<uint8_t> GetPopulatedPages(uintptr_t adr, size_t size);
 }
 
 #endif
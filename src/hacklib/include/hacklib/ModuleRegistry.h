@@ -0,0 +1,111 @@
+#ifndef HACKLIB_MODULEREGISTRY_H
+#define HACKLIB_MODULEREGISTRY_H
+
+#include "hacklib/Memory.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace hl
+{
+/// A cache of the memory map of the current process that is shared by all scans. Readers share an immutable
+/// snapshot, so they never wait for the memory map to be read again. It is only read again when modules were loaded or
+/// unloaded since the snapshot was taken, or after an explicit invalidate. Taking a snapshot copies a
+/// std::shared_ptr out of a std::atomic, which briefly locks on standard libraries where that is not lock-free.
+/// Changes of the memory that do not load or unload a module, like a changed protection or newly allocated
+/// memory, are not detected.
+class ModuleRegistry
+{
+public:
+    /// The state of the memory map at one point in time. The memory map is never modified after it was published.
+    class Snapshot
+    {
+    public:
+        /// Increases with every refresh of the registry.
+        [[nodiscard]] uint64_t generation() const { return m_generation; }
+        /// Returns all memory regions with Status::Valid.
+        [[nodiscard]] const std::vector<hl::MemoryRegion>& memoryMap() const { return m_memoryMap; }
+        /// Returns the executable regions of the module in ascending order. Empty if there are none.
+        [[nodiscard]] std::span<const hl::MemoryRegion> codeRegions(hl::ModuleHandle hModule) const;
+        /// Returns the address range [begin, end) that is covered by the regions of the module. Empty if the module
+        /// has no regions.
+        [[nodiscard]] std::pair<uintptr_t, uintptr_t> moduleExtent(hl::ModuleHandle hModule) const;
+
+    private:
+        friend class ModuleRegistry;
+
+        // Returns the module that the name was resolved to while this snapshot was current, or NullModuleHandle.
+        [[nodiscard]] hl::ModuleHandle findModuleName(const std::string& moduleName) const;
+
+        uint64_t m_generation = 0;
+        // The platform load counter and the invalidate counter when the memory map was read.
+        uint64_t m_loadCount = 0;
+        uint64_t m_invalidateCount = 0;
+        std::vector<hl::MemoryRegion> m_memoryMap;
+        std::unordered_map<hl::ModuleHandle, std::vector<hl::MemoryRegion>> m_codeRegions;
+        std::unordered_map<hl::ModuleHandle, std::pair<uintptr_t, uintptr_t>> m_extents;
+        // Module names are resolved on demand, which is the only change after publishing.
+        mutable std::shared_mutex m_moduleNamesMutex;
+        mutable std::unordered_map<std::string, hl::ModuleHandle> m_moduleNames;
+        // Set when getCodeRegions returned a reference into this snapshot.
+        mutable std::atomic<bool> m_retained = false;
+    };
+
+    /// Executable regions of a module together with the snapshot that they refer into.
+    struct CodeRegions
+    {
+        std::shared_ptr<const Snapshot> snapshot;
+        std::span<const hl::MemoryRegion> regions;
+    };
+
+    ModuleRegistry() = default;
+    ModuleRegistry(const ModuleRegistry&) = delete;
+    ModuleRegistry& operator=(const ModuleRegistry&) = delete;
+
+    /// Returns the current snapshot. Refreshes it first if modules were loaded or unloaded since it was taken.
+    /// Safe to call from multiple threads. Concurrent callers that find the snapshot outdated wait for a single
+    /// refresh.
+    [[nodiscard]] std::shared_ptr<const Snapshot> snapshot();
+    /// Forces the next call of snapshot to read the memory map again. Use this after changes that are not
+    /// detected, like mapping new code.
+    void invalidate();
+
+    /// Returns the executable regions of a module. The reference stays valid for the lifetime of the registry, because
+    /// snapshots that it refers into are retained even after a refresh.
+    /// \param moduleName The name of the module or empty string for the main module.
+    /// Throws std::runtime_error if there is no such module or if it has no code regions.
+    [[nodiscard]] const std::vector<hl::MemoryRegion>& getCodeRegions(const std::string& moduleName = "");
+    /// Like getCodeRegions, but neither copies the regions nor resolves the name again if it was already resolved for
+    /// the current snapshot. Only then modules are not checked for loads or unloads, so call invalidate after
+    /// unloading a module that is still scanned by name.
+    [[nodiscard]] CodeRegions findCodeRegions(const std::string& moduleName = "");
+
+private:
+    // Platform specific. Returns a value that changes whenever a module is loaded or unloaded.
+    static uint64_t GetLoadCount();
+
+    // Resolves the module name, refreshes the snapshot if needed and remembers the name in it.
+    CodeRegions resolveCodeRegions(const std::string& moduleName);
+
+    std::atomic<std::shared_ptr<const Snapshot>> m_snapshot;
+    std::atomic<uint64_t> m_invalidateCount = 0;
+    std::mutex m_refreshMutex;
+    // Snapshots that getCodeRegions returned references into. Only grows with refreshes.
+    std::vector<std::shared_ptr<const Snapshot>> m_retainedSnapshots;
+    std::mutex m_retainedMutex;
+};
+
+/// Returns the process wide hl::ModuleRegistry that is used by hl::FindPattern, hl::PatternScanner and the other
+/// module based scanner APIs.
+ModuleRegistry& GetModuleRegistry();
+}
+
+#endif
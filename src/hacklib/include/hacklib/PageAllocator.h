@@ -59,6 +59,51 @@ class code_page_allocator : public page_allocator<T, hl::PROTECTION_READ_WRITE_E
 };
 
 using code_page_vector = std::vector<unsigned char, code_page_allocator<unsigned char>>;
+
+// Allocates executable pages near a location with hl::PageAllocNear, so that code in them can reach the location with
+// a 32-bit relative displacement. Falls back to pages anywhere if there is no free memory in range.
+template <typename T>
+class near_code_page_allocator
+{
+public:
+    using value_type = T;
+
+    explicit near_code_page_allocator(uintptr_t location = 0) : m_location(location) {}
+    template <typename U>
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    near_code_page_allocator(const near_code_page_allocator<U>& other) : m_location(other.location())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        T* adr = m_location ? (T*)PageAllocNear(m_location, n * sizeof(T), PROTECTION_READ_WRITE_EXECUTE) : nullptr;
+        if (!adr)
+        {
+            adr = (T*)PageAlloc(n * sizeof(T), PROTECTION_READ_WRITE_EXECUTE);
+        }
+        if (!adr)
+        {
+            throw std::bad_alloc();
+        }
+        return adr;
+    }
+    void deallocate(T* p, size_t n) { PageFree(p, n * sizeof(T)); }
+
+    [[nodiscard]] uintptr_t location() const { return m_location; }
+
+    // Memory of any instance can be freed by any other.
+    template <typename U>
+    bool operator==(const near_code_page_allocator<U>&) const
+    {
+        return true;
+    }
+
+private:
+    uintptr_t m_location;
+};
+
+using near_code_page_vector = std::vector<unsigned char, near_code_page_allocator<unsigned char>>;
 }
 
 #endif
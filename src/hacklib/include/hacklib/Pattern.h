@@ -0,0 +1,403 @@
+#ifndef HACKLIB_PATTERN_H
+#define HACKLIB_PATTERN_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace hl
+{
+// Implementation detail. Approximate number of occurrences of each byte value in 65536 bytes of x86-64 code.
+// Measured on the .text sections of a Linux distribution. 0xcc was raised to account for the int3 padding
+// between functions that is emitted by MSVC.
+inline constexpr std::array<uint16_t, 256> CodeByteFrequency = {
+    8320, 1203, 443, 324, 489, 330, 151, 166, 728, 124, 93, 109, 157, 115, 70, 2246,
+    631, 181, 65, 57, 129, 189, 64, 54, 325, 49, 43, 42, 84, 58, 48, 478,
+    346, 76, 43, 38, 1930, 130, 34, 38, 300, 185, 37, 73, 74, 58, 138, 42,
+    226, 419, 34, 46, 77, 122, 34, 45, 194, 342, 43, 106, 119, 136, 42, 57,
+    450, 995, 83, 158, 879, 350, 89, 116, 4804, 774, 62, 59, 1154, 265, 51, 54,
+    225, 43, 40, 152, 226, 189, 99, 104, 125, 37, 35, 157, 178, 201, 106, 97,
+    138, 54, 157, 79, 128, 51, 751, 43, 109, 47, 40, 53, 113, 52, 60, 167,
+    182, 37, 87, 85, 585, 302, 59, 74, 122, 41, 36, 78, 225, 114, 108, 122,
+    282, 141, 48, 872, 839, 783, 50, 70, 141, 2600, 42, 1901, 83, 1017, 41, 39,
+    198, 29, 30, 34, 95, 55, 27, 29, 77, 32, 23, 24, 54, 33, 24, 27,
+    87, 56, 26, 31, 40, 28, 24, 25, 78, 27, 36, 31, 58, 27, 23, 44,
+    93, 44, 24, 31, 76, 44, 135, 89, 159, 103, 162, 52, 132, 73, 171, 106,
+    644, 360, 152, 333, 239, 225, 231, 428, 147, 144, 74, 47, 2000, 51, 59, 54,
+    157, 94, 152, 75, 55, 64, 70, 64, 145, 78, 69, 115, 48, 66, 92, 196,
+    183, 115, 108, 71, 78, 75, 96, 130, 1111, 453, 98, 268, 133, 125, 131, 219,
+    170, 76, 113, 155, 61, 129, 244, 187, 238, 133, 150, 142, 147, 258, 462, 3011,
+};
+
+// Implementation detail. Approximate number of occurrences of bytes that match the value under the mask.
+constexpr uint32_t MaskedByteFrequency(uint8_t value, uint8_t mask)
+{
+    if (mask == 0xff)
+        return CodeByteFrequency[value];
+
+    uint32_t frequency = 0;
+    for (size_t b = 0; b < 256; b++)
+    {
+        if ((b & mask) == value)
+            frequency += CodeByteFrequency[b];
+    }
+    return frequency;
+}
+
+// Implementation detail. The precomputed search strategy of a pattern.
+struct PatternPlan
+{
+    // The two checked bytes that are compared first when searching for candidates. These are the bytes that are
+    // least likely to occur in code, so that few candidates need to be verified.
+    bool hasAnchor = false;
+    size_t anchor1 = 0;
+    size_t anchor2 = 0;
+    // Horspool shift by the last byte of the current window. Wildcards limit the shift for every byte value.
+    std::array<uint32_t, 256> skip = {};
+};
+
+// Implementation detail. Creates the search plan for the part of a pattern before its first gap.
+constexpr PatternPlan MakePatternPlan(const uint8_t* bytes, const uint8_t* mask, size_t size)
+{
+    PatternPlan plan;
+
+    uint32_t frequency1 = 0;
+    uint32_t frequency2 = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (!mask[i])
+            continue;
+
+        const uint32_t frequency = MaskedByteFrequency(bytes[i], mask[i]);
+        if (!plan.hasAnchor)
+        {
+            plan.anchor1 = plan.anchor2 = i;
+            frequency1 = frequency2 = frequency;
+            plan.hasAnchor = true;
+        }
+        else if (frequency < frequency1)
+        {
+            plan.anchor2 = plan.anchor1;
+            frequency2 = frequency1;
+            plan.anchor1 = i;
+            frequency1 = frequency;
+        }
+        else if (plan.anchor2 == plan.anchor1 || frequency < frequency2)
+        {
+            plan.anchor2 = i;
+            frequency2 = frequency;
+        }
+    }
+
+    size_t defaultShift = size;
+    for (size_t i = 0; i + 1 < size; i++)
+    {
+        if (!mask[i])
+            defaultShift = size - 1 - i;
+    }
+    plan.skip.fill((uint32_t)defaultShift);
+    for (size_t i = 0; i + 1 < size; i++)
+    {
+        if (mask[i] == 0xff)
+        {
+            plan.skip[bytes[i]] = std::min(plan.skip[bytes[i]], (uint32_t)(size - 1 - i));
+        }
+        else if (mask[i])
+        {
+            // Partially masked bytes limit the shift of every byte value they match.
+            for (size_t b = 0; b < 256; b++)
+            {
+                if ((b & mask[i]) == bytes[i])
+                    plan.skip[b] = std::min(plan.skip[b], (uint32_t)(size - 1 - i));
+            }
+        }
+    }
+
+    return plan;
+}
+
+
+// Implementation detail. A run of skipped bytes with a variable length within a pattern.
+struct PatternGap
+{
+    // The index of the byte of the pattern that follows the gap.
+    size_t offset = 0;
+    size_t min = 0;
+    size_t max = 0;
+};
+
+// Implementation detail. The longest gap that can be expressed in a pattern string.
+constexpr size_t MaxPatternGap = 0xffff;
+
+// Implementation detail. Parses the string format of hl::FindPattern. Calls onByte(value, mask) for every byte and
+// onGap(min, max) for every gap of variable length. Returns false if the format is invalid.
+template <typename OnByte, typename OnGap>
+constexpr bool ParsePatternString(std::string_view str, OnByte&& onByte, OnGap&& onGap)
+{
+    auto hexValue = [](char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+    auto parseDecimal = [](std::string_view digits, size_t& value)
+    {
+        value = 0;
+        for (char c : digits)
+        {
+            if (c < '0' || c > '9' || value > MaxPatternGap)
+                return false;
+            value = value * 10 + (size_t)(c - '0');
+        }
+        return !digits.empty() && value <= MaxPatternGap;
+    };
+
+    bool hasBytes = false;
+    bool hasGap = false;
+    size_t gapMin = 0;
+    size_t gapMax = 0;
+
+    size_t pos = 0;
+    while (pos < str.size())
+    {
+        if (str[pos] == ' ')
+        {
+            pos++;
+            continue;
+        }
+        const size_t tokenEnd = std::min(str.find(' ', pos), str.size());
+        const std::string_view token = str.substr(pos, tokenEnd - pos);
+        pos = tokenEnd;
+
+        // Gap of min to max bytes: "[2-6]"
+        if (token.front() == '[')
+        {
+            const size_t dash = token.find('-');
+            size_t min = 0;
+            size_t max = 0;
+            if (!hasBytes || token.back() != ']' || dash == std::string_view::npos ||
+                !parseDecimal(token.substr(1, dash - 1), min) ||
+                !parseDecimal(token.substr(dash + 1, token.size() - dash - 2), max) || min > max)
+                return false;
+            gapMin += min;
+            gapMax += max;
+            hasGap = true;
+            continue;
+        }
+
+        int value = 0;
+        int mask = 0;
+        if (token.size() == 2)
+        {
+            // Byte with optional nibble wildcards: "8b", "4?", "?b", "??"
+            for (char c : token)
+            {
+                value <<= 4;
+                mask <<= 4;
+                if (c != '?')
+                {
+                    if (hexValue(c) < 0)
+                        return false;
+                    value |= hexValue(c);
+                    mask |= 0xf;
+                }
+            }
+        }
+        else if (token.size() == 5 && token[2] == '/')
+        {
+            // Byte with bit mask: "8b/38"
+            if (hexValue(token[0]) < 0 || hexValue(token[1]) < 0 || hexValue(token[3]) < 0 || hexValue(token[4]) < 0)
+                return false;
+            mask = hexValue(token[3]) * 16 + hexValue(token[4]);
+            value = (hexValue(token[0]) * 16 + hexValue(token[1])) & mask;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (hasGap)
+        {
+            // Gaps of a fixed length are plain wildcards.
+            if (gapMin == gapMax)
+            {
+                for (size_t i = 0; i < gapMin; i++)
+                    onByte((uint8_t)0, (uint8_t)0);
+            }
+            else
+            {
+                onGap(gapMin, gapMax);
+            }
+            hasGap = false;
+            gapMin = gapMax = 0;
+        }
+        onByte((uint8_t)value, (uint8_t)mask);
+        hasBytes = true;
+    }
+
+    // A pattern can not end with a gap.
+    return !hasGap;
+}
+
+
+/// A non-owning description of a masked byte pattern and its search plan as it is consumed by the scanner.
+/// Created by hl::Pattern and hl::CompiledPattern.
+struct PatternView
+{
+    /// The bytes to compare. A byte of memory matches if it equals the byte after applying the mask.
+    const uint8_t* bytes = nullptr;
+    /// 0xff for bytes that must match, 0x00 for wildcards and anything in between for partial matches.
+    const uint8_t* mask = nullptr;
+    /// The number of bytes and mask bytes.
+    size_t size = 0;
+    /// Optional search plan for the bytes before the first gap.
+    const PatternPlan* plan = nullptr;
+    /// Optional verification of the bytes before the first gap that is specialized for the pattern.
+    bool (*verify)(const uint8_t* data) = nullptr;
+    /// Gaps of variable length between the bytes in ascending order.
+    const PatternGap* gaps = nullptr;
+    size_t numGaps = 0;
+
+    /// Returns the number of bytes before the first gap.
+    [[nodiscard]] constexpr size_t headSize() const { return numGaps ? gaps[0].offset : size; }
+    /// Returns the length of the longest possible match.
+    [[nodiscard]] constexpr size_t maxLength() const
+    {
+        size_t len = size;
+        for (size_t i = 0; i < numGaps; i++)
+            len += gaps[i].max;
+        return len;
+    }
+};
+
+// Implementation detail. Checks if the complete pattern matches at data without reading at or behind end.
+bool MatchPattern(const uint8_t* data, const uint8_t* end, const PatternView& pattern);
+
+
+// Implementation detail. Holds a string literal as template argument of hl::Pattern.
+template <size_t N>
+struct PatternString
+{
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    consteval PatternString(const char (&str)[N]) { std::copy_n(str, N, value); }
+
+    char value[N] = {};
+};
+
+/// A pattern in the string format of hl::FindPattern that is parsed at compile time.
+/// An invalid pattern string does not compile.
+/// Example: hl::FindPattern(hl::Pattern<"48 8b ?? ?? e8">(), moduleName)
+template <PatternString S>
+class Pattern
+{
+    static constexpr std::string_view Str = { S.value, sizeof(S.value) - 1 };
+
+    struct Counts
+    {
+        size_t bytes = 0;
+        size_t gaps = 0;
+    };
+
+    static consteval Counts count()
+    {
+        Counts result;
+        if (!ParsePatternString(
+                Str, [&](uint8_t, uint8_t) { result.bytes++; }, [&](size_t, size_t) { result.gaps++; }))
+            throw "invalid format of pattern string";
+        return result;
+    }
+
+    static constexpr Counts NumParsed = count();
+
+    struct Parsed
+    {
+        std::array<uint8_t, NumParsed.bytes> bytes = {};
+        std::array<uint8_t, NumParsed.bytes> mask = {};
+        std::array<PatternGap, NumParsed.gaps> gaps = {};
+    };
+
+    static consteval Parsed parse()
+    {
+        Parsed result;
+        size_t numBytes = 0;
+        size_t numGaps = 0;
+        ParsePatternString(
+            Str,
+            [&](uint8_t value, uint8_t mask)
+            {
+                result.bytes[numBytes] = value;
+                result.mask[numBytes] = mask;
+                numBytes++;
+            },
+            [&](size_t min, size_t max) { result.gaps[numGaps++] = { numBytes, min, max }; });
+        return result;
+    }
+
+    static constexpr Parsed Data = parse();
+    static constexpr size_t HeadSize = NumParsed.gaps ? Data.gaps[0].offset : NumParsed.bytes;
+    static constexpr PatternPlan Plan = MakePatternPlan(Data.bytes.data(), Data.mask.data(), HeadSize);
+
+    template <size_t... I>
+    static bool verifyImpl(const uint8_t* data, std::index_sequence<I...>)
+    {
+        return (((data[I] & Data.mask[I]) == Data.bytes[I]) && ...);
+    }
+
+public:
+    /// The number of bytes in the pattern, not counting gaps.
+    static constexpr size_t Size = NumParsed.bytes;
+
+    /// Checks if the bytes before the first gap match at the given location.
+    static bool verify(const uint8_t* data) { return verifyImpl(data, std::make_index_sequence<HeadSize>()); }
+
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    operator PatternView() const
+    {
+        return { Data.bytes.data(), Data.mask.data(), Size, &Plan, &verify, Data.gaps.data(), NumParsed.gaps };
+    }
+};
+
+
+/// A pattern that is parsed once at runtime together with its search plan. Use this for patterns that are
+/// scanned for repeatedly.
+class CompiledPattern
+{
+public:
+    /// Parses a pattern in the string format of hl::FindPattern.
+    /// Throws std::runtime_error if the format is invalid.
+    explicit CompiledPattern(const std::string& pattern);
+    /// Uses a byte mask and check mask in the format of hl::FindPatternMask.
+    CompiledPattern(const char* byteMask, const char* checkMask);
+
+    [[nodiscard]] size_t size() const { return m_bytes.size(); }
+    [[nodiscard]] std::span<const uint8_t> bytes() const { return m_bytes; }
+    [[nodiscard]] std::span<const uint8_t> mask() const { return m_mask; }
+    [[nodiscard]] std::span<const PatternGap> gaps() const { return m_gaps; }
+
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    operator PatternView() const
+    {
+        return { m_bytes.data(), m_mask.data(), size(), &m_plan, nullptr, m_gaps.data(), m_gaps.size() };
+    }
+
+private:
+    void add(uint8_t value, uint8_t mask);
+
+    std::vector<uint8_t> m_bytes;
+    std::vector<uint8_t> m_mask;
+    std::vector<PatternGap> m_gaps;
+    PatternPlan m_plan;
+};
+}
+
+#endif
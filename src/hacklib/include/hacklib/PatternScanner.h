@@ -3,23 +3,61 @@
 
 #include "hacklib/Memory.h"
 #include "hacklib/ExeFile.h"
+#include "hacklib/Pattern.h"
+#include "hacklib/ModuleRegistry.h"
+#include "hacklib/ScanCache.h"
+#include "hacklib/XrefIndex.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <ranges>
+#include <span>
 #include <cstdint>
 
 
 namespace hl
 {
+/// Cooperative cancellation of asynchronous scans. Copies share the same state.
+class CancellationToken
+{
+public:
+    /// Requests all scans that use this token to stop.
+    void cancel() { m_cancelled->store(true); }
+    [[nodiscard]] bool isCancelled() const { return m_cancelled->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled = std::make_shared<std::atomic<bool>>(false);
+};
+
+/// Options of asynchronous scans like hl::FindPatternAsync.
+struct AsyncScanOptions
+{
+    /// A cancelled scan stops before its next chunk and its future throws std::runtime_error.
+    CancellationToken cancellation;
+    /// Called on the worker thread with the number of bytes scanned so far and the total number of bytes.
+    /// The last call reports done == total.
+    std::function<void(size_t done, size_t total)> onProgress;
+};
+
+
 /// A helper for doing batch searches through memory regions.
+/// The memory map is taken from hl::GetModuleRegistry at every search, so modules that were loaded or unloaded
+/// after construction are handled.
 class PatternScanner
 {
 public:
     PatternScanner();
     /// Searches for referenced strings in code of the module.
+    /// All strings are resolved together with one pass over the readonly data and one pass over the code.
     std::vector<uintptr_t> find(const std::vector<std::string>& strings, const std::string& moduleName = "");
     /// Searches for one specific referenced string within the code of a module.
+    /// On x64 the references are looked up in a hl::XrefIndex that is built on first use for each module.
+    /// A negative instance is treated like 0.
     uintptr_t findString(const std::string& str, const std::string& moduleName = "", int instance = 0);
     /// Searches for referenced string in code of the module.
     /// \param strings The query strings.
@@ -27,14 +65,73 @@ public:
     /// \return A map from query strings to result addresses.
     std::map<std::string, uintptr_t> findMap(const std::vector<std::string>& strings,
                                              const std::string& moduleName = "");
+    /// Searches for many patterns in the code of the module with a single pass over the memory.
+    /// The patterns use the same format as hl::FindPattern.
+    /// \param patterns The query patterns.
+    /// \param moduleName The name of the target module or empty string for main module.
+    /// \return The first match of each pattern in the same order as the patterns or 0 if a pattern was not found.
+    std::vector<uintptr_t> findPatterns(std::span<const std::string> patterns, const std::string& moduleName = "");
+    /// Variant of find that runs in the background like hl::FindPatternAsync.
+    /// The scanner must not be used or destroyed until the future is ready.
+    std::future<std::vector<uintptr_t>> findAsync(const std::vector<std::string>& strings,
+                                                  const std::string& moduleName = "", AsyncScanOptions options = {});
 
 private:
+    // Takes the current snapshot of the module registry and drops the module state of an outdated snapshot.
+    void refresh();
+    hl::ModuleHandle getModule(const std::string& moduleName);
+    // Returns nullptr if references can not be verified with relocations.
+    const hl::ExeFile* getRelocs(const std::string& moduleName);
+    const hl::XrefIndex& getXrefIndex(const std::string& moduleName);
+    // Implementation of find and findAsync. Options are only given for asynchronous scans.
+    std::vector<uintptr_t> findStrings(const std::vector<std::string>& strings, const std::string& moduleName,
+                                       const AsyncScanOptions* options);
+    // Implementations of find and findString without the scan cache.
+    std::vector<uintptr_t> findReferences(const std::vector<std::string>& strings, const std::string& moduleName,
+                                          const AsyncScanOptions* options);
+    uintptr_t findStringReference(const std::string& str, const std::string& moduleName, int instance);
+
     std::unordered_map<std::string, hl::ModuleHandle> moduleMap;
     std::unordered_map<std::string, std::unique_ptr<hl::ExeFile>> exeFileMap;
     std::unordered_map<std::string, bool> verifyRelocsMap;
-    std::vector<hl::MemoryRegion> memoryMap;
+    std::unordered_map<std::string, std::unique_ptr<hl::XrefIndex>> xrefIndexMap;
+    std::shared_ptr<const hl::ModuleRegistry::Snapshot> snapshot;
+};
+
+
+/// Instruction set extensions that can be used by the pattern matching kernels.
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
 };
 
+/// Returns the best hl::SimdLevel that is supported by the CPU and operating system.
+SimdLevel GetSupportedSimdLevel();
+/// Limits the hl::SimdLevel that is used by pattern scans. All levels produce identical results.
+/// By default the best supported level is used. This is useful for testing and benchmarking.
+void SetMaxSimdLevel(SimdLevel level);
+
+
+/// Enables parallel scanning. Large memory regions are split into chunks that are scanned by an internal pool of
+/// numThreads worker threads. Results are identical to sequential scans. A value of one disables parallel scanning,
+/// which is the default. A value of zero uses one thread per hardware thread.
+void SetScanThreads(unsigned numThreads);
+
+
+/// Makes hl::ScanRegions skip the pages of anonymous memory that were never populated, like most of a large
+/// reservation from hl::PageReserve. Reading such pages would fault them in, which takes time and adds to the memory
+/// usage. Matches within these pages, which only contain zeros, or that extend into them are not found.
+/// File-backed memory and swapped out pages are always scanned. Only has an effect on Linux. The default is off.
+void SetSkipUnpopulatedPages(bool skip);
+
+
+/// Enables a persistent cache for module-wide scans of hl::FindPattern and hl::PatternScanner. Scans are answered
+/// from the cache if the memory at the cached address still matches and run only on a miss. The default is no cache.
+void SetScanCache(std::shared_ptr<ScanCache> cache);
+
 
 /// Finds a binary pattern with mask in executable sections of a module.
 /// The mask is a string containing 'x' to match and '?' to ignore.
@@ -45,17 +142,165 @@ uintptr_t FindPatternMask(const char* byteMask, const char* checkMask, const std
 uintptr_t FindPatternMask(const char* byteMask, const char* checkMask, uintptr_t address, size_t len, int instance = 0);
 /// More convenient and less error prone alternative.
 /// Example: "12 45 ?? 89 ?? ?? ?? cd ef"
+/// Besides full bytes and "??" wildcards, a byte can ignore a nibble like "4?" or "?b", or only compare the bits of
+/// a mask like "8b/38". A gap of a variable number of bytes like "[2-6]" can be placed between bytes.
+/// Example: "48 8b ?? [1-4] e8 ?? ?? ?? ??"
 uintptr_t FindPattern(const std::string& pattern, const std::string& moduleName = "", int instance = 0);
 /// \overload
 uintptr_t FindPattern(const std::string& pattern, uintptr_t address, size_t len, int instance = 0);
 
+/// Variant for precompiled patterns like hl::Pattern and hl::CompiledPattern. Does not parse anything. The code regions
+/// of a module are taken from hl::ModuleRegistry::findCodeRegions without copying them. Only scans of regions that are
+/// large enough to be split across the scan threads allocate memory.
+uintptr_t FindPattern(const PatternView& pattern, const std::string& moduleName = "", int instance = 0);
+/// \overload
+uintptr_t FindPattern(const PatternView& pattern, uintptr_t address, size_t len, int instance = 0);
+/// \overload
+uintptr_t FindPatternMask(const PatternView& pattern, const std::string& moduleName = "", int instance = 0);
+/// \overload
+uintptr_t FindPatternMask(const PatternView& pattern, uintptr_t address, size_t len, int instance = 0);
+
+/// Variant of hl::FindPattern for modules that runs in the background, so that the calling thread is never
+/// blocked. The scan runs on the pool of hl::SetScanThreads, or on a background thread of the library when parallel
+/// scanning is disabled. The module is scanned in chunks, with a check for cancellation and a progress report
+/// before each chunk. An invalid pattern throws immediately, all other errors are thrown by the future.
+std::future<uintptr_t> FindPatternAsync(const std::string& pattern, const std::string& moduleName = "",
+                                        int instance = 0, AsyncScanOptions options = {});
+/// \overload
+/// The memory of the pattern must stay valid until the future is ready. hl::Pattern is always valid.
+std::future<uintptr_t> FindPatternAsync(const PatternView& pattern, const std::string& moduleName = "",
+                                        int instance = 0, AsyncScanOptions options = {});
+
+/// A lazy range over all matches of a pattern in address order. The memory is only searched as far as the range
+/// is iterated, so stopping early skips the rest of the scan. Created by hl::FindAllPatterns.
+/// Iterators refer to the range object, so it must not be moved while iterating.
+class PatternMatches : public std::ranges::view_interface<PatternMatches>
+{
+public:
+    class Iterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = uintptr_t;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        uintptr_t operator*() const { return m_match; }
+        Iterator& operator++()
+        {
+            m_range->findNext(m_rangeIndex, m_match + 1, *this);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+        bool operator==(const Iterator& other) const { return m_match == other.m_match; }
+        bool operator==(std::default_sentinel_t) const { return m_match == 0; }
+
+    private:
+        friend class PatternMatches;
+
+        const PatternMatches* m_range = nullptr;
+        size_t m_rangeIndex = 0;
+        uintptr_t m_match = 0;
+    };
+
+    /// Searches the given address ranges in order. The owner keeps the memory of the pattern alive if needed.
+    PatternMatches(const PatternView& pattern, std::vector<std::pair<uintptr_t, size_t>> ranges,
+                   std::shared_ptr<const CompiledPattern> owner = nullptr)
+        : m_pattern(pattern)
+        , m_ranges(std::move(ranges))
+        , m_owner(std::move(owner))
+    {
+    }
+
+    [[nodiscard]] Iterator begin() const
+    {
+        Iterator it;
+        it.m_range = this;
+        if (!m_ranges.empty())
+            findNext(0, m_ranges[0].first, it);
+        return it;
+    }
+    [[nodiscard]] std::default_sentinel_t end() const { return {}; }
+
+private:
+    // Stores the first match at or after from in the range at rangeIndex or later ranges in the iterator.
+    void findNext(size_t rangeIndex, uintptr_t from, Iterator& it) const;
+
+    PatternView m_pattern;
+    std::vector<std::pair<uintptr_t, size_t>> m_ranges;
+    std::shared_ptr<const CompiledPattern> m_owner;
+};
+
+/// Returns a lazy range of all matches of the pattern in the code of a module in a single forward pass.
+/// This is more efficient than calling hl::FindPattern with increasing instance values.
+/// Example: for (uintptr_t adr : hl::FindAllPatterns("e8 ?? ?? ?? ??")) ...
+PatternMatches FindAllPatterns(const std::string& pattern, const std::string& moduleName = "");
+/// \overload
+PatternMatches FindAllPatterns(const std::string& pattern, uintptr_t address, size_t len);
+/// \overload
+/// The memory of the pattern must stay valid while the range is used.
+PatternMatches FindAllPatterns(const PatternView& pattern, const std::string& moduleName = "");
+/// \overload
+/// The memory of the pattern must stay valid while the range is used.
+PatternMatches FindAllPatterns(const PatternView& pattern, uintptr_t address, size_t len);
+
+/// Finds a pattern in the code sections of an executable file without loading it as module. The file should be
+/// loaded with hl::ExeFile::loadFromFile, which maps it into memory.
+/// \return The RVA of the match or 0 if there is none.
+uintptr_t FindPattern(const PatternView& pattern, const hl::ExeFile& file, int instance = 0);
+/// \overload
+uintptr_t FindPattern(const std::string& pattern, const hl::ExeFile& file, int instance = 0);
+/// Returns the RVAs of all matches of the pattern in the code sections of an executable file in ascending order.
+std::vector<uintptr_t> FindAllPatterns(const PatternView& pattern, const hl::ExeFile& file);
+/// \overload
+std::vector<uintptr_t> FindAllPatterns(const std::string& pattern, const hl::ExeFile& file);
+/// Resolves the references to strings in the code sections of an executable file like hl::PatternScanner::find.
+/// \return The RVAs of the references in the same order as the strings. 0 for strings that are not referenced.
+std::vector<uintptr_t> FindStringReferences(const std::vector<std::string>& strings, const hl::ExeFile& file);
+/// Searches many executable files for many patterns, for example to validate signatures against build artifacts.
+/// The files are scanned in parallel with a single pass over the code of each file.
+/// Throws std::runtime_error if a file can not be loaded.
+/// \param numThreads The number of threads. Zero uses one thread per hardware thread.
+/// \return The RVA of the first match of each pattern or 0, indexed by file and then by pattern.
+std::vector<std::vector<uintptr_t>> FindPatternsInFiles(std::span<const std::string> paths,
+                                                        std::span<const std::string> patterns,
+                                                        unsigned numThreads = 0);
+
+/// Returns all matches of a pattern in the memory regions of the current process that are selected by the predicate
+/// in ascending order. Unlike the module based scans, this covers any memory like heap, stack, anonymous and
+/// file-backed mappings. The memory map is read at every call.
+/// Regions that are not readable and guard pages are skipped. Pages that fault although the memory map claims they
+/// are readable, like the pages of file mappings beyond the end of the file, are detected without touching them
+/// and skipped. Large regions are scanned in parallel on the pool of hl::SetScanThreads. Unpopulated pages are
+/// skipped if enabled by hl::SetSkipUnpopulatedPages.
+/// Example: hl::ScanRegions([](const hl::MemoryRegion& r) { return r.name.empty(); }, "de c0 ad 0b")
+std::vector<uintptr_t> ScanRegions(const std::function<bool(const hl::MemoryRegion&)>& predicate,
+                                   const PatternView& pattern);
+/// \overload
+std::vector<uintptr_t> ScanRegions(const std::function<bool(const hl::MemoryRegion&)>& predicate,
+                                   const std::string& pattern);
+
+/// Generates the shortest signature that only matches at adr in the code of a module. The result uses the format
+/// of hl::FindPattern. Operands of references into the module and relocated bytes are wildcards, so that the
+/// signature survives rebuilds and relocation. The matches of a short prefix are found with one scan and then
+/// narrowed down byte by byte. Throws std::runtime_error if there is no unique signature within 256 bytes.
+std::string GenerateSignature(uintptr_t adr, const std::string& moduleName = "");
+
 /// Helper to follow relative addresses in instructions. For example in jumps and calls.
 /// \param adr The memory address of the relative address within an instruction
 /// \param trail The number of trailing bytes after the relative address until the next instruction.
 /// \return The resolved absolute address.
 uintptr_t FollowRelativeAddress(uintptr_t adr, int trail = 0);
 
-/// Returns a vector of hl::MemoryRegion%s.
+/// Returns the executable hl::MemoryRegion%s of a module from hl::GetModuleRegistry. Safe to call from multiple threads.
+/// The reference stays valid when modules are loaded or unloaded, but then refers to the old memory map.
 const std::vector<hl::MemoryRegion>& GetCodeRegions(const std::string& moduleName = "");
 }
 
@@ -34,6 +34,12 @@ private:
 Process LaunchProcess(const std::string& command, const std::vector<std::string>& args = {},
                       const std::string& initialDirectory = "");
 
+// Returns the operating system ID of the calling thread. Does not allocate memory.
+uint32_t GetCallingThreadId();
+// Returns true if the thread of the current process with the given ID did not exit yet. The ID of an exited thread
+// may be reused by a new thread. Does not allocate memory and preserves errno.
+bool IsThreadAlive(uint32_t threadId);
+
 }
 
 #endif
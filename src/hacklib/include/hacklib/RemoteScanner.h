@@ -0,0 +1,77 @@
+#ifndef HACKLIB_REMOTESCANNER_H
+#define HACKLIB_REMOTESCANNER_H
+
+#include "hacklib/Memory.h"
+#include "hacklib/Pattern.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace hl
+{
+/// Scans the memory of another process without injecting into it. The memory is copied in large chunks, while the
+/// next chunk is read in the background during matching of the current one.
+/// Results are identical to the in-process hl::FindPattern and hl::FindAllPatterns with the same arguments.
+class RemoteScanner
+{
+public:
+    /// The number of bytes that are read at once. Consecutive chunks overlap by the longest match minus one.
+    static constexpr size_t ChunkSize = 1024 * 1024;
+
+    /// Throws std::runtime_error if the process can not be opened.
+    explicit RemoteScanner(int pid);
+    ~RemoteScanner();
+    RemoteScanner(const RemoteScanner&) = delete;
+    RemoteScanner& operator=(const RemoteScanner&) = delete;
+
+    /// Returns the process ID.
+    [[nodiscard]] int pid() const { return m_pid; }
+    /// Returns the memory map of the process at construction or the last refresh.
+    [[nodiscard]] const std::vector<hl::MemoryRegion>& memoryMap() const { return m_memoryMap; }
+    /// Reads the memory map of the process again, for example after it loaded modules.
+    void refresh();
+
+    /// Copies memory of the process. Returns the number of bytes that could be read until the first inaccessible
+    /// page.
+    size_t read(uintptr_t adr, void* buffer, size_t len) const;
+
+    /// Finds a pattern in the code regions of a module of the process.
+    /// \param moduleName The file name or path of the module or empty string for the main module.
+    uintptr_t findPattern(const PatternView& pattern, const std::string& moduleName = "", int instance = 0) const;
+    /// \overload
+    /// Throws std::runtime_error if the range is not completely readable.
+    uintptr_t findPattern(const PatternView& pattern, uintptr_t address, size_t len, int instance = 0) const;
+    /// \overload
+    uintptr_t findPattern(const std::string& pattern, const std::string& moduleName = "", int instance = 0) const;
+    /// \overload
+    uintptr_t findPattern(const std::string& pattern, uintptr_t address, size_t len, int instance = 0) const;
+
+    /// Returns all matches of a pattern in the code regions of a module of the process in ascending order.
+    [[nodiscard]] std::vector<uintptr_t> findAllPatterns(const PatternView& pattern,
+                                                         const std::string& moduleName = "") const;
+    /// \overload
+    [[nodiscard]] std::vector<uintptr_t> findAllPatterns(const PatternView& pattern, uintptr_t address,
+                                                         size_t len) const;
+
+    /// Returns the code regions of a module of the process.
+    [[nodiscard]] std::vector<hl::MemoryRegion> getCodeRegions(const std::string& moduleName = "") const;
+
+private:
+    using Ranges = std::vector<std::pair<uintptr_t, size_t>>;
+
+    // Calls onMatch for every match in the ranges in ascending order until it returns false.
+    template <typename F>
+    void scan(const Ranges& ranges, const PatternView& pattern, F&& onMatch) const;
+    // Returns the address range that is covered by the module.
+    [[nodiscard]] std::pair<uintptr_t, uintptr_t> getModuleExtent(const std::string& moduleName) const;
+
+    int m_pid = 0;
+    // Process handle on Windows.
+    uintptr_t m_handle = 0;
+    std::vector<hl::MemoryRegion> m_memoryMap;
+};
+}
+
+#endif
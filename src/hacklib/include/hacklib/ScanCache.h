@@ -0,0 +1,74 @@
+#ifndef HACKLIB_SCANCACHE_H
+#define HACKLIB_SCANCACHE_H
+
+#include "hacklib/Handles.h"
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+
+namespace hl
+{
+/// A persistent cache of scan results in a memory mapped file.
+/// Results are stored as RVAs per module identity and query. The module identity is the build-id of the module or
+/// a hash of its code if it has none. Users of the cache must validate a hit by checking the memory at the RVA,
+/// because the identity of a patched module may stay the same.
+/// The cache can be shared between threads. It must not be opened by multiple processes at the same time.
+class ScanCache
+{
+public:
+    /// Opens the cache file or creates it if it does not exist or is invalid. Throws std::runtime_error on failure.
+    explicit ScanCache(const std::string& path);
+    ScanCache(const ScanCache&) = delete;
+    ScanCache& operator=(const ScanCache&) = delete;
+    ScanCache(ScanCache&&) = delete;
+    ScanCache& operator=(ScanCache&&) = delete;
+    ~ScanCache();
+
+    /// Returns the identity of a loaded module. The result is computed once per module and cache, and again after
+    /// modules were loaded or unloaded.
+    uint64_t getModuleId(hl::ModuleHandle hModule);
+
+    /// Returns the cached RVA for the query.
+    std::optional<uintptr_t> lookup(uint64_t moduleId, uint64_t queryHash);
+    /// Stores or replaces the RVA for the query.
+    void store(uint64_t moduleId, uint64_t queryHash, uintptr_t rva);
+
+    /// Returns the number of cached results.
+    [[nodiscard]] size_t size();
+
+    /// Hashes arbitrary data for building query hashes. Chain calls by passing the previous result as seed.
+    static uint64_t Hash(std::span<const uint8_t> data, uint64_t seed = 14695981039346656037ull);
+
+private:
+    struct Header;
+    struct Entry;
+
+    // Maps the file with the given number of entries. Implemented per platform.
+    void map(size_t capacity);
+    void unmap();
+    // Returns the build-id of the module or zero if it has none. Implemented per platform.
+    static uint64_t GetBuildId(hl::ModuleHandle hModule);
+
+    Header* header();
+    Entry* entries();
+    Entry* findSlot(uint64_t moduleId, uint64_t queryHash);
+    void grow();
+
+    std::mutex m_mutex;
+    std::string m_path;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    // Platform specific handles of the file and mapping.
+    intptr_t m_file = -1;
+    intptr_t m_mapping = -1;
+    // Module to the generation of the module registry and the module ID.
+    std::unordered_map<hl::ModuleHandle, std::pair<uint64_t, uint64_t>> m_moduleIds;
+};
+}
+
+#endif
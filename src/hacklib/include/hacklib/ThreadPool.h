@@ -0,0 +1,50 @@
+#ifndef HACKLIB_THREADPOOL_H
+#define HACKLIB_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace hl
+{
+/// A fixed set of worker threads that execute queued tasks in order of submission.
+class ThreadPool
+{
+public:
+    /// \param numThreads The number of worker threads. Zero uses one thread per hardware thread.
+    explicit ThreadPool(unsigned numThreads = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+    /// Finishes all queued tasks and joins the worker threads.
+    ~ThreadPool();
+
+    /// Returns the number of worker threads.
+    [[nodiscard]] unsigned size() const { return (unsigned)m_threads.size(); }
+
+    /// Queues a task for execution on one of the worker threads.
+    void submit(std::function<void()> task);
+
+    /// Calls body for every index in [0, count) and returns when all calls are done. The calling thread takes
+    /// part in the work, so this may also be used from within a task of the pool.
+    /// The first exception thrown by body is rethrown after all calls are done.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    void workerThread();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condVar;
+    bool m_stop = false;
+};
+}
+
+#endif
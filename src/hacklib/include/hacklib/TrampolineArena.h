@@ -0,0 +1,66 @@
+#ifndef HACKLIB_TRAMPOLINEARENA_H
+#define HACKLIB_TRAMPOLINEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+namespace hl
+{
+/// Sub-allocates executable slots of a fixed size from large blocks of code pages, so that many hooks share a few
+/// pages and memory map entries instead of each using its own page. Freed slots are reused.
+/// Blocks are allocated near the requested location where possible, see hl::PageAllocNear. Blocks are only released
+/// when the arena is destroyed.
+class TrampolineArena
+{
+public:
+    /// Slots start on a cache line.
+    static constexpr size_t SlotAlignment = 64;
+    static constexpr size_t DefaultBlockSize = 0x10000;
+
+    /// \param slotSize The size of every slot. Rounded up to SlotAlignment.
+    /// \param blockSize The size of the blocks that slots are taken from. Rounded up to the page size.
+    explicit TrampolineArena(size_t slotSize, size_t blockSize = DefaultBlockSize);
+    TrampolineArena(const TrampolineArena&) = delete;
+    TrampolineArena& operator=(const TrampolineArena&) = delete;
+    TrampolineArena(TrampolineArena&&) = delete;
+    TrampolineArena& operator=(TrampolineArena&&) = delete;
+    /// All slots must have been freed or must not be used anymore.
+    ~TrampolineArena();
+
+    /// Returns a readable, writable and executable slot that is filled with INT3 instructions. The slot lies within
+    /// reach of a 32-bit displacement from location if there is free memory in reach, and anywhere otherwise. A
+    /// location of zero means anywhere. Safe to call from multiple threads.
+    /// Throws std::bad_alloc if no memory could be allocated.
+    [[nodiscard]] unsigned char* allocate(uintptr_t location = 0);
+    /// Returns a slot for reuse. Safe to call from multiple threads.
+    void free(unsigned char* slot);
+
+    /// Returns the size of every slot.
+    [[nodiscard]] size_t slotSize() const { return m_slotSize; }
+    /// Returns the number of allocated blocks.
+    [[nodiscard]] size_t numBlocks() const;
+
+private:
+    struct Block
+    {
+        uintptr_t base = 0;
+        // Slots beyond this offset were never handed out.
+        size_t used = 0;
+        // Intrusive list of freed slots. The link is stored in the slot.
+        unsigned char* freeList = nullptr;
+    };
+
+    // Takes a slot from the block or returns nullptr if it is full.
+    unsigned char* take(Block& block);
+
+    size_t m_slotSize;
+    size_t m_blockSize;
+    std::vector<Block> m_blocks;
+    mutable std::mutex m_mutex;
+};
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef HACKLIB_XREFINDEX_H
+#define HACKLIB_XREFINDEX_H
+
+#include "hacklib/Memory.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace hl
+{
+/// The kind of instruction that contains a cross reference.
+enum class XrefType : uint8_t
+{
+    /// E8 call rel32
+    Call,
+    /// E9 jmp rel32
+    Jump,
+    /// 0F 8x jcc rel32
+    CondJump,
+    /// 8D lea with a RIP-relative (x64) or absolute (x86) memory operand
+    Address,
+    /// 8B mov load with a RIP-relative (x64) or absolute (x86) memory operand
+    Load
+};
+
+/// A decoded instruction that references another address.
+struct XrefInstruction
+{
+    XrefType type;
+    uintptr_t target;
+    /// The offset of the 32-bit displacement or address within the instruction.
+    size_t operandOffset;
+};
+
+/// The number of bytes that hl::DecodeXref may read. The longest encoding is REX + opcode + ModRM + disp32.
+constexpr size_t MaxXrefInstructionLen = 7;
+
+/// Decodes one of the encodings that are recognized by hl::XrefIndex at adr.
+/// \param available The number of readable bytes at adr. Encodings that do not fit are rejected.
+std::optional<XrefInstruction> DecodeXref(uintptr_t adr, size_t available = MaxXrefInstructionLen);
+
+
+/// An index of the cross references in code, built with a single pass over the code.
+/// The code is not disassembled. Instead every byte offset is checked for the supported encodings, so a reference
+/// is only recorded if its target lies within the target range. Queries take logarithmic time.
+class XrefIndex
+{
+public:
+    /// Indexes the code of a module. Only references into the module are recorded.
+    /// \param moduleName The name of the target module or empty string for main module.
+    explicit XrefIndex(const std::string& moduleName = "");
+    /// Indexes the given code regions. Only references to targets in [targetBegin, targetEnd) are recorded.
+    /// The code and the targets must lie within 4 GiB.
+    XrefIndex(std::span<const hl::MemoryRegion> codeRegions, uintptr_t targetBegin, uintptr_t targetEnd);
+
+    /// Returns the address of every instruction that references the target in ascending order.
+    [[nodiscard]] std::vector<uintptr_t> referencesTo(uintptr_t target) const;
+    /// Returns the address of every instruction of the given type that references the target in ascending order.
+    [[nodiscard]] std::vector<uintptr_t> referencesTo(uintptr_t target, XrefType type) const;
+    /// Returns the address of every call instruction to the function in ascending order.
+    [[nodiscard]] std::vector<uintptr_t> callersOf(uintptr_t function) const;
+
+    /// Returns the number of recorded references.
+    [[nodiscard]] size_t size() const { return m_edges.size(); }
+
+private:
+    // Addresses are stored as offsets from m_base to halve the memory usage on x64.
+    struct Edge
+    {
+        uint32_t target;
+        uint32_t source;
+        XrefType type;
+    };
+
+    void build(std::span<const hl::MemoryRegion> codeRegions, uintptr_t targetBegin, uintptr_t targetEnd);
+    void scanRegion(const uint8_t* begin, const uint8_t* end, uintptr_t targetBegin, uintptr_t targetEnd);
+
+    uintptr_t m_base = 0;
+    // Sorted by target, type and source.
+    std::vector<Edge> m_edges;
+};
+}
+
+#endif
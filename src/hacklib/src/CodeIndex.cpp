@@ -0,0 +1,293 @@
+#include "hacklib/CodeIndex.h"
+#include "hacklib/PatternScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+// Suffix array construction by induced sorting (SA-IS) in linear time.
+// Based on the implementation of the AtCoder Library (CC0).
+template <typename T>
+static std::vector<int32_t> SuffixArrayInducedSorting(std::span<const T> s, int32_t upper)
+{
+    const auto n = (int32_t)s.size();
+    if (n == 0)
+        return {};
+    if (n == 1)
+        return { 0 };
+    if (n == 2)
+        return s[0] < s[1] ? std::vector<int32_t>{ 0, 1 } : std::vector<int32_t>{ 1, 0 };
+
+    std::vector<int32_t> sa(n);
+    // Whether each suffix is an S-type suffix, that is smaller than its successor.
+    std::vector<bool> ls(n);
+    for (int32_t i = n - 2; i >= 0; i--)
+        ls[i] = s[i] == s[i + 1] ? ls[i + 1] : s[i] < s[i + 1];
+
+    // Bucket boundaries of the L-type and S-type suffixes per character.
+    std::vector<int32_t> sumL(upper + 1), sumS(upper + 1);
+    for (int32_t i = 0; i < n; i++)
+    {
+        if (!ls[i])
+            sumS[s[i]]++;
+        else
+            sumL[s[i] + 1]++;
+    }
+    for (int32_t i = 0; i <= upper; i++)
+    {
+        sumS[i] += sumL[i];
+        if (i < upper)
+            sumL[i + 1] += sumS[i];
+    }
+
+    auto induce = [&](const std::vector<int32_t>& lms)
+    {
+        std::ranges::fill(sa, -1);
+        std::vector<int32_t> buf(upper + 1);
+        std::ranges::copy(sumS, buf.begin());
+        for (auto d : lms)
+        {
+            if (d != n)
+                sa[buf[s[d]]++] = d;
+        }
+        std::ranges::copy(sumL, buf.begin());
+        sa[buf[s[n - 1]]++] = n - 1;
+        for (int32_t i = 0; i < n; i++)
+        {
+            const int32_t v = sa[i];
+            if (v >= 1 && !ls[v - 1])
+                sa[buf[s[v - 1]]++] = v - 1;
+        }
+        std::ranges::copy(sumL, buf.begin());
+        for (int32_t i = n - 1; i >= 0; i--)
+        {
+            const int32_t v = sa[i];
+            if (v >= 1 && ls[v - 1])
+                sa[--buf[s[v - 1] + 1]] = v - 1;
+        }
+    };
+
+    // Leftmost S-type positions.
+    std::vector<int32_t> lmsMap(n + 1, -1);
+    std::vector<int32_t> lms;
+    for (int32_t i = 1; i < n; i++)
+    {
+        if (!ls[i - 1] && ls[i])
+        {
+            lmsMap[i] = (int32_t)lms.size();
+            lms.push_back(i);
+        }
+    }
+    const auto m = (int32_t)lms.size();
+
+    induce(lms);
+
+    if (m)
+    {
+        std::vector<int32_t> sortedLms;
+        sortedLms.reserve(m);
+        for (auto v : sa)
+        {
+            if (lmsMap[v] != -1)
+                sortedLms.push_back(v);
+        }
+
+        // Name the LMS substrings and sort them recursively.
+        std::vector<int32_t> recS(m);
+        int32_t recUpper = 0;
+        recS[lmsMap[sortedLms[0]]] = 0;
+        for (int32_t i = 1; i < m; i++)
+        {
+            int32_t l = sortedLms[i - 1];
+            int32_t r = sortedLms[i];
+            const int32_t endL = lmsMap[l] + 1 < m ? lms[lmsMap[l] + 1] : n;
+            const int32_t endR = lmsMap[r] + 1 < m ? lms[lmsMap[r] + 1] : n;
+            bool same = true;
+            if (endL - l != endR - r)
+            {
+                same = false;
+            }
+            else
+            {
+                while (l < endL && s[l] == s[r])
+                {
+                    l++;
+                    r++;
+                }
+                if (l == n || s[l] != s[r])
+                    same = false;
+            }
+            if (!same)
+                recUpper++;
+            recS[lmsMap[sortedLms[i]]] = recUpper;
+        }
+
+        const auto recSa = SuffixArrayInducedSorting<int32_t>(recS, recUpper);
+        for (int32_t i = 0; i < m; i++)
+            sortedLms[i] = lms[recSa[i]];
+        induce(sortedLms);
+    }
+
+    return sa;
+}
+
+
+hl::CodeIndex::CodeIndex(const std::string& moduleName)
+{
+    build(hl::GetCodeRegions(moduleName));
+}
+
+hl::CodeIndex::CodeIndex(std::span<const hl::MemoryRegion> regions)
+{
+    build(regions);
+}
+
+std::vector<uintptr_t> hl::CodeIndex::find(const PatternView& pattern) const
+{
+    std::vector<uintptr_t> results;
+
+    // Select the run of fixed bytes with the fewest occurrences. Only the bytes before the first gap have a fixed
+    // distance to the start of a match.
+    const size_t headSize = pattern.headSize();
+    size_t bestOffset = 0;
+    std::pair<size_t, size_t> bestRange = { 0, 0 };
+    bool hasRun = false;
+    for (size_t i = 0; i < headSize;)
+    {
+        if (pattern.mask[i] != 0xff)
+        {
+            i++;
+            continue;
+        }
+        size_t runEnd = i;
+        while (runEnd < headSize && pattern.mask[runEnd] == 0xff)
+            runEnd++;
+
+        const auto range = equalRange(pattern.bytes + i, runEnd - i);
+        if (!hasRun || range.second - range.first < bestRange.second - bestRange.first)
+        {
+            bestOffset = i;
+            bestRange = range;
+            hasRun = true;
+        }
+        i = runEnd;
+    }
+
+    auto addIfMatch = [&](size_t offset)
+    {
+        const Region& region = regionOf(offset);
+        if (MatchPattern(m_text.data() + offset, m_text.data() + region.offset + region.size, pattern))
+            results.push_back(region.base + (offset - region.offset));
+    };
+
+    if (hasRun)
+    {
+        for (size_t i = bestRange.first; i < bestRange.second; i++)
+        {
+            if (m_suffixes[i] >= bestOffset)
+                addIfMatch(m_suffixes[i] - bestOffset);
+        }
+        std::ranges::sort(results);
+    }
+    else
+    {
+        for (size_t offset = 0; offset + headSize <= m_text.size(); offset++)
+            addIfMatch(offset);
+    }
+
+    return results;
+}
+
+std::vector<uintptr_t> hl::CodeIndex::find(const std::string& pattern) const
+{
+    return find(CompiledPattern(pattern));
+}
+
+size_t hl::CodeIndex::uniqueLength(uintptr_t adr) const
+{
+    auto it = std::ranges::find_if(m_regions, [adr](const Region& r) { return adr >= r.base && adr - r.base < r.size; });
+    if (it == m_regions.end())
+        return 0;
+    const size_t offset = it->offset + (adr - it->base);
+
+    // The shortest unique prefix is one longer than the longest prefix shared with a neighbor in the suffix array.
+    const size_t rank = rankOf(offset);
+    size_t len = m_lcp[rank];
+    if (rank + 1 < m_suffixes.size())
+        len = std::max<size_t>(len, m_lcp[rank + 1]);
+    len++;
+
+    return offset - it->offset + len <= it->size ? len : 0;
+}
+
+
+void hl::CodeIndex::build(std::span<const hl::MemoryRegion> regions)
+{
+    size_t total = 0;
+    for (const auto& region : regions)
+        total += region.size;
+    if (total >= std::numeric_limits<int32_t>::max())
+        throw std::runtime_error("too much code to index");
+
+    m_text.reserve(total);
+    for (const auto& region : regions)
+    {
+        m_regions.push_back({ m_text.size(), region.base, region.size });
+        m_text.insert(m_text.end(), (const uint8_t*)region.base, (const uint8_t*)region.base + region.size);
+    }
+
+    const auto sa = SuffixArrayInducedSorting<uint8_t>(m_text, 255);
+    m_suffixes.assign(sa.begin(), sa.end());
+
+    // Kasai's algorithm.
+    const size_t n = m_text.size();
+    m_rank.resize(n);
+    for (size_t i = 0; i < n; i++)
+        m_rank[m_suffixes[i]] = (uint32_t)i;
+    m_lcp.assign(n, 0);
+    size_t h = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (m_rank[i] == 0)
+        {
+            h = 0;
+            continue;
+        }
+        const size_t j = m_suffixes[m_rank[i] - 1];
+        while (i + h < n && j + h < n && m_text[i + h] == m_text[j + h])
+            h++;
+        m_lcp[m_rank[i]] = (uint32_t)h;
+        if (h)
+            h--;
+    }
+}
+
+std::pair<size_t, size_t> hl::CodeIndex::equalRange(const uint8_t* bytes, size_t len) const
+{
+    // Compares only the first len bytes of the suffix, so that all suffixes starting with the bytes are equal.
+    auto compare = [&](uint32_t suffix)
+    {
+        const size_t n = std::min(len, m_text.size() - suffix);
+        const int result = memcmp(m_text.data() + suffix, bytes, n);
+        if (result != 0 || n == len)
+            return result;
+        // A shorter suffix with the same beginning is smaller.
+        return -1;
+    };
+
+    const auto first = std::ranges::partition_point(m_suffixes, [&](uint32_t s) { return compare(s) < 0; });
+    const auto last = std::ranges::partition_point(first, m_suffixes.end(), [&](uint32_t s) { return compare(s) == 0; });
+    return { (size_t)(first - m_suffixes.begin()), (size_t)(last - m_suffixes.begin()) };
+}
+
+const hl::CodeIndex::Region& hl::CodeIndex::regionOf(size_t offset) const
+{
+    auto it = std::ranges::upper_bound(m_regions, offset, {}, &Region::offset);
+    return *(it - 1);
+}
+
+size_t hl::CodeIndex::rankOf(size_t offset) const
+{
+    return m_rank[offset];
+}
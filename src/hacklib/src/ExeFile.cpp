@@ -1,26 +1,8 @@
 #include "hacklib/ExeFile.h"
 #include <algorithm>
-#include <fstream>
+#include <stdexcept>
 
 
-bool hl::ExeFile::loadFromFile(const std::string& path)
-{
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    const size_t size = (size_t)file.tellg();
-    file.seekg(0, std::ios::beg);
-    if (size == (size_t)-1)
-    {
-        return false;
-    }
-
-    std::vector<char> buf(size);
-    if (file.read(buf.data(), static_cast<std::streamsize>(size)))
-    {
-        return loadFromMem((uintptr_t)buf.data());
-    }
-    return false;
-}
-
 bool hl::ExeFile::hasRelocs() const
 {
     if (!m_valid)
@@ -1,5 +1,10 @@
 #include "hacklib/ExeFile.h"
 #include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cstring>
 
 
@@ -21,10 +26,23 @@ using Elf_Rel = Elf32_Rel;
 class hl::ExeFileImpl
 {
 public:
+    ~ExeFileImpl() { unmapFile(); }
+
+    void unmapFile()
+    {
+        if (fileData)
+            munmap(fileData, fileSize);
+        fileData = nullptr;
+        fileSize = 0;
+    }
+
     Elf_Ehdr* elfHeader = nullptr;
     Elf_Shdr* sectionHeaders = nullptr;
     Elf_Shdr* strTableHeader = nullptr;
     char* strTable = nullptr;
+    // The file mapping of loadFromFile.
+    void* fileData = nullptr;
+    size_t fileSize = 0;
 };
 
 
@@ -55,9 +73,38 @@ hl::ExeFile::ExeFile()
 hl::ExeFile::~ExeFile() = default;
 
 
+bool hl::ExeFile::loadFromFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat st = {};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Elf_Ehdr))
+    {
+        data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_impl->unmapFile();
+    m_impl->fileData = data;
+    m_impl->fileSize = (size_t)st.st_size;
+    return loadFromMem((uintptr_t)data);
+}
+
+
 bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
 {
     m_valid = false;
+    m_relocs.clear();
+    m_exports.clear();
+    m_sections.clear();
 
     m_impl->elfHeader = (Elf_Ehdr*)moduleBase;
     if (m_impl->elfHeader->e_ident[EI_MAG0] != ELFMAG0 || m_impl->elfHeader->e_ident[EI_MAG1] != ELFMAG1 ||
@@ -85,6 +132,25 @@ bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
         return false;
     }
 
+    // Executables that are not position independent are linked to the address of their first segment.
+    m_imageBase = 0;
+    if (m_impl->elfHeader->e_type == ET_EXEC)
+    {
+        auto programHeaders = (const Elf_Phdr*)(moduleBase + m_impl->elfHeader->e_phoff);
+        m_imageBase = UINTPTR_MAX;
+        for (int i = 0; i < m_impl->elfHeader->e_phnum; i++)
+        {
+            if (programHeaders[i].p_type == PT_LOAD)
+            {
+                m_imageBase = std::min(m_imageBase, (uintptr_t)programHeaders[i].p_vaddr);
+            }
+        }
+        if (m_imageBase == UINTPTR_MAX)
+        {
+            m_imageBase = 0;
+        }
+    }
+
     const size_t strTableSectionIndex = m_impl->elfHeader->e_shstrndx;
     m_impl->sectionHeaders = (Elf_Shdr*)(moduleBase + m_impl->elfHeader->e_shoff);
     m_impl->strTableHeader = &m_impl->sectionHeaders[strTableSectionIndex];
@@ -102,16 +168,24 @@ bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
         outSection.name = sectionName;
         if (section->sh_type != SHT_NOBITS)
         {
-            outSection.data.assign(sectionData, sectionData + section->sh_size);
+            outSection.data = { sectionData, (size_t)section->sh_size };
+        }
+        if (section->sh_flags & SHF_ALLOC)
+        {
+            outSection.rva = (uintptr_t)section->sh_addr - m_imageBase;
         }
 
         switch (section->sh_type)
         {
         case SHT_PROGBITS:
-            if (outSection.name == ".text")
+            if (section->sh_flags & SHF_EXECINSTR)
             {
                 outSection.type = SectionType::Code;
             }
+            else if ((section->sh_flags & SHF_ALLOC) && !(section->sh_flags & SHF_WRITE))
+            {
+                outSection.type = SectionType::ReadOnlyData;
+            }
             break;
 
         case SHT_SYMTAB:
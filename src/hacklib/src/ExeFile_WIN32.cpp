@@ -5,6 +5,17 @@
 class hl::ExeFileImpl
 {
 public:
+    ~ExeFileImpl() { unmapFile(); }
+
+    void unmapFile()
+    {
+        if (fileData)
+            UnmapViewOfFile(fileData);
+        fileData = nullptr;
+    }
+
+    // The file mapping of loadFromFile.
+    void* fileData = nullptr;
     IMAGE_DOS_HEADER* dosHeader = nullptr;
     IMAGE_NT_HEADERS* peHeader = nullptr;
     std::vector<IMAGE_SECTION_HEADER*> sectionHeaders;
@@ -77,9 +88,41 @@ hl::ExeFile::ExeFile()
 hl::ExeFile::~ExeFile() = default;
 
 
+bool hl::ExeFile::loadFromFile(const std::string& path)
+{
+    HANDLE file =
+        CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    // The view keeps the mapping alive.
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data)
+    {
+        return false;
+    }
+
+    m_impl->unmapFile();
+    m_impl->fileData = data;
+    return loadFromMem((uintptr_t)data);
+}
+
+
 bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
 {
     m_valid = false;
+    m_relocs.clear();
+    m_exports.clear();
+    m_sections.clear();
+    m_impl->sectionHeaders.clear();
 
     // Load DOS header and verify "MZ" signature.
     m_impl->dosHeader = (IMAGE_DOS_HEADER*)moduleBase;
@@ -107,6 +150,8 @@ bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
         return false;
     }
 
+    m_imageBase = (uintptr_t)m_impl->peHeader->OptionalHeader.ImageBase;
+
     // Load section headers.
     int nSections = m_impl->peHeader->FileHeader.NumberOfSections;
     for (int i = 0; i < nSections; i++)
@@ -127,12 +172,18 @@ bool hl::ExeFile::loadFromMem(uintptr_t moduleBase)
         if (sectionHeader->SizeOfRawData > 0)
         {
             auto sectionData = (const uint8_t*)(moduleBase + sectionHeader->PointerToRawData);
-            outSection.data.assign(sectionData, sectionData + sectionHeader->SizeOfRawData);
+            outSection.data = { sectionData, (size_t)sectionHeader->SizeOfRawData };
         }
+        outSection.rva = sectionHeader->VirtualAddress;
         if (sectionHeader->Characteristics & IMAGE_SCN_CNT_CODE)
         {
             outSection.type = SectionType::Code;
         }
+        else if ((sectionHeader->Characteristics & IMAGE_SCN_CNT_INITIALIZED_DATA) &&
+                 !(sectionHeader->Characteristics & IMAGE_SCN_MEM_WRITE))
+        {
+            outSection.type = SectionType::ReadOnlyData;
+        }
         m_sections.push_back(std::move(outSection));
     }
 
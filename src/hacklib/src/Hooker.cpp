@@ -1,15 +1,26 @@
 #include "hacklib/Hooker.h"
+#include "hacklib/BitManip.h"
+#include "hacklib/InstructionDecoder.h"
 #include "hacklib/PageAllocator.h"
+#include "hacklib/Process.h"
+#include "hacklib/TrampolineArena.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <map>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 
 
+// A relative jump. Reaches everything on 32-bit, but only targets within +-2 GB on 64-bit.
+static const int JMPSIZE_NEAR = 5;
 #ifdef ARCH_64BIT
-static const int JMPHOOKSIZE = 14;
+// An absolute jump for targets that a relative jump does not reach.
+static const int JMPSIZE_FAR = 14;
 #else
-static const int JMPHOOKSIZE = 5;
+static const int JMPSIZE_FAR = 5;
 #endif
 
 
@@ -122,75 +133,314 @@ public:
     int functionIndex;
 };
 
-class JMPHook : public IHook
+// x86 only guarantees that the two bytes are written at once if they do not cross a cache line. To be safe, they
+// must not cross an 8-byte boundary.
+static bool IsSpinAtomic(uintptr_t location)
+{
+    return location % 8 != 7;
+}
+
+// Writes code to a writable location while other threads may execute it. If IsSpinAtomic, the first two bytes are
+// replaced by a jump to itself first, so that threads arriving at the location spin instead of executing a partially
+// written instruction. Otherwise the code is simply copied and the caller must suspend the other threads. Threads
+// that are inside the overwritten instructions beyond the first one are not protected.
+static void WriteCode(uintptr_t location, const unsigned char* code, int size)
+{
+    if (!IsSpinAtomic(location))
+    {
+        memcpy((void*)location, code, size);
+        return;
+    }
+
+    const uint16_t spin = 0xfeeb; // JMP $
+    uint16_t head = 0;
+    memcpy(&head, code, sizeof(head));
+
+    *(volatile uint16_t*)location = spin;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    memcpy((void*)(location + 2), code + 2, size - 2);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    *(volatile uint16_t*)location = head;
+}
+
+// Returns the arena for wrapper code of the given size. Slot sizes are powers of two.
+static hl::TrampolineArena& GetTrampolineArena(size_t size)
+{
+    static std::mutex mutex;
+    // Never destroyed, so that hooks can still be removed during static destruction.
+    static auto& arenas = *new std::map<size_t, std::unique_ptr<hl::TrampolineArena>>;
+
+    size_t slotSize = hl::TrampolineArena::SlotAlignment;
+    while (slotSize < size)
+        slotSize *= 2;
+
+    const std::lock_guard lock(mutex);
+    auto& arena = arenas[slotSize];
+    if (!arena)
+        arena = std::make_unique<hl::TrampolineArena>(slotSize);
+    return *arena;
+}
+
+// A slot of wrapper code near a hooked location.
+class WrapperCode
 {
 public:
-    JMPHook(uintptr_t location, int offset) : location(location), offset(offset), wrapperCode(offset, 0xcc)
+    WrapperCode(uintptr_t location, size_t size) : m_arena(GetTrampolineArena(size)), m_data(m_arena.allocate(location))
     {
-        memcpy(wrapperCode.data(), (void*)location, offset);
     }
-    JMPHook(const JMPHook&) = delete;
-    JMPHook& operator=(const JMPHook&) = delete;
-    JMPHook(JMPHook&&) = delete;
-    JMPHook& operator=(JMPHook&&) = delete;
-    ~JMPHook() override
+    WrapperCode(const WrapperCode&) = delete;
+    WrapperCode& operator=(const WrapperCode&) = delete;
+    WrapperCode(WrapperCode&&) = delete;
+    WrapperCode& operator=(WrapperCode&&) = delete;
+    ~WrapperCode() { m_arena.free(m_data); }
+
+    [[nodiscard]] unsigned char* data() const { return m_data; }
+    [[nodiscard]] size_t size() const { return m_arena.slotSize(); }
+
+private:
+    hl::TrampolineArena& m_arena;
+    unsigned char* m_data;
+};
+
+
+// A hook that overwrites the code at its location with a jump. The hooker restores the code on unhook if the jump
+// was written, so hooks that failed or were discarded before a batch commit never touch the location.
+class PatchHook : public IHook
+{
+public:
+    [[nodiscard]] virtual const std::vector<unsigned char>& getOverwrittenCode() const = 0;
+};
+
+class JMPHook : public PatchHook
+{
+public:
+    // The wrapper code holds the relocated overwritten code, the jump back and a relay to the hook.
+    JMPHook(uintptr_t location, int offset)
+        : location(location)
+        , offset(offset)
+        , overwrittenCode((unsigned char*)location, (unsigned char*)location + offset)
+        , wrapperCode(location, hl::MaxRelocatedSize(location, offset) + 2 * JMPSIZE_FAR)
     {
-        hl::PageProtect((void*)location, offset, PROTECTION_READ_WRITE_EXECUTE);
-        memcpy((void*)location, wrapperCode.data(), offset);
-        hl::PageProtect((void*)location, offset, PROTECTION_READ_EXECUTE);
     }
 
     [[nodiscard]] uintptr_t getLocation() const override { return location; }
+    [[nodiscard]] const std::vector<unsigned char>& getOverwrittenCode() const override { return overwrittenCode; }
 
     uintptr_t location;
     int offset;
-    hl::code_page_vector wrapperCode;
+    std::vector<unsigned char> overwrittenCode;
+    WrapperCode wrapperCode;
 };
 
-class DetourHook : public IHook
+// The state that is referenced by the generated wrapper code of a detour hook.
+struct DetourWrapper
 {
-public:
-    DetourHook(uintptr_t location, int offset, Hooker::HookCallback_t cbHook)
+    // Upper bound of the size of the generated code besides the two copies of the overwritten code.
+    static constexpr size_t WrapperSize = 272;
+
+    DetourWrapper(uintptr_t location, int offset, Hooker::HookCallback_t cbHook)
         : location(location)
         , offset(offset)
-        , wrapperCode(0x1000, 0xcc)
+        , overwrittenCode((unsigned char*)location, (unsigned char*)location + offset)
+        , wrapperCode(location, WrapperSize + 2 * hl::MaxRelocatedSize(location, offset))
         , cbHook(cbHook)
     {
     }
+
+    uintptr_t location;
+    int offset;
+    std::vector<unsigned char> overwrittenCode;
+    uintptr_t ipBackup = 0;
+    // The first relocated copy of the overwritten code and the offsets of its instructions.
+    unsigned char* originalCode = nullptr;
+    std::vector<std::pair<int, int>> originalCodeOffsets;
+    WrapperCode wrapperCode;
+    Hooker::HookCallback_t cbHook;
+    // Set on unhook. Threads that enter the wrapper afterwards skip the callback.
+    std::atomic<bool> removed = false;
+    // The number of threads between the entry of the wrapper code and the end of the overwritten code. Threads that
+    // leave the overwritten code by a branch are never subtracted, so the wrapper is kept forever.
+    std::atomic<uintptr_t> inFlight = 0;
+};
+
+// Incremented and decremented by the generated code.
+static_assert(sizeof(std::atomic<uintptr_t>) == sizeof(uintptr_t) && std::atomic<uintptr_t>::is_always_lock_free);
+
+
+// Detour callbacks run concurrently without any lock. Every thread has an epoch that is odd while the thread runs
+// a callback. Unhooking waits until each thread that was running a callback has left it.
+// Threads claim a slot of a static array on their first callback, because allocating memory or registering a thread
+// exit handler would recurse into hooks of the allocator. Slots of exited threads are reused once all are taken.
+struct alignas(64) DispatchEpoch
+{
+    std::atomic<uint64_t> value = 0;
+    // The ID of the thread that owns the slot.
+    std::atomic<uint32_t> owner = 0;
+};
+
+static constexpr size_t MaxDispatchThreads = 4096;
+
+// Never destroyed, so that hooks can still be removed during static destruction.
+static DispatchEpoch g_dispatchEpochs[MaxDispatchThreads];
+// Slots behind this number were never claimed.
+static std::atomic<size_t> g_numDispatchEpochs = 0;
+// Shared by the threads that find no free slot. Its value counts the threads that run a callback.
+static DispatchEpoch g_overflowEpoch;
+
+// The glibc allocates the thread local storage of a library that was loaded by dlopen on the first access of each
+// thread, unless it is reserved when the library is loaded.
+#ifdef _MSC_VER
+#define HL_TLS_INITIAL_EXEC
+#else
+#define HL_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#endif
+
+static thread_local DispatchEpoch* t_dispatchEpoch HL_TLS_INITIAL_EXEC = nullptr;
+// The number of callbacks that the thread runs with the overflow epoch.
+static thread_local uint64_t t_overflowCallbacks HL_TLS_INITIAL_EXEC = 0;
+
+static DispatchEpoch* ClaimDispatchEpoch()
+{
+    const uint32_t self = hl::GetCallingThreadId();
+
+    size_t numEpochs = g_numDispatchEpochs.load();
+    while (numEpochs < MaxDispatchThreads)
+    {
+        if (g_numDispatchEpochs.compare_exchange_weak(numEpochs, numEpochs + 1))
+        {
+            g_dispatchEpochs[numEpochs].owner = self;
+            return &g_dispatchEpochs[numEpochs];
+        }
+    }
+
+    for (auto& epoch : g_dispatchEpochs)
+    {
+        uint32_t owner = epoch.owner.load();
+        if (owner && !hl::IsThreadAlive(owner) && epoch.owner.compare_exchange_strong(owner, self))
+        {
+            // Release unhooks that wait for a thread that exited inside a callback.
+            const auto value = epoch.value.load();
+            epoch.value = value + 2 - value % 2;
+            return &epoch;
+        }
+    }
+
+    return &g_overflowEpoch;
+}
+
+// Waits until all threads except the calling one have left the callbacks that they are running.
+static void SynchronizeDispatch()
+{
+    const DispatchEpoch* self = t_dispatchEpoch;
+    const size_t numEpochs = g_numDispatchEpochs.load();
+    for (size_t i = 0; i < numEpochs; i++)
+    {
+        const auto& epoch = g_dispatchEpochs[i];
+        const auto value = epoch.value.load();
+        if (value % 2 == 0 || &epoch == self)
+            continue;
+        const auto owner = epoch.owner.load();
+        while (epoch.value.load() == value && hl::IsThreadAlive(owner))
+            std::this_thread::yield();
+    }
+
+    while (g_overflowEpoch.value.load() > t_overflowCallbacks)
+        std::this_thread::yield();
+}
+
+
+// Wrappers of removed detour hooks that threads may still execute. They are freed by Hooker::PurgeRetiredWrappers.
+struct RetiredWrappers
+{
+    // Threads are not suspended again within this time after some could not be suspended.
+    static constexpr auto RetryDelay = std::chrono::seconds(1);
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<DetourWrapper>> wrappers;
+    std::chrono::steady_clock::time_point nextSuspend;
+};
+
+static RetiredWrappers& GetRetiredWrappers()
+{
+    // Never destroyed, so that hooks can still be removed during static destruction.
+    static auto& wrappers = *new RetiredWrappers;
+    return wrappers;
+}
+
+
+class DetourHook : public PatchHook
+{
+public:
+    explicit DetourHook(std::unique_ptr<DetourWrapper> wrapper) : wrapper(std::move(wrapper)) {}
     DetourHook(const DetourHook&) = delete;
     DetourHook& operator=(const DetourHook&) = delete;
     DetourHook(DetourHook&&) = delete;
     DetourHook& operator=(DetourHook&&) = delete;
     ~DetourHook() override
     {
-        hl::PageProtect((void*)location, offset, PROTECTION_READ_WRITE_EXECUTE);
-        memcpy((void*)location, originalCode, offset);
-        hl::PageProtect((void*)location, offset, PROTECTION_READ_EXECUTE);
-
-        // In case the hook is currently executing, wait for it to end before releasing the wrapper code.
-        const std::lock_guard lock(mutex);
-
-        // BUG: There is a slight chance that the execution flow will enter the hook again and
-        // will crash when trying to return because the wrapper code is gone.
+        // The original code was restored, so no thread enters the wrapper anymore. Wait for the threads in the
+        // callback, which may be called from within a callback itself.
+        wrapper->removed = true;
+        SynchronizeDispatch();
+
+        auto& retired = GetRetiredWrappers();
+        const std::lock_guard lock(retired.mutex);
+        retired.wrappers.push_back(std::move(wrapper));
     }
 
-    [[nodiscard]] uintptr_t getLocation() const override { return location; }
+    [[nodiscard]] uintptr_t getLocation() const override { return wrapper->location; }
+    [[nodiscard]] const std::vector<unsigned char>& getOverwrittenCode() const override
+    {
+        return wrapper->overwrittenCode;
+    }
 
-    uintptr_t location;
-    int offset;
-    uintptr_t ipBackup = 0;
-    unsigned char* originalCode = nullptr;
-    hl::code_page_vector wrapperCode;
-    Hooker::HookCallback_t cbHook;
-    std::mutex mutex;
+    std::unique_ptr<DetourWrapper> wrapper;
 };
 
 
-static void JMPHookLocker(DetourHook* pHook, CpuContext* ctx)
+// Called by the wrapper code. Returns true if the callback changed the instruction pointer.
+static bool DetourDispatch(DetourWrapper* pWrapper, CpuContext* ctx)
 {
-    const std::lock_guard lock(pHook->mutex);
+    DispatchEpoch* epoch = t_dispatchEpoch;
+    if (!epoch)
+        t_dispatchEpoch = epoch = ClaimDispatchEpoch();
+
+    // Must be ordered before the load of removed, which is written before the unhook reads the epochs.
+    const bool overflow = epoch == &g_overflowEpoch;
+    uint64_t value = 0;
+    if (overflow)
+    {
+        t_overflowCallbacks++;
+        epoch->value++;
+    }
+    else
+    {
+        value = epoch->value.load(std::memory_order_relaxed);
+        epoch->value.store(value + 1);
+    }
+
+    bool ipChanged = false;
+    if (!pWrapper->removed.load())
+    {
+        const uintptr_t returnAdr = pWrapper->location + pWrapper->offset;
+        pWrapper->cbHook(ctx);
+#ifdef ARCH_64BIT
+        ipChanged = ctx->RIP != returnAdr;
+#else
+        ipChanged = ctx->EIP != returnAdr;
+#endif
+    }
 
-    pHook->cbHook(ctx);
+    if (overflow)
+    {
+        epoch->value--;
+        t_overflowCallbacks--;
+    }
+    else
+    {
+        epoch->value.store(value + 2, std::memory_order_release);
+    }
+    return ipChanged;
 }
 
 
@@ -208,97 +458,241 @@ const IHook* Hooker::hookVT(uintptr_t classInstance, int functionIndex, uintptr_
 }
 
 
-#ifndef ARCH_64BIT
-static std::vector<unsigned char> GenJumpOverwrite_x86(uintptr_t target, uintptr_t location, int nextInstructionOffset)
+// Returns true if a relative jump at location reaches target.
+static bool IsJumpNear(uintptr_t target, uintptr_t location)
 {
-    // Calculate delta.
-    uintptr_t jmpFromLocToTarget = (uintptr_t)target - location - 5;
+    // Always true on 32-bit.
+    const auto delta = (intptr_t)(target - location - JMPSIZE_NEAR);
+    return (int64_t)delta == (int32_t)delta;
+}
 
+// Returns the size of the jump that GenJumpOverwrite generates.
+static int GetJumpSize(uintptr_t target, uintptr_t location)
+{
+    return IsJumpNear(target, location) ? JMPSIZE_NEAR : JMPSIZE_FAR;
+}
+
+static std::vector<unsigned char> GenJumpOverwrite(uintptr_t target, uintptr_t location, int nextInstructionOffset)
+{
     // Generate patch. Fill with NOPs.
     std::vector<unsigned char> jmpPatch(nextInstructionOffset, 0x90);
-    jmpPatch[0] = 0xe9; // JMP target
-    *(uintptr_t*)&jmpPatch[1] = jmpFromLocToTarget;
+    if (IsJumpNear(target, location))
+    {
+        jmpPatch[0] = 0xe9; // JMP target
+        *(uint32_t*)&jmpPatch[1] = (uint32_t)(target - location - JMPSIZE_NEAR);
+    }
+#ifdef ARCH_64BIT
+    else
+    {
+        // Unlike PUSH/RET, this keeps the return stack buffer balanced and does not write to the stack.
+        jmpPatch[0] = 0xff; // JMP [RIP+0]
+        jmpPatch[1] = 0x25;
+        *(uint32_t*)&jmpPatch[2] = 0;
+        *(uintptr_t*)&jmpPatch[6] = target;
+    }
+#endif
 
     return jmpPatch;
 }
 
-static void GenWrapper_x86(DetourHook* pHook)
+
+// Appends the overwritten code relocated for execution at buffer. Returns nullptr if it can not be relocated.
+static unsigned char* GenOriginalCode(const DetourWrapper* pWrapper, unsigned char* buffer,
+                                      std::vector<std::pair<int, int>>* offsets = nullptr)
 {
-    unsigned char* buffer = pHook->wrapperCode.data();
+    const auto code = hl::RelocateCode(pWrapper->location, pWrapper->offset, (uintptr_t)buffer, offsets);
+    if (code.empty())
+        return nullptr;
+    memcpy(buffer, code.data(), code.size());
+    return buffer + code.size();
+}
+
+// Maps the instructions inside the overwritten code at location to their counterparts in the copy.
+static std::vector<std::pair<uintptr_t, uintptr_t>> GetRelocatedIps(uintptr_t location, uintptr_t copy,
+                                                                    const std::vector<std::pair<int, int>>& offsets)
+{
+    std::vector<std::pair<uintptr_t, uintptr_t>> relocatedIps;
+    for (const auto& [offset, newOffset] : offsets)
+    {
+        // Threads at the start execute the jump.
+        if (offset > 0)
+            relocatedIps.emplace_back(location + offset, copy + newOffset);
+    }
+    return relocatedIps;
+}
+
+
+#ifndef ARCH_64BIT
+// Appends the decrement of the threads in flight after the overwritten code. Preserves all registers and flags.
+static unsigned char* GenLeaveWrapper_x86(DetourWrapper* pWrapper, unsigned char* buffer)
+{
+    buffer[0] = 0x9c; // PUSHFD
+    buffer[1] = 0xf0; // LOCK DEC [inFlight]
+    buffer[2] = 0xff;
+    buffer[3] = 0x0d;
+    *(std::atomic<uintptr_t>**)&buffer[4] = &pWrapper->inFlight;
+    buffer[8] = 0x9d; // POPFD
+
+    return buffer + 9;
+}
+
+static bool GenWrapper_x86(DetourWrapper* pWrapper)
+{
+    unsigned char* buffer = pWrapper->wrapperCode.data();
+    const uintptr_t returnAdr = pWrapper->location + pWrapper->offset;
 
     // Calculate delta.
-    uintptr_t callFromWrapperToLocker = (uintptr_t)JMPHookLocker - (uintptr_t)buffer - 13 - 5;
+    uintptr_t callFromWrapperToDispatch = (uintptr_t)DetourDispatch - (uintptr_t)buffer - 20 - 5;
 
     // Push context to the stack. General purpose, flags and instruction pointer.
     buffer[0] = 0x60; // PUSHAD
     buffer[1] = 0x9c; // PUSHFD
-    buffer[2] = 0x68; // PUSH jumpBack
-    *(uintptr_t*)&buffer[3] = pHook->location + pHook->offset;
-    // Push stack pointer to stack as second argument to the locker function. Pointing to the context.
-    buffer[7] = 0x54; // PUSH ESP
-    // Push pHook instance pointer as first argument to the locker function.
-    buffer[8] = 0x68; // PUSH pHook
-    *(uintptr_t*)&buffer[9] = (uintptr_t)pHook;
+    // Count the thread as in flight until it leaves the overwritten code.
+    buffer[2] = 0xf0; // LOCK INC [inFlight]
+    buffer[3] = 0xff;
+    buffer[4] = 0x05;
+    *(std::atomic<uintptr_t>**)&buffer[5] = &pWrapper->inFlight;
+    buffer[9] = 0x68; // PUSH jumpBack
+    *(uintptr_t*)&buffer[10] = returnAdr;
+    // Push stack pointer to stack as second argument to the dispatch function. Pointing to the context.
+    buffer[14] = 0x54; // PUSH ESP
+    // Push pWrapper instance pointer as first argument to the dispatch function.
+    buffer[15] = 0x68; // PUSH pWrapper
+    *(uintptr_t*)&buffer[16] = (uintptr_t)pWrapper;
     // Call the hook callback.
-    buffer[13] = 0xe8; // CALL cbHook
-    *(uintptr_t*)&buffer[14] = callFromWrapperToLocker;
-    // Cleanup parameters from cdecl call.
-    buffer[18] = 0x58; // POP EAX
-    buffer[19] = 0x58; // POP EAX
-    // Backup the instruction pointer that may have been modified by the callback.
-    buffer[20] = 0x8f; // POP [ipBackup]
-    buffer[21] = 0x05;
-    *(uintptr_t**)&buffer[22] = &pHook->ipBackup;
+    buffer[20] = 0xe8; // CALL DetourDispatch
+    *(uintptr_t*)&buffer[21] = callFromWrapperToDispatch;
+    // Cleanup parameters from cdecl call without touching the result in AL.
+    buffer[25] = 0x83; // ADD ESP, 8
+    buffer[26] = 0xc4;
+    buffer[27] = 0x08;
+    // Take the shared instruction pointer backup only if the callback changed it.
+    buffer[28] = 0x84; // TEST AL, AL
+    buffer[29] = 0xc0;
+    buffer[30] = 0x0f; // JNZ ipChanged
+    buffer[31] = 0x85;
+    unsigned char* jnzTarget = &buffer[32];
+
+    // The instruction pointer was not changed. Drop it and jump back directly.
+    buffer[36] = 0x83; // ADD ESP, 4
+    buffer[37] = 0xc4;
+    buffer[38] = 0x04;
     // Restore general purpose and flags registers.
-    buffer[26] = 0x9d; // POPFD
-    buffer[27] = 0x61; // POPAD
+    buffer[39] = 0x9d; // POPFD
+    buffer[40] = 0x61; // POPAD
 
-    buffer += 28;
-    pHook->originalCode = buffer;
+    buffer += 41;
+    pWrapper->originalCode = buffer;
 
     // Copy originally overwritten code.
-    memcpy(buffer, (void*)pHook->location, pHook->offset);
+    buffer = GenOriginalCode(pWrapper, buffer, &pWrapper->originalCodeOffsets);
+    if (!buffer)
+        return false;
+    buffer = GenLeaveWrapper_x86(pWrapper, buffer);
+
+    buffer[0] = 0xe9; // JMP returnAdr
+    *(uintptr_t*)&buffer[1] = returnAdr - (uintptr_t)buffer - 5;
 
-    buffer += pHook->offset;
+    buffer += 5;
+    *(uintptr_t*)jnzTarget = (uintptr_t)buffer - (uintptr_t)jnzTarget - 4;
+
+    // Backup the instruction pointer that was modified by the callback.
+    buffer[0] = 0x8f; // POP [ipBackup]
+    buffer[1] = 0x05;
+    *(uintptr_t**)&buffer[2] = &pWrapper->ipBackup;
+    // Restore general purpose and flags registers.
+    buffer[6] = 0x9d; // POPFD
+    buffer[7] = 0x61; // POPAD
+
+    buffer += 8;
+
+    // Copy originally overwritten code again.
+    buffer = GenOriginalCode(pWrapper, buffer);
+    if (!buffer)
+        return false;
+    buffer = GenLeaveWrapper_x86(pWrapper, buffer);
 
     // Jump to the backed up instruction pointer.
     buffer[0] = 0xff; // JMP [ipBackup]
     buffer[1] = 0x25;
-    *(uintptr_t**)&buffer[2] = &pHook->ipBackup;
+    *(uintptr_t**)&buffer[2] = &pWrapper->ipBackup;
+
+    return true;
 }
 
 #else
 
-static std::vector<unsigned char> GenJumpOverwrite_x86_64(uintptr_t target, int nextInstructionOffset)
+// Appends the restore of the context that was pushed by the wrapper.
+static unsigned char* GenRestoreContext_x86_64(unsigned char* buffer)
 {
-    auto target_lo = (uint32_t)target;
-    auto target_hi = (uint32_t)(target >> 32);
+    // Restore general purpose and flags registers.
+    buffer[0] = 0x9d; // POPFQ
+    buffer[1] = 0x41; // POP R15
+    buffer[2] = 0x5f;
+    buffer[3] = 0x41; // POP R14
+    buffer[4] = 0x5e;
+    buffer[5] = 0x41; // POP R13
+    buffer[6] = 0x5d;
+    buffer[7] = 0x41; // POP R12
+    buffer[8] = 0x5c;
+    buffer[9] = 0x41; // POP R11
+    buffer[10] = 0x5b;
+    buffer[11] = 0x41; // POP R10
+    buffer[12] = 0x5a;
+    buffer[13] = 0x41; // POP R9
+    buffer[14] = 0x59;
+    buffer[15] = 0x41; // POP R8
+    buffer[16] = 0x58;
+    buffer[17] = 0x5f; // POP RDI
+    buffer[18] = 0x5e; // POP RSI
+    buffer[19] = 0x5d; // POP RBP
+    buffer[20] = 0x5b; // POP RBX
+    buffer[21] = 0x5a; // POP RDX
+    buffer[22] = 0x59; // POP RCX
+    buffer[23] = 0x58; // POP RAX
+    buffer[24] = 0x5c; // POP RSP
 
-    // Generate patch. Fill with NOPs.
-    std::vector<unsigned char> jmpPatch(nextInstructionOffset, 0x90);
-    jmpPatch[0] = 0x68; // PUSH cbHook@lo
-    *(uint32_t*)&jmpPatch[1] = target_lo;
-    jmpPatch[5] = 0xc7; // MOV [RSP+4], cbHook@hi
-    jmpPatch[6] = 0x44;
-    jmpPatch[7] = 0x24;
-    jmpPatch[8] = 0x04;
-    *(uint32_t*)&jmpPatch[9] = target_hi;
-    jmpPatch[13] = 0xc3; // RETN
+    return buffer + 25;
+}
 
-    return jmpPatch;
+// Appends the decrement of the threads in flight after the overwritten code. Preserves all registers and flags.
+static unsigned char* GenLeaveWrapper_x86_64(DetourWrapper* pWrapper, unsigned char* buffer)
+{
+    // The overwritten code may have stored to the red zone of the System V ABI.
+    buffer[0] = 0x48; // LEA RSP, [RSP-128]
+    buffer[1] = 0x8d;
+    buffer[2] = 0x64;
+    buffer[3] = 0x24;
+    buffer[4] = 0x80;
+    buffer[5] = 0x9c; // PUSHFQ
+    buffer[6] = 0x50; // PUSH RAX
+    buffer[7] = 0x48; // MOV RAX, &inFlight
+    buffer[8] = 0xb8;
+    *(std::atomic<uintptr_t>**)&buffer[9] = &pWrapper->inFlight;
+    buffer[17] = 0xf0; // LOCK DEC QWORD [RAX]
+    buffer[18] = 0x48;
+    buffer[19] = 0xff;
+    buffer[20] = 0x08;
+    buffer[21] = 0x58; // POP RAX
+    buffer[22] = 0x9d; // POPFQ
+    buffer[23] = 0x48; // LEA RSP, [RSP+128]
+    buffer[24] = 0x8d;
+    buffer[25] = 0xa4;
+    buffer[26] = 0x24;
+    *(uint32_t*)&buffer[27] = 128;
+
+    return buffer + 31;
 }
 
-static void GenWrapper_x86_64(DetourHook* pHook)
+static bool GenWrapper_x86_64(DetourWrapper* pWrapper)
 {
-    const uintptr_t returnAdr = pHook->location + pHook->offset;
+    const uintptr_t returnAdr = pWrapper->location + pWrapper->offset;
     auto return_lo = (uint32_t)returnAdr;
     auto return_hi = (uint32_t)(returnAdr >> 32);
 
-    unsigned char* buffer = pHook->wrapperCode.data();
+    unsigned char* buffer = pWrapper->wrapperCode.data();
 
     // TODO: Respect red zone for System V ABI! 128 bytes above rsp may not be clobbered!
-    // I think this must be done in the overwrite code
-    // or use this weird trick for jumping: jmp [rip+0]; dq adr
 
     // Push context to the stack. General purpose, flags and instruction pointer.
     buffer[0] = 0x54; // PUSH RSP
@@ -336,6 +730,17 @@ static void GenWrapper_x86_64(DetourHook* pHook)
 
     buffer += 38;
 
+    // Count the thread as in flight until it leaves the overwritten code.
+    buffer[0] = 0x48; // MOV RAX, &inFlight
+    buffer[1] = 0xb8;
+    *(std::atomic<uintptr_t>**)&buffer[2] = &pWrapper->inFlight;
+    buffer[10] = 0xf0; // LOCK INC QWORD [RAX]
+    buffer[11] = 0x48;
+    buffer[12] = 0xff;
+    buffer[13] = 0x00;
+
+    buffer += 14;
+
     // Backup RSP to RBX and align it on 16 byte boundary.
     buffer[0] = 0x48; // MOV RBX, RSP
     buffer[1] = 0x89;
@@ -347,24 +752,24 @@ static void GenWrapper_x86_64(DetourHook* pHook)
 
     buffer += 7;
 
-    // Call the locker function.
+    // Call the dispatch function.
 #if defined(_WIN64)                                         // Microsoft x64 calling convention
     // Second parameter: CpuContext*
     buffer[0] = 0x48; // MOV RDX, RBX
     buffer[1] = 0x89;
     buffer[2] = 0xda;
-    // First parameter: DetourHook*
-    buffer[3] = 0x48; // MOV RCX, pHook
+    // First parameter: DetourWrapper*
+    buffer[3] = 0x48; // MOV RCX, pWrapper
     buffer[4] = 0xb9;
-    *(uintptr_t*)&buffer[5] = (uintptr_t)pHook;
+    *(uintptr_t*)&buffer[5] = (uintptr_t)pWrapper;
     // Shadow space for callee.
     buffer[13] = 0x48; // SUB RSP, 0x20
     buffer[14] = 0x83;
     buffer[15] = 0xec;
     buffer[16] = 0x20;
-    buffer[17] = 0x48; // MOV RAX, JMPHookLocker
+    buffer[17] = 0x48; // MOV RAX, DetourDispatch
     buffer[18] = 0xb8;
-    *(uintptr_t*)&buffer[19] = (uintptr_t)JMPHookLocker;
+    *(uintptr_t*)&buffer[19] = (uintptr_t)DetourDispatch;
     buffer[27] = 0xff; // CALL RAX
     buffer[28] = 0xd0;
 
@@ -374,13 +779,13 @@ static void GenWrapper_x86_64(DetourHook* pHook)
     buffer[0] = 0x48; // MOV RSI, RBP
     buffer[1] = 0x89;
     buffer[2] = 0xde;
-    // First parameter: DetourHook*
-    buffer[3] = 0x48; // MOV RDI, pHook
+    // First parameter: DetourWrapper*
+    buffer[3] = 0x48; // MOV RDI, pWrapper
     buffer[4] = 0xbf;
-    *(uintptr_t*)&buffer[5] = (uintptr_t)pHook;
-    buffer[13] = 0x48; // MOV RAX, JMPHookLocker
+    *(uintptr_t*)&buffer[5] = (uintptr_t)pWrapper;
+    buffer[13] = 0x48; // MOV RAX, DetourDispatch
     buffer[14] = 0xb8;
-    *(uintptr_t*)&buffer[15] = (uintptr_t)JMPHookLocker;
+    *(uintptr_t*)&buffer[15] = (uintptr_t)DetourDispatch;
     buffer[23] = 0xff; // CALL RAX
     buffer[24] = 0xd0;
 
@@ -391,60 +796,61 @@ static void GenWrapper_x86_64(DetourHook* pHook)
     buffer[0] = 0x48; // MOV RSP, RBX
     buffer[1] = 0x89;
     buffer[2] = 0xdc;
+    // Take the shared instruction pointer backup only if the callback changed it.
+    buffer[3] = 0x84; // TEST AL, AL
+    buffer[4] = 0xc0;
+    buffer[5] = 0x0f; // JNZ ipChanged
+    buffer[6] = 0x85;
+    unsigned char* jnzTarget = &buffer[7];
+
+    // The instruction pointer was not changed. Drop it and jump back directly.
+    buffer[11] = 0x48; // LEA RSP, [RSP+8]
+    buffer[12] = 0x8d;
+    buffer[13] = 0x64;
+    buffer[14] = 0x24;
+    buffer[15] = 0x08;
 
-    // Backup the instruction pointer that may have been modified by the callback.
-    buffer[3] = 0x58; // POP EAX
-    buffer[4] = 0x48; // MOV [ipBackup], RAX
-    buffer[5] = 0xa3;
-    *(uintptr_t**)&buffer[6] = &pHook->ipBackup;
+    buffer = GenRestoreContext_x86_64(buffer + 16);
 
-    buffer += 14;
+    pWrapper->originalCode = buffer;
+    // Copy originally overwritten code.
+    buffer = GenOriginalCode(pWrapper, buffer, &pWrapper->originalCodeOffsets);
+    if (!buffer)
+        return false;
+    buffer = GenLeaveWrapper_x86_64(pWrapper, buffer);
 
-    // Restore general purpose and flags registers.
-    buffer[0] = 0x9d; // POPFQ
-    buffer[1] = 0x41; // POP R15
-    buffer[2] = 0x5f;
-    buffer[3] = 0x41; // POP R14
-    buffer[4] = 0x5e;
-    buffer[5] = 0x41; // POP R13
-    buffer[6] = 0x5d;
-    buffer[7] = 0x41; // POP R12
-    buffer[8] = 0x5c;
-    buffer[9] = 0x41; // POP R11
-    buffer[10] = 0x5b;
-    buffer[11] = 0x41; // POP R10
-    buffer[12] = 0x5a;
-    buffer[13] = 0x41; // POP R9
-    buffer[14] = 0x59;
-    buffer[15] = 0x41; // POP R8
-    buffer[16] = 0x58;
-    buffer[17] = 0x5f; // POP RDI
-    buffer[18] = 0x5e; // POP RSI
-    buffer[19] = 0x5d; // POP RBP
-    buffer[20] = 0x5b; // POP RBX
-    buffer[21] = 0x5a; // POP RDX
-    buffer[22] = 0x59; // POP RCX
-    buffer[23] = 0x58; // POP RAX
-    buffer[24] = 0x5c; // POP RSP
+    auto jmpBack = GenJumpOverwrite(returnAdr, (uintptr_t)buffer, JMPSIZE_FAR);
+    memcpy(buffer, jmpBack.data(), JMPSIZE_FAR);
 
-    buffer += 25;
+    buffer += JMPSIZE_FAR;
+    *(uint32_t*)jnzTarget = (uint32_t)(buffer - jnzTarget - 4);
 
-    pHook->originalCode = buffer;
-    // Copy originally overwritten code.
-    memcpy(buffer, (void*)pHook->location, pHook->offset);
+    // Backup the instruction pointer that was modified by the callback.
+    buffer[0] = 0x58; // POP RAX
+    buffer[1] = 0x48; // MOV [ipBackup], RAX
+    buffer[2] = 0xa3;
+    *(uintptr_t**)&buffer[3] = &pWrapper->ipBackup;
+
+    buffer = GenRestoreContext_x86_64(buffer + 11);
 
-    buffer += pHook->offset;
+    // Copy originally overwritten code again.
+    buffer = GenOriginalCode(pWrapper, buffer);
+    if (!buffer)
+        return false;
+    buffer = GenLeaveWrapper_x86_64(pWrapper, buffer);
 
     // Jump to the backed up instruction pointer.
     buffer[0] = 0x50; // PUSH RAX
     buffer[1] = 0x48; // MOV RAX, [ipBackup]
     buffer[2] = 0xa1;
-    *(uintptr_t**)&buffer[3] = &pHook->ipBackup;
+    *(uintptr_t**)&buffer[3] = &pWrapper->ipBackup;
     buffer[11] = 0x48; // XCHG [RSP], RAX
     buffer[12] = 0x87;
     buffer[13] = 0x04;
     buffer[14] = 0x24;
     buffer[15] = 0xc3; // RETN
+
+    return true;
 }
 
 #endif
@@ -452,37 +858,46 @@ static void GenWrapper_x86_64(DetourHook* pHook)
 
 const IHook* Hooker::hookJMP(uintptr_t location, int nextInstructionOffset, uintptr_t cbHook, uintptr_t* jmpBack)
 {
-    // Check for invalid parameters.
-    if (!location || nextInstructionOffset < JMPHOOKSIZE || !cbHook)
+    PurgeRetiredWrappers();
+
+    // Check for invalid parameters. The overwritten code must consist of whole instructions.
+    if (!location || nextInstructionOffset < JMPSIZE_NEAR || !cbHook ||
+        !hl::MaxRelocatedSize(location, nextInstructionOffset))
         return nullptr;
 
     auto pHook = std::make_unique<JMPHook>(location, nextInstructionOffset);
+    const auto wrapper = (uintptr_t)pHook->wrapperCode.data();
 
-    // The jump back must only be written if used.
-    if (jmpBack)
+    std::vector<std::pair<int, int>> offsets;
+    const auto originalCode = hl::RelocateCode(location, nextInstructionOffset, wrapper, &offsets);
+    if (originalCode.empty())
+        return nullptr;
+    memcpy(pHook->wrapperCode.data(), originalCode.data(), originalCode.size());
+
+    // The jump back is also used by threads that a batch moves out of the overwritten code.
+    const uintptr_t jmpBackAdr = wrapper + originalCode.size();
+    auto jmpBackPatch = GenJumpOverwrite(location + nextInstructionOffset, jmpBackAdr, JMPSIZE_FAR);
+    memcpy((void*)jmpBackAdr, jmpBackPatch.data(), JMPSIZE_FAR);
+
+    // If the location is too small for a jump to a far away hook, jump through a relay in the wrapper code.
+    uintptr_t target = cbHook;
+    if (nextInstructionOffset < GetJumpSize(cbHook, location))
     {
-#ifdef ARCH_64BIT
-        auto jmpBackPatch = GenJumpOverwrite_x86_64(location + nextInstructionOffset, JMPHOOKSIZE);
-#else
-        auto jmpBackPatch =
-            GenJumpOverwrite_x86(location + nextInstructionOffset,
-                                 (uintptr_t)pHook->wrapperCode.data() + nextInstructionOffset, JMPHOOKSIZE);
-#endif
-        // It is safe to write out of bounds here, because we allocated a whole page.
-        memcpy(pHook->wrapperCode.data() + nextInstructionOffset, jmpBackPatch.data(), JMPHOOKSIZE);
-        *jmpBack = (uintptr_t)pHook->wrapperCode.data();
+        const uintptr_t relay = jmpBackAdr + JMPSIZE_FAR;
+        auto relayPatch = GenJumpOverwrite(cbHook, relay, JMPSIZE_FAR);
+        memcpy((void*)relay, relayPatch.data(), JMPSIZE_FAR);
+        target = relay;
     }
+    if (nextInstructionOffset < GetJumpSize(target, location))
+        return nullptr;
 
-#ifdef ARCH_64BIT
-    auto jmpPatch = GenJumpOverwrite_x86_64(cbHook, nextInstructionOffset);
-#else
-    auto jmpPatch = GenJumpOverwrite_x86(cbHook, location, nextInstructionOffset);
-#endif
+    if (jmpBack)
+        *jmpBack = wrapper;
+
+    auto jmpPatch = GenJumpOverwrite(target, location, nextInstructionOffset);
 
     // Apply the hook by writing the jump.
-    hl::PageProtect((void*)location, nextInstructionOffset, PROTECTION_READ_WRITE_EXECUTE);
-    memcpy((void*)location, jmpPatch.data(), nextInstructionOffset);
-    hl::PageProtect((void*)location, nextInstructionOffset, PROTECTION_READ_EXECUTE);
+    applyPatch(pHook.get(), location, std::move(jmpPatch), GetRelocatedIps(location, wrapper, offsets));
 
     auto result = pHook.get();
     m_hooks.push_back(std::move(pHook));
@@ -492,24 +907,32 @@ const IHook* Hooker::hookJMP(uintptr_t location, int nextInstructionOffset, uint
 
 const IHook* Hooker::hookDetour(uintptr_t location, int nextInstructionOffset, HookCallback_t cbHook)
 {
-    // Check for invalid parameters.
-    if (!location || nextInstructionOffset < JMPHOOKSIZE || !cbHook)
+    PurgeRetiredWrappers();
+
+    // Check for invalid parameters. The overwritten code must consist of whole instructions.
+    if (!location || nextInstructionOffset < JMPSIZE_NEAR || !cbHook ||
+        !hl::MaxRelocatedSize(location, nextInstructionOffset))
         return nullptr;
 
-    auto pHook = std::make_unique<DetourHook>(location, nextInstructionOffset, cbHook);
+    auto pWrapper = std::make_unique<DetourWrapper>(location, nextInstructionOffset, cbHook);
+    const auto wrapper = (uintptr_t)pWrapper->wrapperCode.data();
+    // No free memory in reach of a short jump.
+    if (nextInstructionOffset < GetJumpSize(wrapper, location))
+        return nullptr;
 
 #ifdef ARCH_64BIT
-    GenWrapper_x86_64(pHook.get());
-    auto jmpPatch = GenJumpOverwrite_x86_64((uintptr_t)pHook->wrapperCode.data(), nextInstructionOffset);
+    if (!GenWrapper_x86_64(pWrapper.get()))
+        return nullptr;
 #else
-    GenWrapper_x86(pHook.get());
-    auto jmpPatch = GenJumpOverwrite_x86((uintptr_t)pHook->wrapperCode.data(), location, nextInstructionOffset);
+    if (!GenWrapper_x86(pWrapper.get()))
+        return nullptr;
 #endif
+    auto jmpPatch = GenJumpOverwrite(wrapper, location, nextInstructionOffset);
+    auto relocatedIps = GetRelocatedIps(location, (uintptr_t)pWrapper->originalCode, pWrapper->originalCodeOffsets);
+    auto pHook = std::make_unique<DetourHook>(std::move(pWrapper));
 
     // Apply the hook by writing the jump.
-    hl::PageProtect((void*)location, nextInstructionOffset, PROTECTION_READ_WRITE_EXECUTE);
-    memcpy((void*)location, jmpPatch.data(), nextInstructionOffset);
-    hl::PageProtect((void*)location, nextInstructionOffset, PROTECTION_READ_EXECUTE);
+    applyPatch(pHook.get(), location, std::move(jmpPatch), std::move(relocatedIps));
 
     auto result = pHook.get();
     m_hooks.push_back(std::move(pHook));
@@ -517,7 +940,189 @@ const IHook* Hooker::hookDetour(uintptr_t location, int nextInstructionOffset, H
 }
 
 
+const IHook* Hooker::hookJMP(uintptr_t location, uintptr_t cbHook, uintptr_t* jmpBack)
+{
+    // A relative jump fits if the hook or the relay in the wrapper code is in reach, which is only known after the
+    // wrapper code was allocated.
+    if (auto pHook = hookJMP(location, hl::GetPrologueSize(location, JMPSIZE_NEAR), cbHook, jmpBack))
+        return pHook;
+    return hookJMP(location, hl::GetPrologueSize(location, JMPSIZE_FAR), cbHook, jmpBack);
+}
+
+
+const IHook* Hooker::hookDetour(uintptr_t location, HookCallback_t cbHook)
+{
+    if (auto pHook = hookDetour(location, hl::GetPrologueSize(location, JMPSIZE_NEAR), cbHook))
+        return pHook;
+    return hookDetour(location, hl::GetPrologueSize(location, JMPSIZE_FAR), cbHook);
+}
+
+
+Hooker::~Hooker()
+{
+    // Later hooks may overwrite the jumps or wrapper code of earlier ones.
+    while (!m_hooks.empty())
+        removeHook(m_hooks.back().get());
+    PurgeRetiredWrappers();
+}
+
 void Hooker::unhook(const IHook* pHook)
 {
-    std::erase_if(m_hooks, [pHook](const auto& uptr) { return uptr.get() == pHook; });
+    removeHook(pHook);
+    PurgeRetiredWrappers();
+}
+
+void Hooker::removeHook(const IHook* pHook)
+{
+    auto it = std::ranges::find_if(m_hooks, [pHook](const auto& uptr) { return uptr.get() == pHook; });
+    if (it == m_hooks.end())
+        return;
+
+    // The jump of a deferred hook was never written.
+    const bool pending =
+        std::erase_if(m_pendingPatches, [pHook](const auto& patch) { return patch.pHook == pHook; }) > 0;
+    if (const auto* pPatchHook = dynamic_cast<const PatchHook*>(pHook); pPatchHook && !pending)
+    {
+        const auto& code = pPatchHook->getOverwrittenCode();
+        WritePatch(pPatchHook->getLocation(), code.data(), (int)code.size());
+    }
+
+    m_hooks.erase(it);
+}
+
+
+void Hooker::WritePatch(uintptr_t location, const unsigned char* code, int size)
+{
+    hl::PageProtect((void*)location, size, PROTECTION_READ_WRITE_EXECUTE);
+    if (IsSpinAtomic(location))
+        WriteCode(location, code, size);
+    else
+        RunSuspended([&] { WriteCode(location, code, size); }, [](uintptr_t ip) { return ip; });
+    hl::FlushICache((void*)location, size);
+    hl::PageProtect((void*)location, size, PROTECTION_READ_EXECUTE);
+}
+
+void Hooker::PurgeRetiredWrappers()
+{
+    auto& retired = GetRetiredWrappers();
+    const std::lock_guard lock(retired.mutex);
+
+    // Only suspend the threads if a wrapper may be free.
+    const bool anyIdle = std::ranges::any_of(retired.wrappers, [](const auto& wrapper) { return !wrapper->inFlight; });
+    if (!anyIdle || std::chrono::steady_clock::now() < retired.nextSuspend)
+        return;
+
+    // A thread can still be in the few instructions before the count is incremented or after it is decremented.
+    // Everything is allocated before the threads are suspended.
+    auto& wrappers = retired.wrappers;
+    std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+    for (const auto& wrapper : wrappers)
+    {
+        const auto begin = (uintptr_t)wrapper->wrapperCode.data();
+        ranges.emplace_back(begin, begin + wrapper->wrapperCode.size());
+    }
+    std::vector<char> idle(wrappers.size());
+
+    const bool complete = RunSuspended(
+        [&]
+        {
+            for (size_t i = 0; i < wrappers.size(); i++)
+                idle[i] = !wrappers[i]->inFlight;
+        },
+        [&](uintptr_t ip)
+        {
+            for (size_t i = 0; i < ranges.size(); i++)
+            {
+                if (ip >= ranges[i].first && ip < ranges[i].second)
+                    idle[i] = false;
+            }
+            return ip;
+        });
+    if (!complete)
+    {
+        retired.nextSuspend = std::chrono::steady_clock::now() + RetiredWrappers::RetryDelay;
+        return;
+    }
+
+    size_t numRetired = 0;
+    for (size_t i = 0; i < wrappers.size(); i++)
+    {
+        if (!idle[i])
+            wrappers[numRetired++] = std::move(wrappers[i]);
+    }
+    wrappers.resize(numRetired);
+}
+
+void Hooker::applyPatch(const IHook* pHook, uintptr_t location, std::vector<unsigned char> code,
+                        std::vector<std::pair<uintptr_t, uintptr_t>> relocatedIps)
+{
+    if (m_batching)
+        m_pendingPatches.push_back({ pHook, location, std::move(code), std::move(relocatedIps) });
+    else
+        WritePatch(location, code.data(), (int)code.size());
+}
+
+void Hooker::beginBatch()
+{
+    m_batching = true;
+}
+
+void Hooker::commit()
+{
+    PurgeRetiredWrappers();
+    m_batching = false;
+    if (m_pendingPatches.empty())
+        return;
+    const auto patches = std::move(m_pendingPatches);
+    m_pendingPatches.clear();
+
+    // Merge the pages of all patches into ranges, so that the protection of every page is only changed once.
+    const auto pageSize = hl::GetPageSize();
+    std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+    for (const auto& patch : patches)
+    {
+        ranges.emplace_back(hl::AlignDown(patch.location, pageSize),
+                            hl::Align(patch.location + patch.code.size(), pageSize));
+    }
+    std::ranges::sort(ranges);
+    size_t numRanges = 0;
+    for (const auto& range : ranges)
+    {
+        if (numRanges && range.first <= ranges[numRanges - 1].second)
+            ranges[numRanges - 1].second = std::max(ranges[numRanges - 1].second, range.second);
+        else
+            ranges[numRanges++] = range;
+    }
+    ranges.resize(numRanges);
+
+    RunSuspended(
+        [&]
+        {
+            for (const auto& [begin, end] : ranges)
+                hl::PageProtect((void*)begin, end - begin, PROTECTION_READ_WRITE_EXECUTE);
+            for (const auto& patch : patches)
+                WriteCode(patch.location, patch.code.data(), (int)patch.code.size());
+            for (const auto& [begin, end] : ranges)
+            {
+                hl::FlushICache((void*)begin, end - begin);
+                hl::PageProtect((void*)begin, end - begin, PROTECTION_READ_EXECUTE);
+            }
+        },
+        [&](uintptr_t ip)
+        {
+            // Threads at the start of a patch execute the jump, all others would execute parts of it.
+            for (const auto& patch : patches)
+            {
+                for (const auto& [from, to] : patch.relocatedIps)
+                {
+                    if (ip != from)
+                        continue;
+                    // The thread skips the entry of the wrapper code, but still leaves through its end.
+                    if (const auto* pDetourHook = dynamic_cast<const DetourHook*>(patch.pHook))
+                        pDetourHook->wrapper->inFlight++;
+                    return to;
+                }
+            }
+            return ip;
+        });
 }
@@ -0,0 +1,296 @@
+#include "hacklib/Hooker.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <dirent.h>
+#include <exception>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <mutex>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+
+// Other threads are suspended by sending them a signal whose handler parks them until they are resumed. The
+// handler receives the saved context of its thread, which is restored when the handler returns, so changing the
+// instruction pointer in it moves the thread.
+
+#ifdef ARCH_64BIT
+#define REG_INSTRUCTIONPTR REG_RIP
+#else
+#define REG_INSTRUCTIONPTR REG_EIP
+#endif
+
+// Threads beyond this number are not suspended.
+static constexpr size_t MaxParkedThreads = 4096;
+// Threads that did not park within this time, for example because they block the signal, are not suspended.
+static constexpr auto ParkTimeout = std::chrono::milliseconds(100);
+// Threads can start while others are suspended, so the threads are listed again until no new one shows up.
+static constexpr int MaxListRounds = 8;
+
+enum ParkState : int
+{
+    // The signal was sent, but the handler did not run yet.
+    PARK_SIGNALED,
+    // The handler waits for the resume.
+    PARK_PARKED,
+    // The thread exited or did not park in time. A late handler returns immediately.
+    PARK_ABANDONED,
+    // The handler was resumed and does not access the slot anymore.
+    PARK_RESUMED
+};
+
+struct ParkSlot
+{
+    std::atomic<pid_t> tid = 0;
+    std::atomic<int> state = PARK_ABANDONED;
+    std::atomic<ucontext_t*> context = nullptr;
+};
+
+// Shared with the signal handler. Statically allocated, because a handler may still run late after a
+// suspension ended and nothing may be allocated while threads are suspended.
+struct ParkingLot
+{
+    ParkSlot slots[MaxParkedThreads];
+    std::atomic<size_t> numSlots = 0;
+    std::atomic<bool> active = false;
+    // Futex word that is incremented by the handler on every state change.
+    std::atomic<uint32_t> changes = 0;
+    // Futex word that is incremented to resume the parked threads.
+    std::atomic<uint32_t> generation = 0;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free);
+
+static ParkingLot g_parkingLot;
+static std::mutex g_parkingMutex;
+
+
+static int GetParkSignal()
+{
+    return SIGRTMIN + 3;
+}
+
+static void FutexWait(std::atomic<uint32_t>& word, uint32_t value, const timespec* timeout)
+{
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT_PRIVATE, value, timeout, nullptr, 0);
+}
+
+static void FutexWake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void ParkHandler(int, siginfo_t*, void* context)
+{
+    const int savedErrno = errno;
+    auto& lot = g_parkingLot;
+
+    if (lot.active.load())
+    {
+        const auto tid = (pid_t)syscall(SYS_gettid);
+        const size_t numSlots = lot.numSlots.load();
+        for (size_t i = 0; i < numSlots; i++)
+        {
+            auto& slot = lot.slots[i];
+            if (slot.tid.load() != tid)
+                continue;
+
+            // Read before parking, because the resume increments it.
+            const auto generation = lot.generation.load();
+            slot.context.store((ucontext_t*)context);
+            int expected = PARK_SIGNALED;
+            if (slot.state.compare_exchange_strong(expected, PARK_PARKED))
+            {
+                lot.changes++;
+                FutexWake(lot.changes);
+                while (lot.generation.load() == generation)
+                    FutexWait(lot.generation, generation, nullptr);
+                slot.state.store(PARK_RESUMED);
+                lot.changes++;
+                FutexWake(lot.changes);
+            }
+            break;
+        }
+    }
+
+    errno = savedErrno;
+}
+
+// Calls func with the id of every thread of the process. Does not allocate memory.
+template <typename F>
+static void ForEachThread(F&& func)
+{
+    const int fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    alignas(dirent64) char buffer[4096];
+    long size = 0;
+    while ((size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (long pos = 0; pos < size;)
+        {
+            const auto* entry = (const dirent64*)(buffer + pos);
+            pos += entry->d_reclen;
+
+            pid_t tid = 0;
+            for (const char* c = entry->d_name; *c >= '0' && *c <= '9'; c++)
+                tid = tid * 10 + (*c - '0');
+            if (tid)
+                func(tid);
+        }
+    }
+
+    close(fd);
+}
+
+// Waits until the slots starting at begin were parked or abandoned. Returns false if a thread that did not exit was
+// abandoned.
+static bool WaitParked(size_t begin)
+{
+    auto& lot = g_parkingLot;
+    const auto pid = getpid();
+    const auto deadline = std::chrono::steady_clock::now() + ParkTimeout;
+    bool complete = true;
+
+    while (true)
+    {
+        const auto changes = lot.changes.load();
+        const bool timedOut = std::chrono::steady_clock::now() >= deadline;
+        bool pending = false;
+        for (size_t i = begin; i < lot.numSlots.load(); i++)
+        {
+            auto& slot = lot.slots[i];
+            if (slot.state.load() != PARK_SIGNALED)
+                continue;
+
+            // Threads that exited before handling the signal never park.
+            const bool exited = syscall(SYS_tgkill, pid, slot.tid.load(), 0) != 0 && errno == ESRCH;
+            if (exited || timedOut)
+            {
+                int expected = PARK_SIGNALED;
+                if (slot.state.compare_exchange_strong(expected, PARK_ABANDONED) && !exited)
+                    complete = false;
+            }
+            pending |= slot.state.load() == PARK_SIGNALED;
+        }
+        if (!pending)
+            return complete;
+
+        const timespec timeout{ 0, 1000000 };
+        FutexWait(lot.changes, changes, &timeout);
+    }
+}
+
+// Resumes all parked threads and waits until they left the slots.
+static void ResumeParked()
+{
+    auto& lot = g_parkingLot;
+
+    lot.generation++;
+    FutexWake(lot.generation);
+
+    while (true)
+    {
+        const auto changes = lot.changes.load();
+        bool parked = false;
+        for (size_t i = 0; i < lot.numSlots.load(); i++)
+            parked |= lot.slots[i].state.load() == PARK_PARKED;
+        if (!parked)
+            break;
+        FutexWait(lot.changes, changes, nullptr);
+    }
+
+    lot.active = false;
+}
+
+
+bool hl::Hooker::RunSuspended(const std::function<void()>& func, const std::function<uintptr_t(uintptr_t)>& relocate)
+{
+    static std::once_flag installed;
+    std::call_once(installed,
+                   []
+                   {
+                       struct sigaction action{};
+                       action.sa_sigaction = ParkHandler;
+                       action.sa_flags = SA_SIGINFO | SA_RESTART;
+                       sigemptyset(&action.sa_mask);
+                       sigaction(GetParkSignal(), &action, nullptr);
+                   });
+
+    const std::lock_guard lock(g_parkingMutex);
+    auto& lot = g_parkingLot;
+    const auto pid = getpid();
+    const auto self = (pid_t)syscall(SYS_gettid);
+
+    lot.numSlots = 0;
+    lot.active = true;
+    bool complete = true;
+
+    for (int round = 0; round < MaxListRounds; round++)
+    {
+        const size_t begin = lot.numSlots.load();
+        ForEachThread(
+            [&](pid_t tid)
+            {
+                const size_t numSlots = lot.numSlots.load();
+                if (tid == self)
+                    return;
+                for (size_t i = 0; i < numSlots; i++)
+                {
+                    if (lot.slots[i].tid.load() == tid)
+                        return;
+                }
+                if (numSlots == MaxParkedThreads)
+                {
+                    complete = false;
+                    return;
+                }
+
+                auto& slot = lot.slots[numSlots];
+                slot.tid = tid;
+                slot.context = nullptr;
+                slot.state = PARK_SIGNALED;
+                lot.numSlots = numSlots + 1;
+                if (syscall(SYS_tgkill, pid, tid, GetParkSignal()) != 0)
+                {
+                    // The thread exited if it does not exist anymore.
+                    if (errno != ESRCH)
+                        complete = false;
+                    slot.state = PARK_ABANDONED;
+                }
+            });
+        if (lot.numSlots.load() == begin)
+            break;
+        if (!WaitParked(begin))
+            complete = false;
+    }
+
+    std::exception_ptr exception;
+    try
+    {
+        func();
+        for (size_t i = 0; i < lot.numSlots.load(); i++)
+        {
+            auto& slot = lot.slots[i];
+            if (slot.state.load() != PARK_PARKED)
+                continue;
+            auto& ip = slot.context.load()->uc_mcontext.gregs[REG_INSTRUCTIONPTR];
+            ip = (greg_t)relocate((uintptr_t)ip);
+        }
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+
+    ResumeParked();
+
+    if (exception)
+        std::rethrow_exception(exception);
+    return complete;
+}
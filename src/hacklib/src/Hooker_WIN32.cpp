@@ -0,0 +1,96 @@
+#include "hacklib/Hooker.h"
+#include <Windows.h>
+#include <TlHelp32.h>
+#include <exception>
+#include <vector>
+
+
+#ifdef ARCH_64BIT
+#define REG_INSTRUCTIONPTR Rip
+#else
+#define REG_INSTRUCTIONPTR Eip
+#endif
+
+
+bool hl::Hooker::RunSuspended(const std::function<void()>& func, const std::function<uintptr_t(uintptr_t)>& relocate)
+{
+    // Everything is allocated before the first thread is suspended.
+    std::vector<HANDLE> threads;
+    bool complete = true;
+    const HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE)
+    {
+        THREADENTRY32 entry{};
+        entry.dwSize = sizeof(entry);
+        for (BOOL found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID != GetCurrentProcessId() || entry.th32ThreadID == GetCurrentThreadId())
+                continue;
+            const HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE,
+                                             entry.th32ThreadID);
+            if (thread)
+                threads.push_back(thread);
+            // Threads that exited since the snapshot can not be opened anymore.
+            else if (GetLastError() != ERROR_INVALID_PARAMETER)
+                complete = false;
+        }
+        CloseHandle(snapshot);
+    }
+    else
+    {
+        complete = false;
+    }
+    std::vector<CONTEXT> contexts(threads.size());
+    std::vector<bool> suspended(threads.size());
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        if (SuspendThread(threads[i]) == (DWORD)-1)
+        {
+            complete = false;
+            continue;
+        }
+        // Also waits until the thread is actually suspended.
+        contexts[i].ContextFlags = CONTEXT_CONTROL;
+        if (!GetThreadContext(threads[i], &contexts[i]))
+        {
+            ResumeThread(threads[i]);
+            complete = false;
+            continue;
+        }
+        suspended[i] = true;
+    }
+
+    std::exception_ptr exception;
+    try
+    {
+        func();
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            if (!suspended[i])
+                continue;
+            const auto ip = (uintptr_t)contexts[i].REG_INSTRUCTIONPTR;
+            const auto newIp = relocate(ip);
+            if (newIp != ip)
+            {
+                contexts[i].REG_INSTRUCTIONPTR = newIp;
+                SetThreadContext(threads[i], &contexts[i]);
+            }
+        }
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        if (suspended[i])
+            ResumeThread(threads[i]);
+        CloseHandle(threads[i]);
+    }
+
+    if (exception)
+        std::rethrow_exception(exception);
+    return complete;
+}
@@ -0,0 +1,178 @@
+#include "hacklib/IncrementalScanner.h"
+#include "hacklib/PatternScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+
+// Soft-dirty bits are shared by the whole process. Every clear starts a new generation, so that scanners can tell
+// whether another scanner cleared the bits of their pages in the meantime.
+static std::mutex g_softDirtyMutex;
+static uint64_t g_softDirtyGeneration = 0;
+
+static uint64_t HashPage(const uint8_t* page, size_t size)
+{
+    uint64_t hash = 0;
+    for (size_t i = 0; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, page + i, sizeof(word));
+        hash = ((hash ^ word) * 0x9e3779b97f4a7c15) ^ (hash >> 29);
+    }
+    return hash;
+}
+
+static bool DefaultFilter(const hl::MemoryRegion& region)
+{
+    return (region.protection & hl::PROTECTION_EXECUTE) && region.name.empty();
+}
+
+
+bool hl::IncrementalScanner::IsSoftDirtySupported()
+{
+    static const bool supported = []
+    {
+        const std::lock_guard lock(g_softDirtyMutex);
+        g_softDirtyGeneration++;
+        return ProbeSoftDirty();
+    }();
+    return supported;
+}
+
+hl::IncrementalScanner::IncrementalScanner(const std::string& pattern, Tracking tracking,
+                                           std::function<bool(const hl::MemoryRegion&)> filter)
+    : IncrementalScanner(std::make_shared<const CompiledPattern>(pattern), {}, tracking, std::move(filter))
+{
+}
+
+hl::IncrementalScanner::IncrementalScanner(const PatternView& pattern, Tracking tracking,
+                                           std::function<bool(const hl::MemoryRegion&)> filter)
+    : IncrementalScanner(nullptr, pattern, tracking, std::move(filter))
+{
+}
+
+hl::IncrementalScanner::IncrementalScanner(std::shared_ptr<const CompiledPattern> owner, const PatternView& pattern,
+                                           Tracking tracking, std::function<bool(const hl::MemoryRegion&)> filter)
+    : m_owner(std::move(owner))
+    , m_pattern(m_owner ? PatternView(*m_owner) : pattern)
+    , m_tracking(tracking)
+    , m_filter(filter ? std::move(filter) : DefaultFilter)
+{
+    if (m_tracking == Tracking::Auto)
+        m_tracking = IsSoftDirtySupported() ? Tracking::SoftDirty : Tracking::PageHash;
+    else if (m_tracking == Tracking::SoftDirty && !IsSoftDirtySupported())
+        throw std::runtime_error("soft-dirty tracking is not supported");
+}
+
+std::vector<uintptr_t> hl::IncrementalScanner::update()
+{
+    const uintptr_t pageSize = hl::GetPageSize();
+
+    std::vector<std::pair<uintptr_t, size_t>> regions;
+    for (const auto& region : hl::GetMemoryMap())
+    {
+        if ((region.protection & hl::PROTECTION_READ) && m_filter(region))
+            regions.emplace_back(region.base, region.size);
+    }
+    auto existedBefore = [&](const std::pair<uintptr_t, size_t>& region)
+    { return std::ranges::binary_search(m_regions, region); };
+
+    // Regions that are new or changed their extent are scanned completely.
+    bool complete = !m_scanned;
+    std::vector<std::vector<uint8_t>> softDirty(regions.size());
+    if (m_tracking == Tracking::SoftDirty)
+    {
+        const std::lock_guard lock(g_softDirtyMutex);
+        if (g_softDirtyGeneration != m_generation)
+            complete = true;
+        for (size_t r = 0; r < regions.size() && !complete; r++)
+        {
+            if (existedBefore(regions[r]))
+                ReadSoftDirty(regions[r].first, regions[r].second / pageSize, softDirty[r]);
+        }
+        // Writes after this point are found by the next update.
+        ClearSoftDirty();
+        m_generation = ++g_softDirtyGeneration;
+    }
+
+    // Drop the matches of regions that no longer exist.
+    std::erase_if(m_matches,
+                  [&](uintptr_t adr)
+                  {
+                      auto it = std::ranges::upper_bound(regions, adr, {}, &std::pair<uintptr_t, size_t>::first);
+                      return it == regions.begin() || adr - (it - 1)->first >= (it - 1)->second;
+                  });
+
+    const size_t overlap = m_pattern.maxLength() ? m_pattern.maxLength() - 1 : 0;
+    std::unordered_map<uintptr_t, uint64_t> pageHashes;
+    std::set<uintptr_t> removed;
+    std::vector<uintptr_t> added;
+    m_lastScannedBytes = 0;
+
+    for (size_t r = 0; r < regions.size(); r++)
+    {
+        const auto [base, size] = regions[r];
+        const bool regionComplete = complete || !existedBefore(regions[r]);
+
+        // Collect the runs of changed pages. Runs that are closer than the overlap are merged, so that every match
+        // is only removed and added by one run.
+        std::vector<std::pair<uintptr_t, uintptr_t>> runs;
+        for (uintptr_t page = base; page < base + size; page += pageSize)
+        {
+            bool dirty = regionComplete;
+            if (m_tracking == Tracking::PageHash)
+            {
+                const uint64_t hash = HashPage((const uint8_t*)page, pageSize);
+                pageHashes[page] = hash;
+                auto it = m_pageHashes.find(page);
+                dirty = dirty || it == m_pageHashes.end() || it->second != hash;
+            }
+            else if (!dirty)
+            {
+                dirty = softDirty[r][(page - base) / pageSize];
+            }
+            if (!dirty)
+                continue;
+
+            if (!runs.empty() && page - runs.back().second <= overlap)
+                runs.back().second = page + pageSize;
+            else
+                runs.emplace_back(page, page + pageSize);
+        }
+
+        for (const auto& [begin, end] : runs)
+            rescan(begin, end, base, base + size, removed, added);
+    }
+
+    m_regions = std::move(regions);
+    m_pageHashes = std::move(pageHashes);
+    m_scanned = true;
+
+    std::erase_if(added, [&](uintptr_t adr) { return removed.contains(adr); });
+    return added;
+}
+
+
+void hl::IncrementalScanner::rescan(uintptr_t begin, uintptr_t end, uintptr_t regionBase, uintptr_t regionEnd,
+                                    std::set<uintptr_t>& removed, std::vector<uintptr_t>& added)
+{
+    const size_t overlap = m_pattern.maxLength() ? m_pattern.maxLength() - 1 : 0;
+    // Matches that start within [from, end) can cover a changed byte.
+    const uintptr_t from = begin - std::min<size_t>(begin - regionBase, overlap);
+    const uintptr_t to = end + std::min<size_t>(regionEnd - end, overlap);
+
+    for (auto it = m_matches.lower_bound(from); it != m_matches.end() && *it < end;)
+    {
+        removed.insert(*it);
+        it = m_matches.erase(it);
+    }
+    for (uintptr_t match : hl::FindAllPatterns(m_pattern, from, to - from))
+    {
+        if (match >= end)
+            break;
+        m_matches.insert(match);
+        added.push_back(match);
+    }
+    m_lastScannedBytes += to - from;
+}
@@ -0,0 +1,67 @@
+#include "hacklib/IncrementalScanner.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// Bit of a pagemap entry that is set when the page was written since the soft-dirty bits were cleared.
+static constexpr uint64_t PagemapSoftDirty = 1ull << 55;
+
+
+bool hl::IncrementalScanner::ProbeSoftDirty()
+{
+    // Kernels without soft-dirty support accept the clear, but never set the bit.
+    const uintptr_t pageSize = hl::GetPageSize();
+    void* page = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED)
+        return false;
+
+    bool supported = false;
+    try
+    {
+        std::vector<uint8_t> before, after;
+        *(volatile uint8_t*)page = 1;
+        ClearSoftDirty();
+        ReadSoftDirty((uintptr_t)page, 1, before);
+        *(volatile uint8_t*)page = 2;
+        ReadSoftDirty((uintptr_t)page, 1, after);
+        supported = !before[0] && after[0];
+    }
+    catch (std::runtime_error&)
+    {
+    }
+
+    munmap(page, pageSize);
+    return supported;
+}
+
+void hl::IncrementalScanner::ClearSoftDirty()
+{
+    const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::runtime_error("could not open clear_refs");
+    const bool success = write(fd, "4", 1) == 1;
+    close(fd);
+    if (!success)
+        throw std::runtime_error("could not clear soft-dirty bits");
+}
+
+void hl::IncrementalScanner::ReadSoftDirty(uintptr_t base, size_t numPages, std::vector<uint8_t>& dirty)
+{
+    const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::runtime_error("could not open pagemap");
+
+    std::vector<uint64_t> entries(numPages);
+    const size_t numBytes = numPages * sizeof(uint64_t);
+    const auto offset = (off_t)(base / hl::GetPageSize() * sizeof(uint64_t));
+    const bool success = pread(fd, entries.data(), numBytes, offset) == (ssize_t)numBytes;
+    close(fd);
+    if (!success)
+        throw std::runtime_error("could not read pagemap");
+
+    dirty.resize(numPages);
+    for (size_t i = 0; i < numPages; i++)
+        dirty[i] = (entries[i] & PagemapSoftDirty) != 0;
+}
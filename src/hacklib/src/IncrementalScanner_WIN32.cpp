@@ -0,0 +1,18 @@
+#include "hacklib/IncrementalScanner.h"
+#include <stdexcept>
+
+
+bool hl::IncrementalScanner::ProbeSoftDirty()
+{
+    return false;
+}
+
+void hl::IncrementalScanner::ClearSoftDirty()
+{
+    throw std::runtime_error("soft-dirty tracking is not supported");
+}
+
+void hl::IncrementalScanner::ReadSoftDirty(uintptr_t base, size_t numPages, std::vector<uint8_t>& dirty)
+{
+    throw std::runtime_error("soft-dirty tracking is not supported");
+}
@@ -0,0 +1,596 @@
+#include "hacklib/InstructionDecoder.h"
+#include <array>
+#include <cstring>
+
+
+// The longest valid instruction.
+static constexpr int MaxInstructionLength = 15;
+
+// Relocated jumps and calls that stay within reach of a 32-bit displacement.
+static constexpr int JumpSizeNear = 5;
+static constexpr int CallSizeNear = 5;
+static constexpr int ConditionalJumpSizeNear = 6;
+#ifdef ARCH_64BIT
+// Relocated jumps and calls through an absolute address.
+static constexpr int JumpSizeFar = 14;
+static constexpr int CallSizeFar = 16;
+static constexpr int ConditionalJumpSizeFar = 16;
+#endif
+// The largest relocated form of any jump or call.
+static constexpr int MaxRelocatedBranchSize = 16;
+
+
+// Properties of an opcode.
+enum : uint16_t
+{
+    OP_NONE = 0,
+    OP_MODRM = 1 << 0,
+    OP_IMM8 = 1 << 1,
+    OP_IMM16 = 1 << 2,
+    // 16 or 32 bits depending on the operand size.
+    OP_IMMZ = 1 << 3,
+    // 16, 32 or 64 bits depending on the operand size. Only MOV r, imm.
+    OP_IMMV = 1 << 4,
+    OP_REL8 = 1 << 5,
+    OP_REL32 = 1 << 6,
+    // A prefix, an escape or an opcode whose size depends on more than the operand size.
+    OP_SPECIAL = 1 << 7,
+    OP_INVALID = 1 << 8
+};
+
+// Shorthands for the tables.
+#define M_ OP_MODRM
+#define I8 OP_IMM8
+#define IW OP_IMM16
+#define IZ OP_IMMZ
+#define IV OP_IMMV
+#define R8 OP_REL8
+#define RZ OP_REL32
+#define S_ OP_SPECIAL
+#define X_ OP_INVALID
+
+static constexpr std::array<uint16_t, 256> OneByteOpcodes = {
+    // clang-format off
+    //  0        1        2        3        4        5        6        7        8        9        A        B        C        D        E        F
+    M_,      M_,      M_,      M_,      I8,      IZ,      0,       0,       M_,      M_,      M_,      M_,      I8,      IZ,      0,       S_,      // 0
+    M_,      M_,      M_,      M_,      I8,      IZ,      0,       0,       M_,      M_,      M_,      M_,      I8,      IZ,      0,       0,       // 1
+    M_,      M_,      M_,      M_,      I8,      IZ,      S_,      0,       M_,      M_,      M_,      M_,      I8,      IZ,      S_,      0,       // 2
+    M_,      M_,      M_,      M_,      I8,      IZ,      S_,      0,       M_,      M_,      M_,      M_,      I8,      IZ,      S_,      0,       // 3
+    0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       // 4
+    0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       // 5
+    0,       0,       S_,      M_,      S_,      S_,      S_,      S_,      IZ,      M_ | IZ, I8,      M_ | I8, 0,       0,       0,       0,       // 6
+    R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      R8,      // 7
+    M_ | I8, M_ | IZ, M_ | I8, M_ | I8, M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 8
+    0,       0,       0,       0,       0,       0,       0,       0,       0,       0,       S_,      0,       0,       0,       0,       0,       // 9
+    S_,      S_,      S_,      S_,      0,       0,       0,       0,       I8,      IZ,      0,       0,       0,       0,       0,       0,       // A
+    I8,      I8,      I8,      I8,      I8,      I8,      I8,      I8,      IV,      IV,      IV,      IV,      IV,      IV,      IV,      IV,      // B
+    M_ | I8, M_ | I8, IW,      0,       S_,      S_,      M_ | I8, M_ | IZ, IW | I8, 0,       IW,      0,       0,       I8,      0,       0,       // C
+    M_,      M_,      M_,      M_,      I8,      I8,      0,       0,       M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // D
+    R8,      R8,      R8,      R8,      I8,      I8,      I8,      I8,      RZ,      RZ,      S_,      R8,      0,       0,       0,       0,       // E
+    S_,      0,       S_,      S_,      0,       0,       S_,      S_,      0,       0,       0,       0,       0,       0,       M_,      M_,      // F
+    // clang-format on
+};
+
+static constexpr std::array<uint16_t, 256> TwoByteOpcodes = {
+    // clang-format off
+    //  0        1        2        3        4        5        6        7        8        9        A        B        C        D        E        F
+    M_,      M_,      M_,      M_,      X_,      0,       0,       0,       0,       0,       X_,      0,       X_,      M_,      0,       M_ | I8, // 0
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 1
+    M_,      M_,      M_,      M_,      X_,      X_,      X_,      X_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 2
+    0,       0,       0,       0,       0,       0,       X_,      0,       S_,      X_,      S_,      X_,      X_,      X_,      X_,      X_,      // 3
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 4
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 5
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 6
+    M_ | I8, M_ | I8, M_ | I8, M_ | I8, M_,      M_,      M_,      0,       M_,      M_,      X_,      X_,      M_,      M_,      M_,      M_,      // 7
+    RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      RZ,      // 8
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // 9
+    0,       0,       0,       M_,      M_ | I8, M_,      X_,      X_,      0,       0,       0,       M_,      M_ | I8, M_,      M_,      M_,      // A
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_ | I8, M_,      M_,      M_,      M_,      M_,      // B
+    M_,      M_,      M_ | I8, M_,      M_ | I8, M_ | I8, M_ | I8, M_,      0,       0,       0,       0,       0,       0,       0,       0,       // C
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // D
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // E
+    M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      M_,      // F
+    // clang-format on
+};
+
+#undef M_
+#undef I8
+#undef IW
+#undef IZ
+#undef IV
+#undef R8
+#undef RZ
+#undef S_
+#undef X_
+
+
+// Returns true for one-byte opcodes that are invalid in 64-bit mode.
+static bool IsInvalidIn64BitMode(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x06: // PUSH ES
+    case 0x07: // POP ES
+    case 0x0e: // PUSH CS
+    case 0x16: // PUSH SS
+    case 0x17: // POP SS
+    case 0x1e: // PUSH DS
+    case 0x1f: // POP DS
+    case 0x27: // DAA
+    case 0x2f: // DAS
+    case 0x37: // AAA
+    case 0x3f: // AAS
+    case 0x60: // PUSHA
+    case 0x61: // POPA
+    case 0x82: // Alias of 0x80
+    case 0x9a: // CALL far
+    case 0xce: // INTO
+    case 0xd4: // AAM
+    case 0xd5: // AAD
+    case 0xd6: // SALC
+    case 0xea: // JMP far
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Returns true if the bytes are within reach of a 32-bit displacement.
+static bool IsRel32(intptr_t delta)
+{
+    return (int64_t)delta == (int32_t)delta;
+}
+
+
+uintptr_t hl::Instruction::relativeTarget(uintptr_t adr) const
+{
+    const auto* code = (const unsigned char*)adr;
+    intptr_t displacement = 0;
+    if (relativeSize == 1)
+    {
+        displacement = (int8_t)code[relativeOffset];
+    }
+    else if (relativeSize == 4)
+    {
+        int32_t disp32 = 0;
+        memcpy(&disp32, code + relativeOffset, sizeof(disp32));
+        displacement = disp32;
+    }
+    return adr + length + displacement;
+}
+
+
+hl::Instruction hl::DecodeInstruction(uintptr_t adr)
+{
+    const auto* code = (const unsigned char*)adr;
+    int pos = 0;
+    bool operandSize16 = false;
+    bool addressSizeOverride = false;
+
+    // Legacy prefixes.
+    for (;; pos++)
+    {
+        if (pos == MaxInstructionLength)
+            return {};
+        const auto prefix = code[pos];
+        if (prefix == 0x66)
+            operandSize16 = true;
+        else if (prefix == 0x67)
+            addressSizeOverride = true;
+        else if (prefix != 0xf0 && prefix != 0xf2 && prefix != 0xf3 && prefix != 0x26 && prefix != 0x2e &&
+                 prefix != 0x36 && prefix != 0x3e && prefix != 0x64 && prefix != 0x65)
+            break;
+    }
+
+    bool rexW = false;
+#ifdef ARCH_64BIT
+    constexpr bool is64Bit = true;
+    if ((code[pos] & 0xf0) == 0x40)
+    {
+        rexW = (code[pos] & 0x08) != 0;
+        pos++;
+    }
+#else
+    constexpr bool is64Bit = false;
+#endif
+
+    Instruction result;
+    uint8_t opcode = code[pos++];
+    // 0 for one-byte opcodes, 1 for 0F xx, 2 for 0F 38 xx and 3 for 0F 3A xx. VEX and EVEX may select others.
+    int map = 0;
+    uint16_t flags = 0;
+
+    // In 32-bit mode, these are only VEX and EVEX prefixes if the following byte would be a register operand.
+    const bool isVex = (opcode == 0xc4 || opcode == 0xc5 || opcode == 0x62) && (is64Bit || (code[pos] & 0xc0) == 0xc0);
+    if (isVex)
+    {
+        if (opcode == 0xc5)
+        {
+            map = 1;
+            pos += 1;
+        }
+        else if (opcode == 0xc4)
+        {
+            map = code[pos] & 0x1f;
+            pos += 2;
+        }
+        else
+        {
+            map = code[pos] & 0x07;
+            pos += 3;
+        }
+        opcode = code[pos++];
+
+        if (map == 1)
+            flags = TwoByteOpcodes[opcode];
+        else if (map == 2 || map == 5 || map == 6)
+            flags = OP_MODRM;
+        else if (map == 3)
+            flags = OP_MODRM | OP_IMM8;
+        else
+            return {};
+        // There are no VEX encoded jumps.
+        if (flags & (OP_REL8 | OP_REL32 | OP_SPECIAL))
+            return {};
+    }
+    else if (opcode == 0x0f)
+    {
+        opcode = code[pos++];
+        map = 1;
+        if (opcode == 0x38)
+        {
+            opcode = code[pos++];
+            map = 2;
+            flags = OP_MODRM;
+        }
+        else if (opcode == 0x3a)
+        {
+            opcode = code[pos++];
+            map = 3;
+            flags = OP_MODRM | OP_IMM8;
+        }
+        else
+        {
+            flags = TwoByteOpcodes[opcode];
+        }
+    }
+    else
+    {
+        if (is64Bit && IsInvalidIn64BitMode(opcode))
+            return {};
+        flags = OneByteOpcodes[opcode];
+    }
+
+    if (flags & OP_INVALID)
+        return {};
+
+    int immediateSize = 0;
+    if (map == 0 && (flags & OP_SPECIAL))
+    {
+        switch (opcode)
+        {
+        case 0xa0: // MOV AL, moffs
+        case 0xa1: // MOV eAX, moffs
+        case 0xa2: // MOV moffs, AL
+        case 0xa3: // MOV moffs, eAX
+            if (is64Bit)
+                immediateSize = addressSizeOverride ? 4 : 8;
+            else
+                immediateSize = addressSizeOverride ? 2 : 4;
+            break;
+        case 0x9a: // CALL ptr16:32
+        case 0xea: // JMP ptr16:32
+            immediateSize = operandSize16 ? 4 : 6;
+            break;
+        case 0x62: // BOUND
+        case 0xc4: // LES
+        case 0xc5: // LDS
+            flags = OP_MODRM;
+            break;
+        case 0xf6: // Group 3. Only TEST has an immediate.
+            flags = OP_MODRM | (((code[pos] >> 3) & 7) < 2 ? OP_IMM8 : OP_NONE);
+            break;
+        case 0xf7:
+            flags = OP_MODRM | (((code[pos] >> 3) & 7) < 2 ? OP_IMMZ : OP_NONE);
+            break;
+        default:
+            // A prefix after the REX prefix.
+            return {};
+        }
+    }
+
+    if (flags & OP_MODRM)
+    {
+        const uint8_t modrm = code[pos++];
+        const int mod = modrm >> 6;
+        const int rm = modrm & 7;
+
+        if (map == 0 && opcode == 0xff)
+        {
+            const int reg = (modrm >> 3) & 7;
+            // JMP r/m and JMP far m.
+            result.endsFlow = reg == 4 || reg == 5;
+        }
+
+        if (mod != 3)
+        {
+            if (!is64Bit && addressSizeOverride)
+            {
+                // 16-bit addressing.
+                if (mod == 0 && rm == 6)
+                    pos += 2;
+                else
+                    pos += mod == 1 ? 1 : mod == 2 ? 2 : 0;
+            }
+            else
+            {
+                if (rm == 4)
+                {
+                    const uint8_t sib = code[pos++];
+                    if (mod == 0 && (sib & 7) == 5)
+                        pos += 4;
+                }
+                else if (mod == 0 && rm == 5)
+                {
+                    if (is64Bit)
+                    {
+                        result.relative = RelativeType::Memory;
+                        result.relativeOffset = pos;
+                        result.relativeSize = 4;
+                    }
+                    pos += 4;
+                }
+                pos += mod == 1 ? 1 : mod == 2 ? 4 : 0;
+            }
+        }
+    }
+
+    if (flags & OP_IMM8)
+        immediateSize += 1;
+    if (flags & OP_IMM16)
+        immediateSize += 2;
+    if (flags & OP_IMMZ)
+        immediateSize += operandSize16 ? 2 : 4;
+    if (flags & OP_IMMV)
+        immediateSize += rexW ? 8 : operandSize16 ? 2 : 4;
+    pos += immediateSize;
+
+    if (flags & (OP_REL8 | OP_REL32))
+    {
+        // Jumps with a 16-bit displacement truncate the instruction pointer. In 64-bit mode, the operand size prefix
+        // does not change the displacement and is used as padding, like for calls of __tls_get_addr.
+        if ((flags & OP_REL32) && operandSize16 && !is64Bit)
+            return {};
+
+        result.relativeOffset = pos;
+        result.relativeSize = (flags & OP_REL8) ? 1 : 4;
+        pos += result.relativeSize;
+
+        if (map == 1 || (opcode >= 0x70 && opcode <= 0x7f))
+        {
+            result.relative = RelativeType::ConditionalJump;
+            result.condition = opcode & 0x0f;
+        }
+        else if (opcode >= 0xe0 && opcode <= 0xe3)
+        {
+            result.relative = RelativeType::Loop;
+        }
+        else if (opcode == 0xe8)
+        {
+            result.relative = RelativeType::Call;
+        }
+        else
+        {
+            result.relative = RelativeType::Jump;
+            result.endsFlow = true;
+        }
+    }
+
+    if (map == 0)
+    {
+        switch (opcode)
+        {
+        case 0xc2: // RET imm16
+        case 0xc3: // RET
+        case 0xca: // RETF imm16
+        case 0xcb: // RETF
+        case 0xcc: // INT3
+        case 0xcf: // IRET
+        case 0xea: // JMP far
+        case 0xf4: // HLT
+            result.endsFlow = true;
+            break;
+        default:
+            break;
+        }
+    }
+    else if (map == 1 && opcode == 0x0b && !isVex) // UD2
+    {
+        result.endsFlow = true;
+    }
+
+    if (pos > MaxInstructionLength)
+        return {};
+    result.length = pos;
+    return result;
+}
+
+
+int hl::GetPrologueSize(uintptr_t location, int minSize)
+{
+    int size = 0;
+    while (size < minSize)
+    {
+        const auto instruction = hl::DecodeInstruction(location + size);
+        if (!instruction.length || instruction.relative == RelativeType::Loop)
+            return 0;
+        size += instruction.length;
+        // The following bytes may not belong to the same function.
+        if (instruction.endsFlow && size < minSize)
+            return 0;
+    }
+    return size;
+}
+
+
+int hl::MaxRelocatedSize(uintptr_t from, int size)
+{
+    int relocatedSize = 0;
+    for (int offset = 0; offset < size;)
+    {
+        const auto instruction = hl::DecodeInstruction(from + offset);
+        if (!instruction.length)
+            return 0;
+        const bool isBranch =
+            instruction.relative != RelativeType::None && instruction.relative != RelativeType::Memory;
+        relocatedSize += isBranch ? MaxRelocatedBranchSize : instruction.length;
+        offset += instruction.length;
+    }
+    return relocatedSize;
+}
+
+
+// Appends a little endian value.
+template <typename T>
+static void Append(std::vector<unsigned char>& code, T value)
+{
+    const auto size = code.size();
+    code.resize(size + sizeof(T));
+    memcpy(&code[size], &value, sizeof(T));
+}
+
+std::vector<unsigned char> hl::RelocateCode(uintptr_t from, int size, uintptr_t to,
+                                            std::vector<std::pair<int, int>>* offsets)
+{
+    std::vector<std::pair<int, Instruction>> instructions;
+    for (int offset = 0; offset < size;)
+    {
+        const auto instruction = hl::DecodeInstruction(from + offset);
+        if (!instruction.length || instruction.relative == RelativeType::Loop || offset + instruction.length > size)
+            return {};
+        instructions.emplace_back(offset, instruction);
+        offset += instruction.length;
+    }
+
+    auto isInside = [from, size](uintptr_t target) { return target >= from && target < from + size; };
+
+    // Jumps into the copied range always use a 32-bit displacement, so that the sizes do not depend on each other.
+    std::vector<int> newOffsets(instructions.size() + 1);
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        const auto& [offset, instruction] = instructions[i];
+        int newSize = instruction.length;
+        if (instruction.relative != RelativeType::None && instruction.relative != RelativeType::Memory)
+        {
+            const uintptr_t target = instruction.relativeTarget(from + offset);
+            const uintptr_t newAdr = to + newOffsets[i];
+            const int nearSize = instruction.relative == RelativeType::Jump ? JumpSizeNear
+                                 : instruction.relative == RelativeType::Call ? CallSizeNear
+                                                                              : ConditionalJumpSizeNear;
+            newSize = nearSize;
+#ifdef ARCH_64BIT
+            if (!isInside(target) && !IsRel32((intptr_t)(target - newAdr - nearSize)))
+            {
+                newSize = instruction.relative == RelativeType::Jump ? JumpSizeFar
+                          : instruction.relative == RelativeType::Call ? CallSizeFar
+                                                                       : ConditionalJumpSizeFar;
+            }
+#endif
+        }
+        newOffsets[i + 1] = newOffsets[i] + newSize;
+    }
+
+    // Returns the address in the copy of a target within the copied range.
+    auto relocateTarget = [&](uintptr_t target) -> uintptr_t
+    {
+        for (size_t i = 0; i < instructions.size(); i++)
+        {
+            if (from + instructions[i].first == target)
+                return to + newOffsets[i];
+        }
+        // Not on an instruction boundary.
+        return 0;
+    };
+
+    std::vector<unsigned char> code;
+    code.reserve(newOffsets.back());
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        const auto& [offset, instruction] = instructions[i];
+        const uintptr_t adr = from + offset;
+        const uintptr_t newAdr = to + newOffsets[i];
+        const int newSize = newOffsets[i + 1] - newOffsets[i];
+
+        if (instruction.relative == RelativeType::None)
+        {
+            code.insert(code.end(), (const unsigned char*)adr, (const unsigned char*)adr + instruction.length);
+            continue;
+        }
+
+        uintptr_t target = instruction.relativeTarget(adr);
+        if (instruction.relative == RelativeType::Memory)
+        {
+            const auto delta = (intptr_t)(target - newAdr - instruction.length);
+            if (!IsRel32(delta))
+                return {};
+            code.insert(code.end(), (const unsigned char*)adr, (const unsigned char*)adr + instruction.length);
+            memcpy(&code[code.size() - instruction.length + instruction.relativeOffset], &delta, 4);
+            continue;
+        }
+
+        if (isInside(target))
+        {
+            target = relocateTarget(target);
+            if (!target)
+                return {};
+        }
+
+        if (newSize == JumpSizeNear || newSize == ConditionalJumpSizeNear)
+        {
+            // Also covers CALL, which has the same size as JMP.
+            if (instruction.relative == RelativeType::ConditionalJump)
+            {
+                code.push_back(0x0f); // Jcc rel32
+                code.push_back(0x80 | instruction.condition);
+            }
+            else
+            {
+                code.push_back(instruction.relative == RelativeType::Call ? 0xe8 : 0xe9); // CALL/JMP rel32
+            }
+            Append(code, (int32_t)(target - newAdr - newSize));
+            continue;
+        }
+
+#ifdef ARCH_64BIT
+        if (instruction.relative == RelativeType::Call)
+        {
+            code.push_back(0xff); // CALL [RIP+2]
+            code.push_back(0x15);
+            Append(code, (int32_t)2);
+            code.push_back(0xeb); // JMP +8
+            code.push_back(0x08);
+        }
+        else
+        {
+            if (instruction.relative == RelativeType::ConditionalJump)
+            {
+                // Skip the absolute jump if the inverted condition is met.
+                code.push_back(0x70 | (instruction.condition ^ 1)); // Jncc +14
+                code.push_back(JumpSizeFar);
+            }
+            code.push_back(0xff); // JMP [RIP+0]
+            code.push_back(0x25);
+            Append(code, (int32_t)0);
+        }
+        Append(code, (uint64_t)target);
+#endif
+    }
+
+    if (offsets)
+    {
+        offsets->clear();
+        for (size_t i = 0; i < instructions.size(); i++)
+            offsets->emplace_back(instructions[i].first, newOffsets[i]);
+    }
+    return code;
+}
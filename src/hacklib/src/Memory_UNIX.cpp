@@ -2,13 +2,21 @@
 #include "hacklib/BitManip.h"
 #include "hacklib/Logging.h"
 #include <algorithm>
+#include <cerrno>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <fstream>
 #include <stdexcept>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+
 static int ToUnixProt(hl::Protection protection)
 {
     int unixProt = PROT_NONE;
@@ -58,6 +66,53 @@ void* hl::PageAlloc(size_t n, hl::Protection protection)
     return mmap(nullptr, n, ToUnixProt(protection), MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 }
 
+void* hl::PageAllocNear(uintptr_t adr, size_t n, hl::Protection protection, uintptr_t maxDistance)
+{
+    const uintptr_t pageSize = hl::GetPageSize();
+    n = hl::Align(n, pageSize);
+    // Stay above the lowest address that may be mapped by default.
+    const uintptr_t low = std::max<uintptr_t>(adr > maxDistance ? adr - maxDistance : 0, 0x10000);
+    const uintptr_t high = adr < UINTPTR_MAX - maxDistance ? adr + maxDistance : UINTPTR_MAX;
+
+    // The address nearest to adr within every gap in range.
+    std::vector<uintptr_t> candidates;
+    auto addGap = [&](uintptr_t begin, uintptr_t end)
+    {
+        begin = hl::Align(std::max(begin, low), pageSize);
+        end = hl::AlignDown(std::min(end, high), pageSize);
+        if (end < begin || end - begin < n)
+            return;
+        candidates.push_back(std::clamp(hl::AlignDown(adr, pageSize), begin, end - n));
+    };
+    uintptr_t prevEnd = 0;
+    for (const auto& region : hl::GetMemoryMap())
+    {
+        addGap(prevEnd, region.base);
+        prevEnd = region.base + region.size;
+    }
+    addGap(prevEnd, high);
+
+    std::ranges::sort(candidates, {}, [adr](uintptr_t candidate)
+                      { return candidate > adr ? candidate - adr : adr - candidate; });
+    for (auto candidate : candidates)
+    {
+        // The gap may have been taken by another thread since the memory map was read.
+        void* p = mmap((void*)candidate, n, ToUnixProt(protection), MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                       -1, 0);
+        if (p == MAP_FAILED)
+            continue;
+        // Kernels before 4.17 ignore the flag and treat the address as a hint.
+        if (p != (void*)candidate)
+        {
+            munmap(p, n);
+            continue;
+        }
+        return p;
+    }
+
+    return nullptr;
+}
+
 void hl::PageFree(void* p, size_t n)
 {
     if (!n)
@@ -199,3 +254,83 @@ std::vector<hl::MemoryRegion> hl::GetMemoryMap(int pid)
 
     return regions;
 }
+
+
+size_t hl::GetReadableSize(const hl::MemoryRegion& region)
+{
+    if (!(region.protection & hl::PROTECTION_READ) || region.size == 0)
+        return 0;
+
+    // Reading through the kernel reports an error instead of raising a signal. Inaccessible pages of a readable
+    // region only occur at its end, so the readable size is found with a binary search over the pages.
+    const uintptr_t pageSize = hl::GetPageSize();
+    const pid_t pid = getpid();
+    bool unsupported = false;
+    auto isReadable = [&](size_t page)
+    {
+        uint8_t byte;
+        iovec local = { &byte, 1 };
+        iovec remote = { (void*)(region.base + page * pageSize), 1 };
+        if (process_vm_readv(pid, &local, 1, &remote, 1, 0) == 1)
+            return true;
+        unsupported = errno != EFAULT;
+        return false;
+    };
+
+    const size_t numPages = (region.size + pageSize - 1) / pageSize;
+    if (isReadable(numPages - 1))
+        return region.size;
+    if (unsupported)
+    {
+        // Without the system call, the memory map has to be trusted.
+        return region.size;
+    }
+    if (!isReadable(0))
+        return 0;
+
+    // Page lo is readable, page hi is not.
+    size_t lo = 0;
+    size_t hi = numPages - 1;
+    while (hi - lo > 1)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (isReadable(mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi * pageSize;
+}
+
+std::vector<uint8_t> hl::GetPopulatedPages(uintptr_t adr, size_t size)
+{
+    // Bits of a pagemap entry.
+    constexpr uint64_t PagemapPresent = 1ull << 63;
+    constexpr uint64_t PagemapSwapped = 1ull << 62;
+    // The number of entries that are read at once.
+    constexpr size_t BatchSize = 0x10000;
+
+    const uintptr_t pageSize = hl::GetPageSize();
+    const uintptr_t firstPage = adr / pageSize;
+    const size_t numPages = (adr + size + pageSize - 1) / pageSize - firstPage;
+    std::vector<uint8_t> populated(numPages, 1);
+
+    const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return populated;
+
+    std::vector<uint64_t> entries(std::min(numPages, BatchSize));
+    for (size_t i = 0; i < numPages; i += BatchSize)
+    {
+        const size_t count = std::min(numPages - i, BatchSize);
+        const size_t numBytes = count * sizeof(uint64_t);
+        const auto offset = (off_t)((firstPage + i) * sizeof(uint64_t));
+        if (pread(fd, entries.data(), numBytes, offset) != (ssize_t)numBytes)
+            break;
+        for (size_t j = 0; j < count; j++)
+            populated[i + j] = (entries[j] & (PagemapPresent | PagemapSwapped)) != 0;
+    }
+
+    close(fd);
+    return populated;
+}
@@ -1,6 +1,8 @@
 #include "hacklib/Memory.h"
+#include "hacklib/BitManip.h"
 #include "hacklib/Logging.h"
 #include <Windows.h>
+#include <algorithm>
 #include <stdexcept>
 
 
@@ -99,6 +101,51 @@ void* hl::PageAlloc(size_t n, hl::Protection protection)
     return VirtualAlloc(NULL, n, MEM_RESERVE | MEM_COMMIT, ToWindowsProt(protection));
 }
 
+void* hl::PageAllocNear(uintptr_t adr, size_t n, hl::Protection protection, uintptr_t maxDistance)
+{
+    SYSTEM_INFO sys_info;
+    GetSystemInfo(&sys_info);
+    // Allocations start on the allocation granularity, which is larger than the page size.
+    const uintptr_t granularity = sys_info.dwAllocationGranularity;
+    n = hl::Align(n, (uintptr_t)sys_info.dwPageSize);
+    const uintptr_t low =
+        std::max(adr > maxDistance ? adr - maxDistance : 0, (uintptr_t)sys_info.lpMinimumApplicationAddress);
+    const uintptr_t high = std::min(adr < UINTPTR_MAX - maxDistance ? adr + maxDistance : UINTPTR_MAX,
+                                    (uintptr_t)sys_info.lpMaximumApplicationAddress);
+
+    // The address nearest to adr within every free region in range.
+    std::vector<uintptr_t> candidates;
+    MEMORY_BASIC_INFORMATION mbi;
+    for (uintptr_t cur = low; cur < high && VirtualQuery((LPCVOID)cur, &mbi, sizeof(mbi));)
+    {
+        const auto regionBase = (uintptr_t)mbi.BaseAddress;
+        const uintptr_t regionEnd = regionBase + mbi.RegionSize;
+        if (mbi.State == MEM_FREE)
+        {
+            const uintptr_t begin = hl::Align(std::max(regionBase, low), granularity);
+            const uintptr_t end = std::min(regionEnd, high);
+            if (begin < end && end - begin >= n)
+            {
+                const uintptr_t last = hl::AlignDown(end - n, granularity);
+                if (begin <= last)
+                    candidates.push_back(std::clamp(hl::AlignDown(adr, granularity), begin, last));
+            }
+        }
+        cur = regionEnd;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [adr](uintptr_t a, uintptr_t b)
+              { return (a > adr ? a - adr : adr - a) < (b > adr ? b - adr : adr - b); });
+    for (auto candidate : candidates)
+    {
+        // The region may have been taken by another thread since it was queried.
+        if (void* p = VirtualAlloc((LPVOID)candidate, n, MEM_RESERVE | MEM_COMMIT, ToWindowsProt(protection)))
+            return p;
+    }
+
+    return nullptr;
+}
+
 void hl::PageFree(void* p, size_t n)
 {
     HL_APICHECK(VirtualFree(p, 0, MEM_RELEASE));
@@ -232,4 +279,20 @@ std::vector<hl::MemoryRegion> hl::GetMemoryMap(int pid)
     }
 
     return regions;
-}
\ No newline at end of file
+}
+
+size_t hl::GetReadableSize(const hl::MemoryRegion& region)
+{
+    // The regions from VirtualQuery are always backed.
+    if (!(region.protection & hl::PROTECTION_READ) || (region.protection & hl::PROTECTION_GUARD))
+        return 0;
+    return region.size;
+}
+
+std::vector<uint8_t> hl::GetPopulatedPages(uintptr_t adr, size_t size)
+{
+    // Reserved memory is not part of the memory map. Committed pages that were never touched can not be told apart
+    // from pages that were paged out.
+    const uintptr_t pageSize = hl::GetPageSize();
+    return std::vector<uint8_t>((adr + size + pageSize - 1) / pageSize - adr / pageSize, 1);
+}
@@ -0,0 +1,137 @@
+#include "hacklib/ModuleRegistry.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+std::span<const hl::MemoryRegion> hl::ModuleRegistry::Snapshot::codeRegions(hl::ModuleHandle hModule) const
+{
+    auto it = m_codeRegions.find(hModule);
+    if (it == m_codeRegions.end())
+        return {};
+    return it->second;
+}
+
+hl::ModuleHandle hl::ModuleRegistry::Snapshot::findModuleName(const std::string& moduleName) const
+{
+    const std::shared_lock lock(m_moduleNamesMutex);
+    auto it = m_moduleNames.find(moduleName);
+    return it == m_moduleNames.end() ? hl::NullModuleHandle : it->second;
+}
+
+std::pair<uintptr_t, uintptr_t> hl::ModuleRegistry::Snapshot::moduleExtent(hl::ModuleHandle hModule) const
+{
+    auto it = m_extents.find(hModule);
+    if (it == m_extents.end())
+        return { 0, 0 };
+    return it->second;
+}
+
+
+std::shared_ptr<const hl::ModuleRegistry::Snapshot> hl::ModuleRegistry::snapshot()
+{
+    auto isCurrent = [this](const std::shared_ptr<const Snapshot>& snapshot, uint64_t loadCount)
+    {
+        return snapshot && snapshot->m_loadCount == loadCount && snapshot->m_invalidateCount == m_invalidateCount;
+    };
+
+    // The counters are read before the memory map, so that a change during the refresh causes another refresh.
+    uint64_t loadCount = GetLoadCount();
+    auto current = m_snapshot.load();
+    if (isCurrent(current, loadCount))
+        return current;
+
+    const std::lock_guard lock(m_refreshMutex);
+
+    // Another thread may have refreshed in the meantime.
+    loadCount = GetLoadCount();
+    current = m_snapshot.load();
+    if (isCurrent(current, loadCount))
+        return current;
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->m_generation = current ? current->m_generation + 1 : 1;
+    snapshot->m_loadCount = loadCount;
+    snapshot->m_invalidateCount = m_invalidateCount;
+    snapshot->m_memoryMap = hl::GetMemoryMap();
+    for (const auto& region : snapshot->m_memoryMap)
+    {
+        if (!region.hModule)
+            continue;
+
+        auto [it, inserted] = snapshot->m_extents.try_emplace(region.hModule, region.base, region.base + region.size);
+        if (!inserted)
+        {
+            it->second.first = std::min(it->second.first, region.base);
+            it->second.second = std::max(it->second.second, region.base + region.size);
+        }
+        if (region.protection == hl::PROTECTION_READ_EXECUTE)
+            snapshot->m_codeRegions[region.hModule].push_back(region);
+    }
+
+    m_snapshot.store(snapshot);
+    return snapshot;
+}
+
+void hl::ModuleRegistry::invalidate()
+{
+    m_invalidateCount++;
+}
+
+const std::vector<hl::MemoryRegion>& hl::ModuleRegistry::getCodeRegions(const std::string& moduleName)
+{
+    auto codeRegions = resolveCodeRegions(moduleName);
+    const auto& regions = codeRegions.snapshot->m_codeRegions.at(codeRegions.regions.front().hModule);
+
+    // The caller holds no reference to the snapshot, so it must outlive newer snapshots.
+    if (!codeRegions.snapshot->m_retained.exchange(true))
+    {
+        const std::lock_guard lock(m_retainedMutex);
+        m_retainedSnapshots.push_back(std::move(codeRegions.snapshot));
+    }
+    return regions;
+}
+
+hl::ModuleRegistry::CodeRegions hl::ModuleRegistry::findCodeRegions(const std::string& moduleName)
+{
+    auto current = m_snapshot.load();
+    if (current && current->m_invalidateCount == m_invalidateCount)
+    {
+        if (auto hModule = current->findModuleName(moduleName))
+        {
+            const auto regions = current->codeRegions(hModule);
+            return { std::move(current), regions };
+        }
+    }
+
+    return resolveCodeRegions(moduleName);
+}
+
+hl::ModuleRegistry::CodeRegions hl::ModuleRegistry::resolveCodeRegions(const std::string& moduleName)
+{
+    auto hModule = hl::GetModuleByName(moduleName);
+    if (!hModule)
+    {
+        throw std::runtime_error("no such module");
+    }
+
+    // The span refers into the snapshot, which must outlive it even if another thread publishes a newer one.
+    auto current = snapshot();
+    const auto regions = current->codeRegions(hModule);
+    if (regions.empty())
+    {
+        throw std::runtime_error("no code sections found");
+    }
+
+    {
+        const std::unique_lock lock(current->m_moduleNamesMutex);
+        current->m_moduleNames.try_emplace(moduleName, hModule);
+    }
+    return { std::move(current), regions };
+}
+
+
+hl::ModuleRegistry& hl::GetModuleRegistry()
+{
+    static ModuleRegistry registry;
+    return registry;
+}
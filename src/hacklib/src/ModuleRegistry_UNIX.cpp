@@ -0,0 +1,18 @@
+#include "hacklib/ModuleRegistry.h"
+#include <link.h>
+
+
+uint64_t hl::ModuleRegistry::GetLoadCount()
+{
+    // The loader counts all loads and unloads. The counters are the same for every module, so the first one is
+    // enough.
+    uint64_t count = 0;
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data)
+        {
+            *(uint64_t*)data = info->dlpi_adds + info->dlpi_subs;
+            return 1;
+        },
+        &count);
+    return count;
+}
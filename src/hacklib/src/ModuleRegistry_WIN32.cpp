@@ -0,0 +1,35 @@
+#include "hacklib/ModuleRegistry.h"
+#include <Windows.h>
+
+
+// Declarations from the documentation of LdrRegisterDllNotification.
+using LdrDllNotificationFunction = VOID(CALLBACK*)(ULONG reason, const void* data, PVOID context);
+using LdrRegisterDllNotificationFunction = LONG(NTAPI*)(ULONG flags, LdrDllNotificationFunction function,
+                                                        PVOID context, PVOID* cookie);
+
+static std::atomic<uint64_t> g_loadCount = 0;
+
+
+static bool RegisterDllNotification()
+{
+    auto ldrRegisterDllNotification = (LdrRegisterDllNotificationFunction)GetProcAddress(
+        GetModuleHandleA("ntdll.dll"), "LdrRegisterDllNotification");
+    if (!ldrRegisterDllNotification)
+        return false;
+
+    PVOID cookie = nullptr;
+    return ldrRegisterDllNotification(
+               0, [](ULONG, const void*, PVOID) { g_loadCount++; }, nullptr, &cookie) >= 0;
+}
+
+uint64_t hl::ModuleRegistry::GetLoadCount()
+{
+    // The notification stays registered for the lifetime of the process.
+    static const bool registered = RegisterDllNotification();
+    if (!registered)
+    {
+        // Without notifications every snapshot is outdated.
+        return ++g_loadCount;
+    }
+    return g_loadCount;
+}
@@ -0,0 +1,58 @@
+#include "hacklib/Pattern.h"
+#include <stdexcept>
+
+
+hl::CompiledPattern::CompiledPattern(const std::string& pattern)
+{
+    if (!ParsePatternString(
+            pattern, [this](uint8_t value, uint8_t mask) { add(value, mask); },
+            [this](size_t min, size_t max) { m_gaps.push_back({ size(), min, max }); }))
+        throw std::runtime_error("invalid format of pattern string");
+
+    m_plan = MakePatternPlan(m_bytes.data(), m_mask.data(), m_gaps.empty() ? size() : m_gaps.front().offset);
+}
+
+hl::CompiledPattern::CompiledPattern(const char* byteMask, const char* checkMask)
+{
+    for (size_t i = 0; checkMask[i]; i++)
+        add((uint8_t)byteMask[i], checkMask[i] == 'x' ? 0xff : 0x00);
+
+    m_plan = MakePatternPlan(m_bytes.data(), m_mask.data(), size());
+}
+
+
+void hl::CompiledPattern::add(uint8_t value, uint8_t mask)
+{
+    m_bytes.push_back(value & mask);
+    m_mask.push_back(mask);
+}
+
+
+// Matches the pattern from the byte index first on, which directly follows the gap with index gap - 1.
+static bool MatchPatternFrom(const uint8_t* data, const uint8_t* end, const hl::PatternView& pattern, size_t first,
+                             size_t gap)
+{
+    const size_t last = gap < pattern.numGaps ? pattern.gaps[gap].offset : pattern.size;
+    if ((size_t)(end - data) < last - first)
+        return false;
+    for (size_t i = first; i < last; i++)
+    {
+        if ((data[i - first] & pattern.mask[i]) != pattern.bytes[i])
+            return false;
+    }
+    if (gap == pattern.numGaps)
+        return true;
+
+    data += last - first;
+    for (size_t len = pattern.gaps[gap].min; len <= pattern.gaps[gap].max && len <= (size_t)(end - data); len++)
+    {
+        if (MatchPatternFrom(data + len, end, pattern, last, gap + 1))
+            return true;
+    }
+    return false;
+}
+
+bool hl::MatchPattern(const uint8_t* data, const uint8_t* end, const PatternView& pattern)
+{
+    return MatchPatternFrom(data, end, pattern, 0, 0);
+}
@@ -1,14 +1,35 @@
 #include "hacklib/PatternScanner.h"
 #include "hacklib/ExeFile.h"
+#include "hacklib/ScanCache.h"
+#include "hacklib/ThreadPool.h"
 #include <algorithm>
 #include <unordered_map>
 #include <memory>
 #include <map>
 #include <iterator>
 #include <cstring>
+#include <cstdio>
 #include <stdexcept>
 #include <cstdlib>
 #include <cctype>
+#include <atomic>
+#include <bit>
+#include <functional>
+#include <future>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HL_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows all intrinsics without enabling them for the whole translation unit.
+#define HL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define HL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
 
 
 using namespace hl;
@@ -92,51 +113,298 @@ static const uint8_t* boyermoore(const uint8_t* txt, const size_t n, const uint8
 
 // End of third party code.
 
-PatternScanner::PatternScanner()
+
+// Regions larger than this are split for parallel scanning.
+static constexpr size_t ScanChunkSize = 0x100000;
+
+static std::mutex g_scanPoolMutex;
+static std::shared_ptr<hl::ThreadPool> g_scanPool;
+
+// Returns nullptr when parallel scanning is disabled.
+static std::shared_ptr<hl::ThreadPool> GetScanPool()
 {
-    memoryMap = hl::GetMemoryMap();
+    const std::lock_guard lock(g_scanPoolMutex);
+    return g_scanPool;
 }
 
-std::vector<uintptr_t> PatternScanner::find(const std::vector<std::string>& strings, const std::string& moduleName)
+void hl::SetScanThreads(unsigned numThreads)
 {
-    std::vector<uintptr_t> results(strings.size());
+    std::shared_ptr<hl::ThreadPool> pool;
+    if (numThreads != 1)
+        pool = std::make_shared<hl::ThreadPool>(numThreads);
 
-    int i = 0;
-    bool errorEncountered = false;
-    for (const auto& str : strings)
-    {
-        try
+    // Scans that are in progress keep the previous pool alive.
+    const std::lock_guard lock(g_scanPoolMutex);
+    g_scanPool = std::move(pool);
+}
+
+static std::atomic<bool> g_skipUnpopulatedPages = false;
+
+void hl::SetSkipUnpopulatedPages(bool skip)
+{
+    g_skipUnpopulatedPages = skip;
+}
+
+// Asynchronous scans run on the scan pool, or on a single background thread when parallel scanning is disabled.
+static std::shared_ptr<hl::ThreadPool> GetAsyncPool()
+{
+    if (auto pool = GetScanPool())
+        return pool;
+
+    static auto backgroundPool = std::make_shared<hl::ThreadPool>(1);
+    return backgroundPool;
+}
+
+// Runs func on the async pool. Exceptions are forwarded to the future.
+template <typename F>
+static auto RunAsync(F func) -> std::future<decltype(func())>
+{
+    // Tasks of the pool must be copyable, so the promise is shared.
+    auto promise = std::make_shared<std::promise<decltype(func())>>();
+    auto future = promise->get_future();
+    GetAsyncPool()->submit(
+        [promise, func = std::move(func)]() mutable
         {
-            results[i] = findString(str, moduleName);
-        }
-        catch (std::runtime_error&)
+            try
+            {
+                promise->set_value(func());
+            }
+            catch (...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+    return future;
+}
+
+// Reports the progress of an asynchronous scan. Throws if the scan was cancelled. Does nothing for synchronous scans
+// without options.
+static void ReportProgress(const AsyncScanOptions* options, size_t done, size_t total)
+{
+    if (!options)
+        return;
+    if (options->cancellation.isCancelled())
+        throw std::runtime_error("scan cancelled");
+    if (options->onProgress)
+        options->onProgress(done, total);
+}
+
+
+// Finds the instance-th match in [begin, end). Large ranges are split into chunks that are searched on the scan
+// pool. Each chunk only reports matches that start within itself, so the order and count of matches is the same
+// as with a sequential search.
+// findFirst(from, to) must return the first match that starts within [from, to) or nullptr. It may read behind to,
+// as far as a match that starts before to may extend.
+template <typename F>
+static const uint8_t* FindInstance(const uint8_t* begin, const uint8_t* end, int instance, const F& findFirst)
+{
+    const auto len = (size_t)(end - begin);
+    auto pool = len > ScanChunkSize ? GetScanPool() : nullptr;
+
+    if (!pool)
+    {
+        const uint8_t* cur = begin;
+        while (const uint8_t* found = findFirst(cur, end))
         {
-            errorEncountered = true;
+            if (!instance--)
+                return found;
+            cur = found + 1;
         }
-        i++;
+        return nullptr;
     }
 
-    if (errorEncountered)
-        throw std::runtime_error("one or more patterns not found");
+    const size_t numChunks = (len + ScanChunkSize - 1) / ScanChunkSize;
+    std::vector<std::vector<const uint8_t*>> chunkMatches(numChunks);
+    // The lowest chunk that contains enough matches by itself. All chunks behind it can be skipped.
+    std::atomic<size_t> completeChunk = numChunks;
 
-    return results;
+    pool->parallelFor(numChunks,
+                      [&](size_t i)
+                      {
+                          if (i > completeChunk.load(std::memory_order_relaxed))
+                              return;
+
+                          const uint8_t* cur = begin + i * ScanChunkSize;
+                          const uint8_t* to = begin + std::min(len, (i + 1) * ScanChunkSize);
+                          auto& matches = chunkMatches[i];
+                          while (matches.size() <= (size_t)instance)
+                          {
+                              const uint8_t* found = findFirst(cur, to);
+                              if (!found)
+                                  return;
+                              matches.push_back(found);
+                              cur = found + 1;
+                          }
+
+                          size_t expected = completeChunk.load();
+                          while (i < expected && !completeChunk.compare_exchange_weak(expected, i))
+                          {
+                          }
+                      });
+
+    // Merge in address order.
+    auto remaining = (size_t)instance;
+    for (const auto& matches : chunkMatches)
+    {
+        if (matches.size() > remaining)
+            return matches[remaining];
+        remaining -= matches.size();
+    }
+    return nullptr;
+}
+
+
+static std::mutex g_scanCacheMutex;
+static std::shared_ptr<hl::ScanCache> g_scanCache;
+
+static std::shared_ptr<hl::ScanCache> GetScanCache()
+{
+    const std::lock_guard lock(g_scanCacheMutex);
+    return g_scanCache;
+}
+
+void hl::SetScanCache(std::shared_ptr<ScanCache> cache)
+{
+    const std::lock_guard lock(g_scanCacheMutex);
+    g_scanCache = std::move(cache);
+}
+
+static uint64_t HashPatternQuery(const PatternView& pattern, int instance)
+{
+    uint64_t hash = ScanCache::Hash({ (const uint8_t*)"pattern", 7 });
+    hash = ScanCache::Hash({ (const uint8_t*)&instance, sizeof(instance) }, hash);
+    hash = ScanCache::Hash({ pattern.bytes, pattern.size }, hash);
+    hash = ScanCache::Hash({ pattern.mask, pattern.size }, hash);
+    return ScanCache::Hash({ (const uint8_t*)pattern.gaps, pattern.numGaps * sizeof(hl::PatternGap) }, hash);
+}
+
+static uint64_t HashStringQuery(const std::string& str, int instance)
+{
+    uint64_t hash = ScanCache::Hash({ (const uint8_t*)"string", 6 });
+    hash = ScanCache::Hash({ (const uint8_t*)&instance, sizeof(instance) }, hash);
+    return ScanCache::Hash({ (const uint8_t*)str.data(), str.size() }, hash);
+}
+
+// Answers a module-wide scan from the scan cache if possible. Otherwise runs the scan and stores its result.
+// validate(adr) must check the memory at a cached address, because cached results may be outdated.
+template <typename Validate, typename Scan>
+static uintptr_t CachedScan(hl::ModuleHandle hModule, uint64_t queryHash, const Validate& validate, const Scan& scan)
+{
+    auto cache = hModule ? GetScanCache() : nullptr;
+    if (!cache)
+        return scan();
+
+    const uint64_t moduleId = cache->getModuleId(hModule);
+    if (auto rva = cache->lookup(moduleId, queryHash))
+    {
+        const uintptr_t adr = (uintptr_t)hModule + *rva;
+        if (validate(adr))
+            return adr;
+    }
+
+    const uintptr_t result = scan();
+    if (result)
+        cache->store(moduleId, queryHash, result - (uintptr_t)hModule);
+    return result;
+}
+
+static bool IsInRegion(std::span<const hl::MemoryRegion> memoryMap, hl::ModuleHandle hModule,
+                       hl::Protection protection, uintptr_t adr, size_t size)
+{
+    return std::ranges::any_of(memoryMap,
+                               [&](const hl::MemoryRegion& region)
+                               {
+                                   return region.hModule == hModule && region.protection == protection &&
+                                          adr >= region.base && size <= region.size &&
+                                          adr - region.base <= region.size - size;
+                               });
+}
+
+// Checks if the pattern matches at adr within a code region of the module.
+static bool IsPatternMatch(std::span<const hl::MemoryRegion> memoryMap, hl::ModuleHandle hModule, uintptr_t adr,
+                           const PatternView& pattern)
+{
+    const auto region = std::ranges::find_if(memoryMap,
+                                             [&](const hl::MemoryRegion& r)
+                                             {
+                                                 return r.hModule == hModule &&
+                                                        r.protection == hl::PROTECTION_READ_EXECUTE &&
+                                                        adr >= r.base && adr - r.base < r.size;
+                                             });
+    return region != memoryMap.end() &&
+           hl::MatchPattern((const uint8_t*)adr, (const uint8_t*)(region->base + region->size), pattern);
+}
+
+// Checks if adr is a reference to the string like the ones found by PatternScanner::findString.
+static bool IsStringReference(const std::vector<hl::MemoryRegion>& memoryMap, hl::ModuleHandle hModule, uintptr_t adr,
+                              const std::string& str)
+{
+#ifdef ARCH_64BIT
+    if (!IsInRegion(memoryMap, hModule, hl::PROTECTION_READ_EXECUTE, adr - 3, 7))
+        return false;
+    const uintptr_t target = hl::FollowRelativeAddress(adr);
+#else
+    if (!IsInRegion(memoryMap, hModule, hl::PROTECTION_READ_EXECUTE, adr, sizeof(uintptr_t)))
+        return false;
+    const uintptr_t target = *(const uintptr_t*)adr;
+#endif
+    return IsInRegion(memoryMap, hModule, hl::PROTECTION_READ, target, str.size() + 1) &&
+           memcmp((const void*)target, str.c_str(), str.size() + 1) == 0;
+}
+
+
+PatternScanner::PatternScanner()
+{
+    refresh();
+}
+
+void PatternScanner::refresh()
+{
+    auto current = hl::GetModuleRegistry().snapshot();
+    if (snapshot && snapshot->generation() != current->generation())
+    {
+        // Modules may have been unloaded and others loaded at the same address.
+        moduleMap.clear();
+        exeFileMap.clear();
+        verifyRelocsMap.clear();
+        xrefIndexMap.clear();
+    }
+    snapshot = std::move(current);
 }
 
 uintptr_t hl::PatternScanner::findString(const std::string& str, const std::string& moduleName, int instance)
 {
-    if (!moduleMap.contains(moduleName))
-        moduleMap[moduleName] = hl::GetModuleByName(moduleName);
-    auto hModule = moduleMap[moduleName];
+    // Negative instances refer to the first reference, like they always did.
+    instance = std::max(instance, 0);
+    refresh();
+    auto hModule = getModule(moduleName);
+    return CachedScan(
+        hModule, HashStringQuery(str, instance),
+        [&](uintptr_t adr) { return IsStringReference(snapshot->memoryMap(), hModule, adr, str); },
+        [&] { return findStringReference(str, moduleName, instance); });
+}
+
+uintptr_t PatternScanner::findStringReference(const std::string& str, const std::string& moduleName, int instance)
+{
+    auto hModule = getModule(moduleName);
 
     uintptr_t addr = 0;
 
     // Search all readonly sections for the string.
-    for (const auto& region : memoryMap)
+    for (const auto& region : snapshot->memoryMap())
     {
         if (region.hModule == hModule && region.protection == hl::PROTECTION_READ)
         {
-            const uint8_t* found =
-                boyermoore((const uint8_t*)region.base, region.size, (const uint8_t*)str.data(), str.size() + 1);
+            auto begin = (const uint8_t*)region.base;
+            const uint8_t* end = begin + region.size;
+            const uint8_t* found = FindInstance(begin, end, 0,
+                                                [&](const uint8_t* from, const uint8_t* to)
+                                                {
+                                                    const size_t n = std::min((size_t)(end - from),
+                                                                              (size_t)(to - from) + str.size());
+                                                    return boyermoore(from, n, (const uint8_t*)str.data(),
+                                                                      str.size() + 1);
+                                                });
 
             if (found)
             {
@@ -149,67 +417,79 @@ uintptr_t hl::PatternScanner::findString(const std::string& str, const std::stri
     if (!addr)
         throw std::runtime_error("pattern not found");
 
-    if (!exeFileMap.contains(moduleName))
-        exeFileMap[moduleName] = std::make_unique<ExeFile>();
-    ExeFile& exeFile = *exeFileMap[moduleName].get();
-
-    if (!verifyRelocsMap.contains(moduleName))
-        verifyRelocsMap[moduleName] = exeFile.loadFromMem((uintptr_t)hModule) && exeFile.hasRelocs();
-    [[maybe_unused]] const bool verifyWithRelocs = verifyRelocsMap[moduleName];
-
-    uintptr_t ret = 0;
+#ifdef ARCH_64BIT
+    // Repeated queries are answered from the reference index of the module.
+    const auto refs = getXrefIndex(moduleName).referencesTo(addr, hl::XrefType::Address);
+    if ((size_t)instance >= refs.size())
+        return 0;
+    // Return the address of the displacement like the x86 search returns the address of the operand.
+    return refs[instance] + 3;
+#else
+    const ExeFile* relocs = getRelocs(moduleName);
 
     // Search all code sections for references to the string.
-    for (const auto& region : memoryMap)
+    for (const auto& region : snapshot->memoryMap())
     {
         if (region.hModule == hModule && region.protection == hl::PROTECTION_READ_EXECUTE)
         {
-            auto baseAdr = (const uint8_t*)region.base;
-            const size_t regionSize = region.size;
+            auto begin = (const uint8_t*)region.base;
+            const uint8_t* end = begin + region.size;
 
-#ifndef ARCH_64BIT
-            do
+            auto findFirst = [&](const uint8_t* from, const uint8_t* to) -> const uint8_t*
             {
-                const auto found = boyermoore(baseAdr, regionSize, (const uint8_t*)&addr, sizeof(uintptr_t));
-                if (found)
+                while (from < to)
                 {
+                    const size_t n = std::min((size_t)(end - from), (size_t)(to - from) + sizeof(uintptr_t) - 1);
+                    const auto found = boyermoore(from, n, (const uint8_t*)&addr, sizeof(uintptr_t));
+                    if (!found)
+                        break;
+
                     // Prevent false positives by checking if the reference is relocated.
-                    if ((verifyWithRelocs && !exeFile.isReloc((uintptr_t)found - (uintptr_t)hModule)) || instance-- > 0)
-                    {
-                        // continue searching
-                        baseAdr = found + 1;
-                        regionSize -= (size_t)(found - baseAdr + 1);
-                        continue;
-                    }
+                    if (!relocs || relocs->isReloc((uintptr_t)found - (uintptr_t)hModule))
+                        return found;
 
-                    ret = (uintptr_t)found;
-                }
-            } while (false);
-#else
-            auto endAdr = (uintptr_t)(baseAdr + regionSize);
-            for (auto adr = (uintptr_t)baseAdr; adr < endAdr; adr++)
-            {
-                if (FollowRelativeAddress(adr) == addr)
-                {
-                    // Prevent false poritives by checking if the reference occurs in a LEA instruction.
-                    const uint16_t opcode = *(uint16_t*)(adr - 3);
-                    if (opcode == 0x8D48 || opcode == 0x8D4C)
-                    {
-                        if (instance-- <= 0)
-                        {
-                            ret = adr;
-                            break;
-                        }
-                    }
+                    from = found + 1;
                 }
-            }
-#endif
-            if (ret)
-                break;
+                return nullptr;
+            };
+
+            if (const uint8_t* found = FindInstance(begin, end, instance, findFirst))
+                return (uintptr_t)found;
         }
     }
 
-    return ret;
+    return 0;
+#endif
+}
+
+hl::ModuleHandle PatternScanner::getModule(const std::string& moduleName)
+{
+    if (!moduleMap.contains(moduleName))
+        moduleMap[moduleName] = hl::GetModuleByName(moduleName);
+    return moduleMap[moduleName];
+}
+
+const hl::XrefIndex& PatternScanner::getXrefIndex(const std::string& moduleName)
+{
+    auto& index = xrefIndexMap[moduleName];
+    if (!index)
+    {
+        auto hModule = getModule(moduleName);
+        const auto [targetBegin, targetEnd] = snapshot->moduleExtent(hModule);
+        index = std::make_unique<hl::XrefIndex>(snapshot->codeRegions(hModule), targetBegin, targetEnd);
+    }
+    return *index;
+}
+
+const hl::ExeFile* PatternScanner::getRelocs(const std::string& moduleName)
+{
+    if (!exeFileMap.contains(moduleName))
+        exeFileMap[moduleName] = std::make_unique<ExeFile>();
+    ExeFile& exeFile = *exeFileMap[moduleName].get();
+
+    if (!verifyRelocsMap.contains(moduleName))
+        verifyRelocsMap[moduleName] = exeFile.loadFromMem((uintptr_t)getModule(moduleName)) && exeFile.hasRelocs();
+    return verifyRelocsMap[moduleName] ? &exeFile : nullptr;
 }
 
 std::map<std::string, uintptr_t> PatternScanner::findMap(const std::vector<std::string>& strings,
@@ -226,123 +506,1290 @@ std::map<std::string, uintptr_t> PatternScanner::findMap(const std::vector<std::
 }
 
 
-static bool MatchMaskedPattern(uintptr_t address, const char* byteMask, const char* checkMask)
+using SearchFunc = const uint8_t* (*)(const uint8_t*, const uint8_t*, const PatternView&);
+
+
+static bool MatchMaskedPattern(const uint8_t* data, const PatternView& pattern)
 {
-    for (; *checkMask; ++checkMask, ++address, ++byteMask)
-        if (*checkMask == 'x' && *(char*)address != *byteMask)
+    for (size_t i = 0; i < pattern.size; i++)
+        if ((data[i] & pattern.mask[i]) != pattern.bytes[i])
             return false;
-    return *checkMask == 0;
+    return true;
 }
 
-
-uintptr_t hl::FindPatternMask(const char* byteMask, const char* checkMask, const std::string& moduleName, int instance)
+static bool VerifyCandidate(const uint8_t* data, const PatternView& pattern)
 {
-    uintptr_t result = 0;
-    for (const auto& region : hl::GetCodeRegions(moduleName))
-    {
-        result = hl::FindPatternMask(byteMask, checkMask, region.base, region.size);
-        if (result)
-            break;
-    }
-    return result;
+    return pattern.verify ? pattern.verify(data) : MatchMaskedPattern(data, pattern);
 }
 
-uintptr_t hl::FindPatternMask(const char* byteMask, const char* checkMask, uintptr_t address, size_t len, int instance)
+// Returns the first match that lies completely within [begin, end) or nullptr. The search functions only consider
+// the bytes before the first gap of a pattern.
+static const uint8_t* SearchScalar(const uint8_t* begin, const uint8_t* end, const PatternView& pattern)
 {
-    const uintptr_t end = address + len - strlen(checkMask) + 1;
-    for (uintptr_t i = address; i < end; i++)
+    if ((size_t)(end - begin) < pattern.size)
+        return nullptr;
+
+    const uint8_t* last = end - pattern.size;
+    // Horspool search with the shift table of the plan.
+    if (pattern.plan && pattern.size)
     {
-        if (MatchMaskedPattern(i, byteMask, checkMask))
+        const auto& skip = pattern.plan->skip;
+        for (const uint8_t* cur = begin;; cur += skip[cur[pattern.size - 1]])
         {
-            if (!instance--)
-                return i;
+            if (VerifyCandidate(cur, pattern))
+                return cur;
+            if ((size_t)(last - cur) < skip[cur[pattern.size - 1]])
+                return nullptr;
         }
     }
-    return 0;
+
+    for (const uint8_t* cur = begin; cur <= last; cur++)
+    {
+        if (VerifyCandidate(cur, pattern))
+            return cur;
+    }
+    return nullptr;
 }
 
-uintptr_t hl::FindPattern(const std::string& pattern, const std::string& moduleName, int instance)
+// Verifies all candidates that are marked in the bit mask of anchor matches.
+static const uint8_t* VerifyCandidates(const uint8_t* cur, uint64_t candidates, const PatternView& pattern)
 {
-    uintptr_t result = 0;
-    for (const auto& region : hl::GetCodeRegions(moduleName))
+    while (candidates)
     {
-        result = hl::FindPattern(pattern, region.base, region.size, instance);
-        if (result)
-            break;
+        const uint8_t* candidate = cur + std::countr_zero(candidates);
+        if (VerifyCandidate(candidate, pattern))
+            return candidate;
+        candidates &= candidates - 1;
     }
-    return result;
+    return nullptr;
 }
 
-uintptr_t hl::FindPattern(const std::string& pattern, uintptr_t address, size_t len, int instance)
+
+#ifdef HL_SIMD_X86
+
+// The kernels test a block of W consecutive candidates at once by comparing the two anchor bytes of the plan under
+// their masks. A block is only processed when all of its candidates can hold a complete match, so the wide loads at
+// the anchors never read past the end. The rest is handled by the next narrower kernel.
+
+HL_TARGET("sse2")
+static const uint8_t* SearchSSE2(const uint8_t* begin, const uint8_t* end, const PatternView& pattern)
 {
-    std::vector<char> byteMask;
-    std::vector<char> checkMask;
+    constexpr size_t W = 16;
+    if (!pattern.plan || !pattern.plan->hasAnchor || (size_t)(end - begin) < pattern.size)
+        return SearchScalar(begin, end, pattern);
+    const size_t anchor1 = pattern.plan->anchor1;
+    const size_t anchor2 = pattern.plan->anchor2;
 
-    std::string lowPattern = pattern;
-    std::ranges::transform(lowPattern, lowPattern.begin(), ::tolower);
-    lowPattern += " ";
+    const size_t numCandidates = (size_t)(end - begin) - pattern.size + 1;
+    const __m128i first = _mm_set1_epi8((char)pattern.bytes[anchor1]);
+    const __m128i second = _mm_set1_epi8((char)pattern.bytes[anchor2]);
+    const __m128i firstMask = _mm_set1_epi8((char)pattern.mask[anchor1]);
+    const __m128i secondMask = _mm_set1_epi8((char)pattern.mask[anchor2]);
 
-    for (size_t i = 0; i < lowPattern.size() / 3; i++)
+    size_t offset = 0;
+    for (; offset + W <= numCandidates; offset += W)
     {
-        if (lowPattern[3 * i + 2] == ' ' && lowPattern[3 * i] == '?' && lowPattern[3 * i + 1] == '?')
+        const uint8_t* cur = begin + offset;
+        const __m128i block1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(cur + anchor1)), firstMask);
+        const __m128i block2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(cur + anchor2)), secondMask);
+        const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(block1, first), _mm_cmpeq_epi8(block2, second));
+        const auto candidates = (uint32_t)_mm_movemask_epi8(eq);
+        if (candidates)
         {
-            byteMask.push_back(0);
-            checkMask.push_back('?');
+            if (const uint8_t* found = VerifyCandidates(cur, candidates, pattern))
+                return found;
         }
-        else if (lowPattern[3 * i + 2] == ' ' &&
-                 ((lowPattern[3 * i] >= '0' && lowPattern[3 * i] <= '9') ||
-                  (lowPattern[3 * i] >= 'a' && lowPattern[3 * i] <= 'f')) &&
-                 ((lowPattern[3 * i + 1] >= '0' && lowPattern[3 * i + 1] <= '9') ||
-                  (lowPattern[3 * i + 1] >= 'a' && lowPattern[3 * i + 1] <= 'f')))
+    }
+
+    return SearchScalar(begin + offset, end, pattern);
+}
 
+HL_TARGET("avx2")
+static const uint8_t* SearchAVX2(const uint8_t* begin, const uint8_t* end, const PatternView& pattern)
+{
+    constexpr size_t W = 32;
+    if (!pattern.plan || !pattern.plan->hasAnchor || (size_t)(end - begin) < pattern.size)
+        return SearchScalar(begin, end, pattern);
+    const size_t anchor1 = pattern.plan->anchor1;
+    const size_t anchor2 = pattern.plan->anchor2;
+
+    const size_t numCandidates = (size_t)(end - begin) - pattern.size + 1;
+    const __m256i first = _mm256_set1_epi8((char)pattern.bytes[anchor1]);
+    const __m256i second = _mm256_set1_epi8((char)pattern.bytes[anchor2]);
+    const __m256i firstMask = _mm256_set1_epi8((char)pattern.mask[anchor1]);
+    const __m256i secondMask = _mm256_set1_epi8((char)pattern.mask[anchor2]);
+
+    size_t offset = 0;
+    for (; offset + W <= numCandidates; offset += W)
+    {
+        const uint8_t* cur = begin + offset;
+        const __m256i block1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(cur + anchor1)), firstMask);
+        const __m256i block2 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(cur + anchor2)), secondMask);
+        const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(block1, first), _mm256_cmpeq_epi8(block2, second));
+        const auto candidates = (uint32_t)_mm256_movemask_epi8(eq);
+        if (candidates)
         {
-            auto value = strtol(lowPattern.data() + 3 * i, nullptr, 16);
-            byteMask.push_back((char)value);
-            checkMask.push_back('x');
+            if (const uint8_t* found = VerifyCandidates(cur, candidates, pattern))
+                return found;
         }
-        else
+    }
+
+    return SearchSSE2(begin + offset, end, pattern);
+}
+
+HL_TARGET("avx512f,avx512bw")
+static const uint8_t* SearchAVX512(const uint8_t* begin, const uint8_t* end, const PatternView& pattern)
+{
+    constexpr size_t W = 64;
+    if (!pattern.plan || !pattern.plan->hasAnchor || (size_t)(end - begin) < pattern.size)
+        return SearchScalar(begin, end, pattern);
+    const size_t anchor1 = pattern.plan->anchor1;
+    const size_t anchor2 = pattern.plan->anchor2;
+
+    const size_t numCandidates = (size_t)(end - begin) - pattern.size + 1;
+    const __m512i first = _mm512_set1_epi8((char)pattern.bytes[anchor1]);
+    const __m512i second = _mm512_set1_epi8((char)pattern.bytes[anchor2]);
+    const __m512i firstMask = _mm512_set1_epi8((char)pattern.mask[anchor1]);
+    const __m512i secondMask = _mm512_set1_epi8((char)pattern.mask[anchor2]);
+
+    size_t offset = 0;
+    for (; offset + W <= numCandidates; offset += W)
+    {
+        const uint8_t* cur = begin + offset;
+        const __m512i block1 = _mm512_and_si512(_mm512_loadu_si512((const void*)(cur + anchor1)), firstMask);
+        const __m512i block2 = _mm512_and_si512(_mm512_loadu_si512((const void*)(cur + anchor2)), secondMask);
+        const uint64_t candidates =
+            _mm512_cmpeq_epi8_mask(block1, first) & _mm512_cmpeq_epi8_mask(block2, second);
+        if (candidates)
         {
-            throw std::runtime_error("invalid format of pattern string");
+            if (const uint8_t* found = VerifyCandidates(cur, candidates, pattern))
+                return found;
         }
     }
 
-    // Terminate mask string, because it is used to determine length.
-    checkMask.push_back('\0');
+    return SearchAVX2(begin + offset, end, pattern);
+}
+
 
-    return hl::FindPatternMask(byteMask.data(), checkMask.data(), address, len, instance);
+static void CpuId(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
 }
 
+static uint64_t XGetBv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo = 0, hi = 0;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
 
-uintptr_t hl::FollowRelativeAddress(uintptr_t adr, int trail)
+static SimdLevel DetectSimdLevel()
 {
-    // Hardcoded 32-bit dereference to make it work with 64-bit code.
-    return *(int32_t*)adr + adr + 4 + trail;
+    uint32_t regs[4] = {};
+    CpuId(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    if (!(regs[3] & (1u << 26)))
+        return SimdLevel::Scalar;
+
+    // The operating system must save the extended register state for AVX to be usable.
+    const bool osxsave = regs[2] & (1u << 27);
+    const uint64_t xcr0 = osxsave ? XGetBv() : 0;
+    if (maxLeaf < 7 || (xcr0 & 0x6) != 0x6)
+        return SimdLevel::SSE2;
+
+    CpuId(7, 0, regs);
+    const bool avx2 = regs[1] & (1u << 5);
+    const bool avx512f = regs[1] & (1u << 16);
+    const bool avx512bw = regs[1] & (1u << 30);
+    if (avx512f && avx512bw && (xcr0 & 0xe6) == 0xe6)
+        return SimdLevel::AVX512;
+    if (avx2)
+        return SimdLevel::AVX2;
+    return SimdLevel::SSE2;
 }
 
+#else
 
-const std::vector<hl::MemoryRegion>& hl::GetCodeRegions(const std::string& moduleName)
+static SimdLevel DetectSimdLevel()
 {
-    static std::unordered_map<std::string, std::vector<hl::MemoryRegion>> lut;
+    return SimdLevel::Scalar;
+}
+
+#endif
+
 
-    auto it = lut.find(moduleName);
-    if (it != lut.end())
+static std::atomic<SimdLevel> g_maxSimdLevel = SimdLevel::AVX512;
+
+static SearchFunc GetSearchFunc()
+{
+    switch (std::min(hl::GetSupportedSimdLevel(), g_maxSimdLevel.load(std::memory_order_relaxed)))
     {
-        return it->second;
+#ifdef HL_SIMD_X86
+    case SimdLevel::AVX512:
+        return SearchAVX512;
+    case SimdLevel::AVX2:
+        return SearchAVX2;
+    case SimdLevel::SSE2:
+        return SearchSSE2;
+#endif
+    default:
+        return SearchScalar;
     }
+}
+
+
+// Returns the first match whose bytes before the first gap lie within [begin, headEnd) and that lies completely
+// within [begin, end) or nullptr.
+static const uint8_t* SearchPattern(SearchFunc search, const uint8_t* begin, const uint8_t* headEnd, const uint8_t* end,
+                                    const PatternView& pattern)
+{
+    if (!pattern.numGaps)
+        return search(begin, headEnd, pattern);
 
-    auto hModule = hl::GetModuleByName(moduleName);
-    if (!hModule)
+    PatternView head = pattern;
+    head.size = pattern.headSize();
+    head.gaps = nullptr;
+    head.numGaps = 0;
+    for (const uint8_t* cur = begin; (cur = search(cur, headEnd, head)); cur++)
     {
-        throw std::runtime_error("no such module");
+        if (hl::MatchPattern(cur, end, pattern))
+            return cur;
     }
+    return nullptr;
+}
+
 
-    const static auto memoryMap = hl::GetMemoryMap();
-    std::ranges::copy_if(memoryMap, std::back_inserter(lut[moduleName]), [hModule](const hl::MemoryRegion& r)
-                         { return r.hModule == hModule && r.protection == hl::PROTECTION_READ_EXECUTE; });
-    if (lut[moduleName].empty())
+hl::SimdLevel hl::GetSupportedSimdLevel()
+{
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+void hl::SetMaxSimdLevel(SimdLevel level)
+{
+    g_maxSimdLevel = level;
+}
+
+
+uintptr_t hl::FindPatternMask(const char* byteMask, const char* checkMask, const std::string& moduleName, int instance)
+{
+    uintptr_t result = 0;
+    for (const auto& region : hl::GetModuleRegistry().findCodeRegions(moduleName).regions)
     {
-        throw std::runtime_error("no code sections found");
+        result = hl::FindPatternMask(byteMask, checkMask, region.base, region.size);
+        if (result)
+            break;
     }
+    return result;
+}
+
+uintptr_t hl::FindPattern(const PatternView& pattern, const std::string& moduleName, int instance)
+{
+    // Keeps the snapshot alive that the regions refer into.
+    const auto [snapshot, codeRegions] = hl::GetModuleRegistry().findCodeRegions(moduleName);
+    return CachedScan(
+        codeRegions.front().hModule, HashPatternQuery(pattern, instance),
+        [&](uintptr_t adr)
+        {
+            return IsPatternMatch(codeRegions, codeRegions.front().hModule, adr, pattern);
+        },
+        [&]
+        {
+            uintptr_t result = 0;
+            for (const auto& region : codeRegions)
+            {
+                result = hl::FindPattern(pattern, region.base, region.size, instance);
+                if (result)
+                    break;
+            }
+            return result;
+        });
+}
+
+// Implementation of hl::FindPatternAsync that runs on the async pool.
+static uintptr_t FindPatternChunked(const PatternView& pattern, const std::string& moduleName, int instance,
+                                    const AsyncScanOptions& options)
+{
+    const auto [snapshot, codeRegions] = hl::GetModuleRegistry().findCodeRegions(moduleName);
+    const auto hModule = codeRegions.front().hModule;
+    return CachedScan(
+        hModule, HashPatternQuery(pattern, instance),
+        [&](uintptr_t adr) { return IsPatternMatch(codeRegions, hModule, adr, pattern); },
+        [&]
+        {
+            size_t total = 0;
+            for (const auto& region : codeRegions)
+                total += region.size;
+
+            // Each chunk only counts the matches that start within itself. Like hl::FindPattern, the instance is
+            // counted within each region and the first region that contains it wins.
+            const size_t overlap = pattern.maxLength() ? pattern.maxLength() - 1 : 0;
+            size_t done = 0;
+            for (const auto& region : codeRegions)
+            {
+                int remaining = instance;
+                for (size_t offset = 0; offset < region.size; offset += ScanChunkSize)
+                {
+                    ReportProgress(&options, done, total);
+                    const size_t len = std::min(ScanChunkSize, region.size - offset);
+                    const uintptr_t chunkEnd = region.base + offset + len;
+                    const size_t matchLen = std::min(region.size - offset, len + overlap);
+                    for (uintptr_t match : hl::FindAllPatterns(pattern, region.base + offset, matchLen))
+                    {
+                        if (match >= chunkEnd)
+                            break;
+                        if (!remaining--)
+                        {
+                            ReportProgress(&options, total, total);
+                            return match;
+                        }
+                    }
+                    done += len;
+                }
+            }
+            ReportProgress(&options, total, total);
+            return (uintptr_t)0;
+        });
+}
 
-    return lut[moduleName];
+std::future<uintptr_t> hl::FindPatternAsync(const std::string& pattern, const std::string& moduleName, int instance,
+                                            AsyncScanOptions options)
+{
+    auto compiled = std::make_shared<const CompiledPattern>(pattern);
+    return RunAsync([compiled, moduleName, instance, options = std::move(options)]
+                    { return FindPatternChunked(*compiled, moduleName, instance, options); });
+}
+
+std::future<uintptr_t> hl::FindPatternAsync(const PatternView& pattern, const std::string& moduleName, int instance,
+                                            AsyncScanOptions options)
+{
+    return RunAsync([pattern, moduleName, instance, options = std::move(options)]
+                    { return FindPatternChunked(pattern, moduleName, instance, options); });
+}
+
+uintptr_t hl::FindPattern(const PatternView& pattern, uintptr_t address, size_t len, int instance)
+{
+    // An empty pattern matches everywhere.
+    if (!pattern.size)
+        return (size_t)instance <= len ? address + instance : 0;
+
+    const SearchFunc search = GetSearchFunc();
+
+    auto begin = (const uint8_t*)address;
+    const uint8_t* end = begin + len;
+    // Chunks overlap by the longest match minus one to find matches that start before the chunk end.
+    const size_t headSize = pattern.headSize();
+    const size_t maxLength = pattern.maxLength();
+    return (uintptr_t)FindInstance(
+        begin, end, instance,
+        [&](const uint8_t* from, const uint8_t* to)
+        {
+            const uint8_t* headEnd = from + std::min((size_t)(end - from), (size_t)(to - from) + headSize - 1);
+            const uint8_t* matchEnd = from + std::min((size_t)(end - from), (size_t)(to - from) + maxLength - 1);
+            return SearchPattern(search, from, headEnd, matchEnd, pattern);
+        });
+}
+
+void PatternMatches::findNext(size_t rangeIndex, uintptr_t from, Iterator& it) const
+{
+    const SearchFunc search = GetSearchFunc();
+
+    for (; rangeIndex < m_ranges.size(); rangeIndex++)
+    {
+        const auto [address, len] = m_ranges[rangeIndex];
+        if (rangeIndex != it.m_rangeIndex || from < address)
+            from = address;
+
+        // An empty pattern also matches at the end.
+        if (from <= address + len)
+        {
+            const auto* end = (const uint8_t*)(address + len);
+            if (const uint8_t* found = SearchPattern(search, (const uint8_t*)from, end, end, m_pattern))
+            {
+                it.m_rangeIndex = rangeIndex;
+                it.m_match = (uintptr_t)found;
+                return;
+            }
+        }
+    }
+
+    it.m_rangeIndex = m_ranges.size();
+    it.m_match = 0;
+}
+
+static std::vector<std::pair<uintptr_t, size_t>> GetCodeRanges(const std::string& moduleName)
+{
+    std::vector<std::pair<uintptr_t, size_t>> ranges;
+    for (const auto& region : hl::GetModuleRegistry().findCodeRegions(moduleName).regions)
+        ranges.emplace_back(region.base, region.size);
+    return ranges;
+}
+
+PatternMatches hl::FindAllPatterns(const std::string& pattern, const std::string& moduleName)
+{
+    auto compiled = std::make_shared<const CompiledPattern>(pattern);
+    return { *compiled, GetCodeRanges(moduleName), compiled };
+}
+
+PatternMatches hl::FindAllPatterns(const std::string& pattern, uintptr_t address, size_t len)
+{
+    auto compiled = std::make_shared<const CompiledPattern>(pattern);
+    return { *compiled, { { address, len } }, compiled };
+}
+
+PatternMatches hl::FindAllPatterns(const PatternView& pattern, const std::string& moduleName)
+{
+    return { pattern, GetCodeRanges(moduleName) };
+}
+
+PatternMatches hl::FindAllPatterns(const PatternView& pattern, uintptr_t address, size_t len)
+{
+    return { pattern, { { address, len } } };
+}
+
+
+uintptr_t hl::FindPatternMask(const PatternView& pattern, const std::string& moduleName, int instance)
+{
+    return hl::FindPattern(pattern, moduleName, instance);
+}
+
+uintptr_t hl::FindPatternMask(const PatternView& pattern, uintptr_t address, size_t len, int instance)
+{
+    return hl::FindPattern(pattern, address, len, instance);
+}
+
+uintptr_t hl::FindPatternMask(const char* byteMask, const char* checkMask, uintptr_t address, size_t len, int instance)
+{
+    return hl::FindPattern(CompiledPattern(byteMask, checkMask), address, len, instance);
+}
+
+uintptr_t hl::FindPattern(const std::string& pattern, const std::string& moduleName, int instance)
+{
+    return hl::FindPattern(CompiledPattern(pattern), moduleName, instance);
+}
+
+uintptr_t hl::FindPattern(const std::string& pattern, uintptr_t address, size_t len, int instance)
+{
+    return hl::FindPattern(CompiledPattern(pattern), address, len, instance);
+}
+
+
+// Aho-Corasick automaton over one fixed run of bytes of each pattern. The automaton reports candidates for
+// all patterns in a single pass, which are then verified against the complete masked pattern.
+class MultiPatternMatcher
+{
+    // Longer keys do not filter notably better, but increase the size of the transition table.
+    static constexpr size_t MaxKeyLen = 8;
+
+    struct Key
+    {
+        size_t offset = 0;
+        size_t len = 0;
+    };
+
+public:
+    explicit MultiPatternMatcher(std::vector<CompiledPattern> patterns) : m_patterns(std::move(patterns))
+    {
+        std::vector<std::vector<uint32_t>> outputs(1);
+        m_transitions.assign(256, 0);
+
+        // Build a trie of the keys.
+        for (uint32_t i = 0; i < (uint32_t)m_patterns.size(); i++)
+        {
+            const auto& pattern = m_patterns[i];
+            const Key key = selectKey(pattern);
+            m_keys.push_back(key);
+            if (!key.len)
+            {
+                m_keylessPatterns.push_back(i);
+                continue;
+            }
+
+            uint32_t state = 0;
+            for (size_t j = key.offset; j < key.offset + key.len; j++)
+            {
+                const size_t edge = (size_t)state * 256 + pattern.bytes()[j];
+                if (!m_transitions[edge])
+                {
+                    m_transitions[edge] = (uint32_t)outputs.size();
+                    outputs.emplace_back();
+                    m_transitions.resize(m_transitions.size() + 256, 0);
+                }
+                state = m_transitions[edge];
+            }
+            outputs[state].push_back(i);
+        }
+
+        // Turn the trie into a DFA by resolving failure links breadth first. Outputs of the longest proper
+        // suffix state are inherited, so that each state directly lists every key that ends there.
+        const size_t numStates = outputs.size();
+        std::vector<uint32_t> failure(numStates, 0);
+        std::vector<uint32_t> queue;
+        std::vector<bool> isTrieEdge(m_transitions.size(), false);
+        for (size_t t = 0; t < m_transitions.size(); t++)
+            isTrieEdge[t] = m_transitions[t] != 0;
+
+        for (size_t c = 0; c < 256; c++)
+        {
+            if (m_transitions[c])
+                queue.push_back(m_transitions[c]);
+        }
+        for (size_t q = 0; q < queue.size(); q++)
+        {
+            const uint32_t state = queue[q];
+            const uint32_t fail = failure[state];
+            outputs[state].insert(outputs[state].end(), outputs[fail].begin(), outputs[fail].end());
+
+            for (size_t c = 0; c < 256; c++)
+            {
+                auto& next = m_transitions[(size_t)state * 256 + c];
+                if (isTrieEdge[(size_t)state * 256 + c])
+                {
+                    failure[next] = m_transitions[(size_t)fail * 256 + c];
+                    queue.push_back(next);
+                }
+                else
+                {
+                    next = m_transitions[(size_t)fail * 256 + c];
+                }
+            }
+        }
+
+        // Flatten the outputs for cache friendly access during the scan.
+        m_outputBegin.reserve(numStates + 1);
+        for (const auto& out : outputs)
+        {
+            m_outputBegin.push_back((uint32_t)m_outputs.size());
+            m_outputs.insert(m_outputs.end(), out.begin(), out.end());
+        }
+        m_outputBegin.push_back((uint32_t)m_outputs.size());
+    }
+
+    [[nodiscard]] size_t size() const { return m_patterns.size(); }
+    [[nodiscard]] const CompiledPattern& pattern(size_t i) const { return m_patterns[i]; }
+
+    // Scans the memory in [begin, end) and records the first match of every pattern that has no result yet.
+    // Returns the number of patterns that were newly found.
+    size_t scan(const uint8_t* begin, const uint8_t* end, std::vector<uintptr_t>& results) const
+    {
+        const auto len = (size_t)(end - begin);
+        size_t numFound = 0;
+
+        // Patterns without a run of fixed bytes are searched for individually.
+        if (!m_keylessPatterns.empty())
+        {
+            const SearchFunc search = GetSearchFunc();
+            for (auto i : m_keylessPatterns)
+            {
+                if (results[i])
+                    continue;
+                if (const uint8_t* found = SearchPattern(search, begin, end, end, m_patterns[i]))
+                {
+                    results[i] = (uintptr_t)found;
+                    numFound++;
+                }
+            }
+        }
+
+        uint32_t state = 0;
+        for (size_t pos = 0; pos < len; pos++)
+        {
+            state = m_transitions[(size_t)state * 256 + begin[pos]];
+            const uint32_t outBegin = m_outputBegin[state];
+            const uint32_t outEnd = m_outputBegin[state + 1];
+            for (uint32_t o = outBegin; o < outEnd; o++)
+            {
+                const uint32_t i = m_outputs[o];
+                const Key& key = m_keys[i];
+                const CompiledPattern& pattern = m_patterns[i];
+                if (results[i] || pos + 1 < key.offset + key.len)
+                    continue;
+
+                const size_t start = pos + 1 - key.len - key.offset;
+                if (hl::MatchPattern(begin + start, end, pattern))
+                {
+                    results[i] = (uintptr_t)(begin + start);
+                    numFound++;
+                }
+            }
+        }
+
+        return numFound;
+    }
+
+private:
+    // Uses the longest run of fixed bytes before the first gap.
+    static Key selectKey(const CompiledPattern& pattern)
+    {
+        const size_t headSize = pattern.gaps().empty() ? pattern.size() : pattern.gaps().front().offset;
+        Key best;
+        size_t runStart = 0;
+        for (size_t i = 0; i <= headSize; i++)
+        {
+            if (i == headSize || pattern.mask()[i] != 0xff)
+            {
+                if (i - runStart > best.len)
+                    best = { runStart, i - runStart };
+                runStart = i + 1;
+            }
+        }
+        best.len = std::min(best.len, MaxKeyLen);
+        return best;
+    }
+
+    std::vector<CompiledPattern> m_patterns;
+    std::vector<Key> m_keys;
+    std::vector<uint32_t> m_keylessPatterns;
+    // Dense DFA with 256 entries per state. State 0 is the root.
+    std::vector<uint32_t> m_transitions;
+    // The patterns whose key ends in a state are listed in m_outputs from index m_outputBegin[state] to
+    // m_outputBegin[state + 1].
+    std::vector<uint32_t> m_outputBegin;
+    std::vector<uint32_t> m_outputs;
+};
+
+
+std::vector<uintptr_t> PatternScanner::findPatterns(std::span<const std::string> patterns,
+                                                    const std::string& moduleName)
+{
+    std::vector<CompiledPattern> parsedPatterns;
+    parsedPatterns.reserve(patterns.size());
+    for (const auto& pattern : patterns)
+        parsedPatterns.emplace_back(pattern);
+    const MultiPatternMatcher matcher(std::move(parsedPatterns));
+
+    refresh();
+    auto hModule = getModule(moduleName);
+
+    std::vector<uintptr_t> results(patterns.size(), 0);
+    size_t numRemaining = patterns.size();
+
+    // Take valid results from the scan cache. The matcher skips patterns that already have a result.
+    auto cache = GetScanCache();
+    const uint64_t moduleId = cache ? cache->getModuleId(hModule) : 0;
+    if (cache)
+    {
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            const CompiledPattern& pattern = matcher.pattern(i);
+            auto rva = cache->lookup(moduleId, HashPatternQuery(pattern, 0));
+            const uintptr_t adr = rva ? (uintptr_t)hModule + *rva : 0;
+            if (adr && IsPatternMatch(snapshot->memoryMap(), hModule, adr, pattern))
+            {
+                results[i] = adr;
+                numRemaining--;
+            }
+        }
+    }
+    const auto cachedResults = results;
+
+    for (const auto& region : snapshot->memoryMap())
+    {
+        if (numRemaining == 0)
+            break;
+
+        if (region.hModule == hModule && region.protection == hl::PROTECTION_READ_EXECUTE)
+        {
+            numRemaining -= matcher.scan((const uint8_t*)region.base, (const uint8_t*)(region.base + region.size),
+                                         results);
+        }
+    }
+
+    if (cache)
+    {
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            if (results[i] && !cachedResults[i])
+                cache->store(moduleId, HashPatternQuery(matcher.pattern(i), 0), results[i] - (uintptr_t)hModule);
+        }
+    }
+
+    return results;
+}
+
+
+std::vector<uintptr_t> PatternScanner::find(const std::vector<std::string>& strings, const std::string& moduleName)
+{
+    return findStrings(strings, moduleName, nullptr);
+}
+
+std::future<std::vector<uintptr_t>> PatternScanner::findAsync(const std::vector<std::string>& strings,
+                                                              const std::string& moduleName, AsyncScanOptions options)
+{
+    return RunAsync([this, strings, moduleName, options = std::move(options)]
+                    { return findStrings(strings, moduleName, &options); });
+}
+
+std::vector<uintptr_t> PatternScanner::findStrings(const std::vector<std::string>& strings,
+                                                   const std::string& moduleName, const AsyncScanOptions* options)
+{
+    refresh();
+    auto cache = GetScanCache();
+    if (!cache)
+        return findReferences(strings, moduleName, options);
+
+    auto hModule = getModule(moduleName);
+    const uint64_t moduleId = cache->getModuleId(hModule);
+
+    std::vector<uintptr_t> results(strings.size(), 0);
+    std::vector<std::string> missing;
+    std::vector<size_t> missingIndices;
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        auto rva = cache->lookup(moduleId, HashStringQuery(strings[i], 0));
+        if (rva && IsStringReference(snapshot->memoryMap(), hModule, (uintptr_t)hModule + *rva, strings[i]))
+        {
+            results[i] = (uintptr_t)hModule + *rva;
+        }
+        else
+        {
+            missing.push_back(strings[i]);
+            missingIndices.push_back(i);
+        }
+    }
+
+    if (!missing.empty())
+    {
+        const auto found = findReferences(missing, moduleName, options);
+        for (size_t i = 0; i < missing.size(); i++)
+        {
+            results[missingIndices[i]] = found[i];
+            if (found[i])
+                cache->store(moduleId, HashStringQuery(missing[i], 0), found[i] - (uintptr_t)hModule);
+        }
+    }
+    else
+    {
+        // Nothing was scanned.
+        ReportProgress(options, 0, 0);
+    }
+
+    return results;
+}
+
+std::vector<uintptr_t> PatternScanner::findReferences(const std::vector<std::string>& strings,
+                                                     const std::string& moduleName, const AsyncScanOptions* options)
+{
+    auto hModule = getModule(moduleName);
+
+    // First pass: Find all strings including their terminator in the readonly sections.
+    std::vector<CompiledPattern> stringPatterns;
+    stringPatterns.reserve(strings.size());
+    for (const auto& str : strings)
+        stringPatterns.emplace_back(str.c_str(), std::string(str.size() + 1, 'x').c_str());
+    const MultiPatternMatcher matcher(std::move(stringPatterns));
+
+    // The progress of asynchronous scans is reported per region of both passes.
+    size_t progressDone = 0;
+    size_t progressTotal = 0;
+    for (const auto& region : snapshot->memoryMap())
+    {
+        if (region.hModule == hModule &&
+            (region.protection == hl::PROTECTION_READ || region.protection == hl::PROTECTION_READ_EXECUTE))
+            progressTotal += region.size;
+    }
+
+    std::vector<uintptr_t> stringAddrs(strings.size(), 0);
+    size_t numRemaining = strings.size();
+    for (const auto& region : snapshot->memoryMap())
+    {
+        if (numRemaining == 0)
+            break;
+
+        if (region.hModule == hModule && region.protection == hl::PROTECTION_READ)
+        {
+            ReportProgress(options, progressDone, progressTotal);
+            progressDone += region.size;
+            numRemaining -= matcher.scan((const uint8_t*)region.base, (const uint8_t*)(region.base + region.size),
+                                         stringAddrs);
+        }
+    }
+
+    if (numRemaining)
+        throw std::runtime_error("one or more patterns not found");
+
+    // Second pass: Decode the candidate references in the code once and look up their targets.
+    std::unordered_map<uintptr_t, size_t> targetIndices;
+    for (auto adr : stringAddrs)
+        targetIndices.emplace(adr, targetIndices.size());
+    const auto [minTarget, maxTarget] = std::ranges::minmax(stringAddrs);
+
+#ifndef ARCH_64BIT
+    const ExeFile* relocs = getRelocs(moduleName);
+#endif
+
+    // Stores the first reference within [from, to) of each target that has none yet. Returns the number of targets
+    // that were newly found.
+    auto scanChunk = [&](const uint8_t* from, const uint8_t* to, const uint8_t* end, std::vector<uintptr_t>& refs)
+    {
+        size_t numMissing = std::ranges::count(refs, 0);
+        const size_t numMissingBefore = numMissing;
+
+        for (const uint8_t* adr = from; adr < to && adr + 4 <= end; adr++)
+        {
+#ifndef ARCH_64BIT
+            const auto target = *(const uintptr_t*)adr;
+#else
+            // Prevent false positives by checking if the reference occurs in a LEA instruction.
+            const uint16_t opcode = *(const uint16_t*)(adr - 3);
+            if ((opcode != 0x8D48 && opcode != 0x8D4C) || (adr[-1] & 0xc7) != 0x05)
+                continue;
+            const uintptr_t target = FollowRelativeAddress((uintptr_t)adr);
+#endif
+            if (target < minTarget || target > maxTarget)
+                continue;
+            auto it = targetIndices.find(target);
+            if (it == targetIndices.end() || refs[it->second])
+                continue;
+#ifndef ARCH_64BIT
+            // Prevent false positives by checking if the reference is relocated.
+            if (relocs && !relocs->isReloc((uintptr_t)adr - (uintptr_t)hModule))
+                continue;
+#endif
+
+            refs[it->second] = (uintptr_t)adr;
+            if (--numMissing == 0)
+                break;
+        }
+
+        return numMissingBefore - numMissing;
+    };
+
+    std::vector<uintptr_t> refs(targetIndices.size(), 0);
+    numRemaining = refs.size();
+    for (const auto& region : snapshot->memoryMap())
+    {
+        if (numRemaining == 0)
+            break;
+        if (region.hModule != hModule || region.protection != hl::PROTECTION_READ_EXECUTE)
+            continue;
+
+        ReportProgress(options, progressDone, progressTotal);
+        progressDone += region.size;
+
+        const auto begin = (const uint8_t*)region.base;
+        const uint8_t* end = begin + region.size;
+#ifdef ARCH_64BIT
+        // Stay within the region for the opcode.
+        const uint8_t* first = begin + std::min<size_t>(3, region.size);
+#else
+        const uint8_t* first = begin;
+#endif
+
+        auto pool = region.size > ScanChunkSize ? GetScanPool() : nullptr;
+        if (!pool)
+        {
+            numRemaining -= scanChunk(first, end, end, refs);
+            continue;
+        }
+
+        // Each chunk records its own first references. The lowest address wins when merging.
+        const size_t numChunks = (region.size + ScanChunkSize - 1) / ScanChunkSize;
+        std::vector<std::vector<uintptr_t>> chunkRefs(numChunks, std::vector<uintptr_t>(refs.size(), 0));
+        pool->parallelFor(numChunks,
+                          [&](size_t i)
+                          {
+                              const uint8_t* from = std::max(first, begin + i * ScanChunkSize);
+                              const uint8_t* to = begin + std::min(region.size, (i + 1) * ScanChunkSize);
+                              scanChunk(from, to, end, chunkRefs[i]);
+                          });
+        for (size_t t = 0; t < refs.size(); t++)
+        {
+            for (size_t i = 0; i < numChunks && !refs[t]; i++)
+            {
+                if (chunkRefs[i][t])
+                {
+                    refs[t] = chunkRefs[i][t];
+                    numRemaining--;
+                }
+            }
+        }
+    }
+
+    ReportProgress(options, progressTotal, progressTotal);
+
+    std::vector<uintptr_t> results(strings.size());
+    for (size_t i = 0; i < strings.size(); i++)
+        results[i] = refs[targetIndices[stringAddrs[i]]];
+    return results;
+}
+
+
+// Returns the sections of the type in ascending order of their RVA.
+static std::vector<const hl::ExeFile::Section*> GetSections(const hl::ExeFile& file, hl::ExeFile::SectionType type)
+{
+    std::vector<const hl::ExeFile::Section*> sections;
+    for (const auto& section : file.getSections())
+    {
+        if (section.type == type && !section.data.empty())
+            sections.push_back(&section);
+    }
+    std::ranges::sort(sections, {}, &hl::ExeFile::Section::rva);
+    return sections;
+}
+
+uintptr_t hl::FindPattern(const PatternView& pattern, const hl::ExeFile& file, int instance)
+{
+    for (const auto* section : GetSections(file, ExeFile::SectionType::Code))
+    {
+        const auto data = (uintptr_t)section->data.data();
+        for (uintptr_t match : FindAllPatterns(pattern, data, section->data.size()))
+        {
+            if (!instance--)
+                return section->rva + (match - data);
+        }
+    }
+    return 0;
+}
+
+uintptr_t hl::FindPattern(const std::string& pattern, const hl::ExeFile& file, int instance)
+{
+    return hl::FindPattern(CompiledPattern(pattern), file, instance);
+}
+
+std::vector<uintptr_t> hl::FindAllPatterns(const PatternView& pattern, const hl::ExeFile& file)
+{
+    std::vector<uintptr_t> results;
+    for (const auto* section : GetSections(file, ExeFile::SectionType::Code))
+    {
+        const auto data = (uintptr_t)section->data.data();
+        for (uintptr_t match : FindAllPatterns(pattern, data, section->data.size()))
+            results.push_back(section->rva + (match - data));
+    }
+    return results;
+}
+
+std::vector<uintptr_t> hl::FindAllPatterns(const std::string& pattern, const hl::ExeFile& file)
+{
+    return hl::FindAllPatterns(CompiledPattern(pattern), file);
+}
+
+// Records the first match of each pattern in the sections as RVA.
+static void ScanSections(const MultiPatternMatcher& matcher, std::span<const hl::ExeFile::Section* const> sections,
+                         std::vector<uintptr_t>& results)
+{
+    size_t numRemaining = std::ranges::count(results, 0);
+    for (const auto* section : sections)
+    {
+        if (numRemaining == 0)
+            break;
+
+        // The matcher reports addresses within the mapped section, which are translated for the new results.
+        const auto previous = results;
+        const uint8_t* data = section->data.data();
+        numRemaining -= matcher.scan(data, data + section->data.size(), results);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (results[i] && !previous[i])
+                results[i] = section->rva + (results[i] - (uintptr_t)data);
+        }
+    }
+}
+
+std::vector<uintptr_t> hl::FindStringReferences(const std::vector<std::string>& strings, const hl::ExeFile& file)
+{
+    // First pass: Find all strings including their terminator in the readonly sections.
+    std::vector<CompiledPattern> stringPatterns;
+    stringPatterns.reserve(strings.size());
+    for (const auto& str : strings)
+        stringPatterns.emplace_back(str.c_str(), std::string(str.size() + 1, 'x').c_str());
+    const MultiPatternMatcher matcher(std::move(stringPatterns));
+
+    std::vector<uintptr_t> stringRvas(strings.size(), 0);
+    ScanSections(matcher, GetSections(file, ExeFile::SectionType::ReadOnlyData), stringRvas);
+
+    std::unordered_map<uintptr_t, uintptr_t> refs;
+    for (auto rva : stringRvas)
+    {
+        if (rva)
+            refs.emplace(rva, 0);
+    }
+    size_t numRemaining = refs.size();
+
+    // Second pass: Decode the candidate references like PatternScanner::find.
+#ifndef ARCH_64BIT
+    const bool verifyRelocs = file.hasRelocs();
+#endif
+    for (const auto* section : GetSections(file, ExeFile::SectionType::Code))
+    {
+        const uint8_t* data = section->data.data();
+        const size_t size = section->data.size();
+#ifdef ARCH_64BIT
+        const size_t first = 3;
+#else
+        const size_t first = 0;
+#endif
+        for (size_t offset = first; offset + 4 <= size && numRemaining; offset++)
+        {
+            int32_t value;
+            memcpy(&value, data + offset, sizeof(value));
+#ifdef ARCH_64BIT
+            // Prevent false positives by checking if the reference occurs in a LEA instruction.
+            if ((data[offset - 3] != 0x48 && data[offset - 3] != 0x4c) || data[offset - 2] != 0x8d ||
+                (data[offset - 1] & 0xc7) != 0x05)
+                continue;
+            const uintptr_t target = section->rva + offset + 4 + value;
+#else
+            const uintptr_t target = (uint32_t)value - file.getImageBase();
+#endif
+            auto it = refs.find(target);
+            if (it == refs.end() || it->second)
+                continue;
+#ifndef ARCH_64BIT
+            // Prevent false positives by checking if the reference is relocated.
+            if (verifyRelocs && !file.isReloc(section->rva + offset))
+                continue;
+#endif
+            it->second = section->rva + offset;
+            numRemaining--;
+        }
+    }
+
+    std::vector<uintptr_t> results(strings.size(), 0);
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        if (stringRvas[i])
+            results[i] = refs[stringRvas[i]];
+    }
+    return results;
+}
+
+std::vector<std::vector<uintptr_t>> hl::FindPatternsInFiles(std::span<const std::string> paths,
+                                                            std::span<const std::string> patterns,
+                                                            unsigned numThreads)
+{
+    std::vector<CompiledPattern> parsedPatterns;
+    parsedPatterns.reserve(patterns.size());
+    for (const auto& pattern : patterns)
+        parsedPatterns.emplace_back(pattern);
+    const MultiPatternMatcher matcher(std::move(parsedPatterns));
+
+    std::vector<std::vector<uintptr_t>> results(paths.size());
+    hl::ThreadPool pool(numThreads);
+    pool.parallelFor(paths.size(),
+                     [&](size_t i)
+                     {
+                         hl::ExeFile file;
+                         if (!file.loadFromFile(paths[i]))
+                             throw std::runtime_error("could not load executable file: " + paths[i]);
+                         results[i].assign(patterns.size(), 0);
+                         ScanSections(matcher, GetSections(file, ExeFile::SectionType::Code), results[i]);
+                     });
+    return results;
+}
+
+
+std::vector<uintptr_t> hl::ScanRegions(const std::function<bool(const hl::MemoryRegion&)>& predicate,
+                                       const PatternView& pattern)
+{
+    struct Chunk
+    {
+        uintptr_t begin;
+        uintptr_t end;
+        // The end of the readable and populated run of pages. Matches may extend up to it.
+        uintptr_t readableEnd;
+    };
+
+    // Split the regions into chunks, so that large regions are scanned in parallel.
+    std::vector<Chunk> chunks;
+    for (const auto& region : hl::GetMemoryMap())
+    {
+        if (!predicate(region))
+            continue;
+
+        const size_t size = hl::GetReadableSize(region);
+        auto addRun = [&](uintptr_t begin, uintptr_t end)
+        {
+            for (uintptr_t from = begin; from < end; from += ScanChunkSize)
+                chunks.push_back({ from, from + std::min(ScanChunkSize, end - from), end });
+        };
+
+        // Only anonymous memory has pages that are never populated. Other pages may still be read from a file.
+        const bool isAnonymous = region.name.empty() || region.name[0] == '[';
+        if (!size || !g_skipUnpopulatedPages || !isAnonymous)
+        {
+            addRun(region.base, region.base + size);
+            continue;
+        }
+
+        const auto populated = hl::GetPopulatedPages(region.base, size);
+        const uintptr_t pageSize = hl::GetPageSize();
+        const uintptr_t end = region.base + size;
+        for (size_t page = 0; page < populated.size();)
+        {
+            if (!populated[page])
+            {
+                page++;
+                continue;
+            }
+            const size_t first = page;
+            while (page < populated.size() && populated[page])
+                page++;
+            addRun(region.base + first * pageSize, std::min(end, region.base + page * pageSize));
+        }
+    }
+
+    // Each chunk only reports the matches that start within itself.
+    const size_t overlap = pattern.maxLength() ? pattern.maxLength() - 1 : 0;
+    std::vector<std::vector<uintptr_t>> chunkMatches(chunks.size());
+    auto scanChunk = [&](size_t i)
+    {
+        const Chunk& chunk = chunks[i];
+        const size_t len = std::min(chunk.readableEnd - chunk.begin, chunk.end - chunk.begin + overlap);
+        for (uintptr_t match : hl::FindAllPatterns(pattern, chunk.begin, len))
+        {
+            if (match >= chunk.end)
+                break;
+            chunkMatches[i].push_back(match);
+        }
+    };
+
+    if (auto pool = chunks.size() > 1 ? GetScanPool() : nullptr)
+    {
+        pool->parallelFor(chunks.size(), scanChunk);
+    }
+    else
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+            scanChunk(i);
+    }
+
+    std::vector<uintptr_t> results;
+    for (const auto& matches : chunkMatches)
+        results.insert(results.end(), matches.begin(), matches.end());
+    return results;
+}
+
+std::vector<uintptr_t> hl::ScanRegions(const std::function<bool(const hl::MemoryRegion&)>& predicate,
+                                       const std::string& pattern)
+{
+    return hl::ScanRegions(predicate, CompiledPattern(pattern));
+}
+
+
+std::string hl::GenerateSignature(uintptr_t adr, const std::string& moduleName)
+{
+    constexpr size_t MaxSignatureLen = 256;
+    // The first scan looks for a prefix with this many fixed bytes. Then the candidates are narrowed down.
+    constexpr size_t MinPrefixFixedBytes = 3;
+
+    const auto& codeRegions = hl::GetCodeRegions(moduleName);
+    auto regionIt = std::ranges::find_if(codeRegions, [adr](const hl::MemoryRegion& r)
+                                         { return adr >= r.base && adr - r.base < r.size; });
+    if (regionIt == codeRegions.end())
+        throw std::runtime_error("address is not in code of the module");
+    const uintptr_t regionEnd = regionIt->base + regionIt->size;
+    const size_t maxLen = std::min(MaxSignatureLen, (size_t)(regionEnd - adr));
+    const auto hModule = regionIt->hModule;
+
+    std::vector<uint8_t> mask(maxLen, 0xff);
+    auto setWildcards = [&](uintptr_t from, size_t n)
+    {
+        for (uintptr_t i = std::max(from, adr); i < from + n && i < adr + maxLen; i++)
+            mask[i - adr] = 0;
+    };
+
+    // Operands of references to the module change with its layout.
+    const auto [moduleBegin, moduleEnd] = hl::GetModuleRegistry().snapshot()->moduleExtent(hModule);
+    // Include instructions that start before adr.
+    const uintptr_t decodeBegin = adr - std::min<size_t>(adr - regionIt->base, MaxXrefInstructionLen - 1);
+    for (uintptr_t p = decodeBegin; p < adr + maxLen; p++)
+    {
+        const auto xref = DecodeXref(p, regionEnd - p);
+        if (xref && xref->target >= moduleBegin && xref->target < moduleEnd)
+            setWildcards(p + xref->operandOffset, 4);
+    }
+
+#ifdef _WIN32
+    // Relocated bytes change with the load address. Position independent ELF code does not contain relocations,
+    // and the section headers that list them are not mapped into memory.
+    hl::ExeFile exeFile;
+    if (exeFile.loadFromMem((uintptr_t)hModule) && exeFile.hasRelocs())
+    {
+        const uintptr_t relocBegin = adr - std::min<size_t>(adr - regionIt->base, sizeof(uintptr_t) - 1);
+        for (uintptr_t p = relocBegin; p < adr + maxLen; p++)
+        {
+            if (exeFile.isReloc(p - (uintptr_t)hModule))
+                setWildcards(p, sizeof(uintptr_t));
+        }
+    }
+#endif
+
+    std::string byteMask(maxLen, '\0');
+    std::string checkMask(maxLen, '?');
+    for (size_t i = 0; i < maxLen; i++)
+    {
+        if (mask[i])
+        {
+            byteMask[i] = *(const char*)(adr + i);
+            checkMask[i] = 'x';
+        }
+    }
+
+    size_t len = 0;
+    for (size_t numFixed = 0; len < maxLen && numFixed < MinPrefixFixedBytes; len++)
+        numFixed += mask[len] ? 1 : 0;
+
+    // Find all matches of the prefix with one scan.
+    struct Candidate
+    {
+        uintptr_t adr;
+        uintptr_t regionEnd;
+    };
+    std::vector<Candidate> candidates;
+    const CompiledPattern prefix(byteMask.c_str(), checkMask.substr(0, len).c_str());
+    for (const auto& region : codeRegions)
+    {
+        for (uintptr_t match : FindAllPatterns(prefix, region.base, region.size))
+            candidates.push_back({ match, region.base + region.size });
+    }
+
+    // Extend the signature byte by byte and drop the candidates that stop matching.
+    while (candidates.size() > 1 && len < maxLen)
+    {
+        const size_t i = len++;
+        std::erase_if(candidates,
+                      [&](const Candidate& c)
+                      {
+                          return len > c.regionEnd - c.adr ||
+                                 (mask[i] && *(const uint8_t*)(c.adr + i) != *(const uint8_t*)(adr + i));
+                      });
+    }
+    if (candidates.size() != 1)
+        throw std::runtime_error("no unique signature found");
+
+    std::string signature;
+    for (size_t i = 0; i < len; i++)
+    {
+        char byteStr[4];
+        if (mask[i])
+            snprintf(byteStr, sizeof(byteStr), "%02x", *(const uint8_t*)(adr + i));
+        else
+            snprintf(byteStr, sizeof(byteStr), "??");
+        signature += (i ? " " : "") + std::string(byteStr);
+    }
+    return signature;
+}
+
+
+uintptr_t hl::FollowRelativeAddress(uintptr_t adr, int trail)
+{
+    // Hardcoded 32-bit dereference to make it work with 64-bit code.
+    return *(int32_t*)adr + adr + 4 + trail;
+}
+
+
+const std::vector<hl::MemoryRegion>& hl::GetCodeRegions(const std::string& moduleName)
+{
+    return hl::GetModuleRegistry().getCodeRegions(moduleName);
 }
@@ -2,7 +2,9 @@
 #include <stdexcept>
 #include <cstring>
 #include <cstdio>
+#include <cerrno>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -74,3 +76,16 @@ hl::Process hl::LaunchProcess(const std::string& command, const std::vector<std:
 
     return Process(pid, 0);
 }
+
+uint32_t hl::GetCallingThreadId()
+{
+    return (uint32_t)syscall(SYS_gettid);
+}
+
+bool hl::IsThreadAlive(uint32_t threadId)
+{
+    const int savedErrno = errno;
+    const bool alive = syscall(SYS_tgkill, getpid(), (pid_t)threadId, 0) == 0 || errno != ESRCH;
+    errno = savedErrno;
+    return alive;
+}
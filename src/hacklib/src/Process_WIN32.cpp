@@ -52,3 +52,22 @@ hl::Process hl::LaunchProcess(const std::string& command, const std::vector<std:
 
     return Process(processInfo.dwProcessId, (uintptr_t)processInfo.hProcess);
 }
+
+uint32_t hl::GetCallingThreadId()
+{
+    return GetCurrentThreadId();
+}
+
+bool hl::IsThreadAlive(uint32_t threadId)
+{
+    const DWORD savedError = GetLastError();
+    bool alive = false;
+    if (HANDLE hThread = OpenThread(SYNCHRONIZE | THREAD_QUERY_LIMITED_INFORMATION, FALSE, threadId))
+    {
+        alive = GetProcessIdOfThread(hThread) == GetCurrentProcessId() &&
+                WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT;
+        CloseHandle(hThread);
+    }
+    SetLastError(savedError);
+    return alive;
+}
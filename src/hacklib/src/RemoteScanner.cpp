@@ -0,0 +1,166 @@
+#include "hacklib/RemoteScanner.h"
+#include "hacklib/PatternScanner.h"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+
+
+void hl::RemoteScanner::refresh()
+{
+    m_memoryMap = hl::GetMemoryMap(m_pid);
+}
+
+uintptr_t hl::RemoteScanner::findPattern(const PatternView& pattern, const std::string& moduleName,
+                                         int instance) const
+{
+    uintptr_t result = 0;
+    for (const auto& region : getCodeRegions(moduleName))
+    {
+        result = findPattern(pattern, region.base, region.size, instance);
+        if (result)
+            break;
+    }
+    return result;
+}
+
+uintptr_t hl::RemoteScanner::findPattern(const PatternView& pattern, uintptr_t address, size_t len,
+                                         int instance) const
+{
+    uintptr_t result = 0;
+    scan({ { address, len } }, pattern,
+         [&](uintptr_t adr)
+         {
+             if (instance--)
+                 return true;
+             result = adr;
+             return false;
+         });
+    return result;
+}
+
+uintptr_t hl::RemoteScanner::findPattern(const std::string& pattern, const std::string& moduleName,
+                                         int instance) const
+{
+    return findPattern(CompiledPattern(pattern), moduleName, instance);
+}
+
+uintptr_t hl::RemoteScanner::findPattern(const std::string& pattern, uintptr_t address, size_t len,
+                                         int instance) const
+{
+    return findPattern(CompiledPattern(pattern), address, len, instance);
+}
+
+std::vector<uintptr_t> hl::RemoteScanner::findAllPatterns(const PatternView& pattern,
+                                                          const std::string& moduleName) const
+{
+    Ranges ranges;
+    for (const auto& region : getCodeRegions(moduleName))
+        ranges.emplace_back(region.base, region.size);
+
+    std::vector<uintptr_t> results;
+    scan(ranges, pattern,
+         [&](uintptr_t adr)
+         {
+             results.push_back(adr);
+             return true;
+         });
+    return results;
+}
+
+std::vector<uintptr_t> hl::RemoteScanner::findAllPatterns(const PatternView& pattern, uintptr_t address,
+                                                          size_t len) const
+{
+    std::vector<uintptr_t> results;
+    scan({ { address, len } }, pattern,
+         [&](uintptr_t adr)
+         {
+             results.push_back(adr);
+             return true;
+         });
+    return results;
+}
+
+std::vector<hl::MemoryRegion> hl::RemoteScanner::getCodeRegions(const std::string& moduleName) const
+{
+    const auto [begin, end] = getModuleExtent(moduleName);
+
+    std::vector<hl::MemoryRegion> regions;
+    for (const auto& region : m_memoryMap)
+    {
+        if (region.protection == hl::PROTECTION_READ_EXECUTE && region.base >= begin && region.base < end)
+            regions.push_back(region);
+    }
+    return regions;
+}
+
+
+template <typename F>
+void hl::RemoteScanner::scan(const Ranges& ranges, const PatternView& pattern, F&& onMatch) const
+{
+    // An empty pattern matches everywhere, including the end of a range.
+    if (!pattern.size)
+    {
+        for (const auto& [address, len] : ranges)
+        {
+            for (size_t offset = 0; offset <= len; offset++)
+            {
+                if (!onMatch(address + offset))
+                    return;
+            }
+        }
+        return;
+    }
+
+    struct Chunk
+    {
+        uintptr_t address;
+        // The number of bytes to read, including the overlap with the next chunk.
+        size_t len;
+        // Matches must start within this many bytes. Later ones are found in the next chunk.
+        size_t startLen;
+    };
+
+    // Chunks overlap by the longest match minus one, so that every match lies completely within a chunk.
+    const size_t overlap = pattern.maxLength() - 1;
+    std::vector<Chunk> chunks;
+    size_t bufferSize = 0;
+    for (const auto& [address, len] : ranges)
+    {
+        for (size_t offset = 0; offset < len; offset += ChunkSize)
+        {
+            const size_t remaining = len - offset;
+            chunks.push_back({ address + offset, std::min(remaining, ChunkSize + overlap),
+                               std::min(remaining, ChunkSize) });
+            bufferSize = std::max(bufferSize, chunks.back().len);
+        }
+    }
+    if (chunks.empty())
+        return;
+
+    // The next chunk is read into the other buffer while the current one is searched.
+    std::vector<uint8_t> buffers[2] = { std::vector<uint8_t>(bufferSize), std::vector<uint8_t>(bufferSize) };
+    auto readChunk = [&](size_t i)
+    {
+        if (read(chunks[i].address, buffers[i % 2].data(), chunks[i].len) != chunks[i].len)
+            throw std::runtime_error("could not read process memory");
+    };
+    // Declared after the buffers, so that a pending read finishes before they are destroyed.
+    auto pending = std::async(std::launch::async, readChunk, 0);
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        pending.get();
+        if (i + 1 < chunks.size())
+            pending = std::async(std::launch::async, readChunk, i + 1);
+
+        const auto& chunk = chunks[i];
+        const auto data = (uintptr_t)buffers[i % 2].data();
+        for (uintptr_t match : hl::FindAllPatterns(pattern, data, chunk.len))
+        {
+            if (match - data >= chunk.startLen)
+                break;
+            if (!onMatch(chunk.address + (match - data)))
+                return;
+        }
+    }
+}
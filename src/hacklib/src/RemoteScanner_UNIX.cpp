@@ -0,0 +1,62 @@
+#include "hacklib/RemoteScanner.h"
+#include <limits>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+hl::RemoteScanner::RemoteScanner(int pid) : m_pid(pid)
+{
+    refresh();
+    if (m_memoryMap.empty())
+        throw std::runtime_error("could not open process");
+}
+
+hl::RemoteScanner::~RemoteScanner() = default;
+
+size_t hl::RemoteScanner::read(uintptr_t adr, void* buffer, size_t len) const
+{
+    size_t numRead = 0;
+    // A read stops early at the first inaccessible page.
+    while (numRead < len)
+    {
+        iovec local = { (uint8_t*)buffer + numRead, len - numRead };
+        iovec remote = { (void*)(adr + numRead), len - numRead };
+        const ssize_t result = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+        if (result <= 0)
+            break;
+        numRead += (size_t)result;
+    }
+    return numRead;
+}
+
+std::pair<uintptr_t, uintptr_t> hl::RemoteScanner::getModuleExtent(const std::string& moduleName) const
+{
+    std::string path = moduleName;
+    if (path.empty())
+    {
+        char exePath[4096];
+        const std::string link = "/proc/" + std::to_string(m_pid) + "/exe";
+        const ssize_t len = readlink(link.c_str(), exePath, sizeof(exePath) - 1);
+        if (len <= 0)
+            throw std::runtime_error("could not determine main module");
+        path.assign(exePath, (size_t)len);
+    }
+
+    // Modules are identified by the path of their mapped file, or by its file name.
+    uintptr_t begin = std::numeric_limits<uintptr_t>::max();
+    uintptr_t end = 0;
+    for (const auto& region : m_memoryMap)
+    {
+        const auto& name = region.name;
+        if (name == path || (name.size() > path.size() && name.ends_with(path) &&
+                             name[name.size() - path.size() - 1] == '/'))
+        {
+            begin = std::min(begin, region.base);
+            end = std::max(end, region.base + region.size);
+        }
+    }
+    if (begin >= end)
+        throw std::runtime_error("no such module");
+    return { begin, end };
+}
@@ -0,0 +1,71 @@
+#include "hacklib/RemoteScanner.h"
+#include <Windows.h>
+#include <Psapi.h>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+
+hl::RemoteScanner::RemoteScanner(int pid) : m_pid(pid)
+{
+    HANDLE hProc = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+    if (!hProc)
+        throw std::runtime_error("could not open process");
+    m_handle = (uintptr_t)hProc;
+    refresh();
+}
+
+hl::RemoteScanner::~RemoteScanner()
+{
+    CloseHandle((HANDLE)m_handle);
+}
+
+size_t hl::RemoteScanner::read(uintptr_t adr, void* buffer, size_t len) const
+{
+    SIZE_T numRead = 0;
+    if (ReadProcessMemory((HANDLE)m_handle, (LPCVOID)adr, buffer, len, &numRead))
+        return len;
+
+    // Find the readable part page by page.
+    const uintptr_t pageSize = hl::GetPageSize();
+    size_t total = 0;
+    while (total < len)
+    {
+        const size_t n = std::min<size_t>(len - total, pageSize - (adr + total) % pageSize);
+        if (!ReadProcessMemory((HANDLE)m_handle, (LPCVOID)(adr + total), (uint8_t*)buffer + total, n, &numRead))
+            break;
+        total += n;
+    }
+    return total;
+}
+
+std::pair<uintptr_t, uintptr_t> hl::RemoteScanner::getModuleExtent(const std::string& moduleName) const
+{
+    HMODULE modules[1024];
+    DWORD needed = 0;
+    if (!EnumProcessModulesEx((HANDLE)m_handle, modules, sizeof(modules), &needed, LIST_MODULES_ALL))
+        throw std::runtime_error("could not enumerate modules");
+
+    // The first module is the executable.
+    const size_t numModules = std::min<size_t>(needed / sizeof(HMODULE), std::size(modules));
+    for (size_t i = 0; i < numModules; i++)
+    {
+        if (!moduleName.empty())
+        {
+            char baseName[MAX_PATH];
+            char fileName[MAX_PATH];
+            if ((!GetModuleBaseNameA((HANDLE)m_handle, modules[i], baseName, MAX_PATH) ||
+                 _stricmp(baseName, moduleName.c_str()) != 0) &&
+                (!GetModuleFileNameExA((HANDLE)m_handle, modules[i], fileName, MAX_PATH) ||
+                 _stricmp(fileName, moduleName.c_str()) != 0))
+                continue;
+        }
+
+        MODULEINFO info = {};
+        if (!GetModuleInformation((HANDLE)m_handle, modules[i], &info, sizeof(info)))
+            break;
+        return { (uintptr_t)info.lpBaseOfDll, (uintptr_t)info.lpBaseOfDll + info.SizeOfImage };
+    }
+
+    throw std::runtime_error("no such module");
+}
@@ -0,0 +1,156 @@
+#include "hacklib/ScanCache.h"
+#include "hacklib/ModuleRegistry.h"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+
+struct hl::ScanCache::Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t count;
+};
+
+struct hl::ScanCache::Entry
+{
+    // Zero marks an empty slot.
+    uint64_t moduleId;
+    uint64_t queryHash;
+    uint64_t rva;
+};
+
+
+static constexpr uint32_t CacheMagic = 0x4353'4c48; // "HLSC"
+static constexpr uint32_t CacheVersion = 1;
+static constexpr size_t InitialCapacity = 1024;
+
+
+hl::ScanCache::ScanCache(const std::string& path) : m_path(path)
+{
+    map(0);
+
+    // Start from scratch if the file is new or was written by something else.
+    const bool valid = m_size >= sizeof(Header) && header()->magic == CacheMagic &&
+                       header()->version == CacheVersion && header()->capacity &&
+                       m_size == sizeof(Header) + header()->capacity * sizeof(Entry);
+    if (!valid)
+    {
+        unmap();
+        map(sizeof(Header) + InitialCapacity * sizeof(Entry));
+        memset(m_data, 0, m_size);
+        *header() = { CacheMagic, CacheVersion, InitialCapacity, 0 };
+    }
+}
+
+uint64_t hl::ScanCache::getModuleId(hl::ModuleHandle hModule)
+{
+    const std::lock_guard lock(m_mutex);
+
+    // A different module may have been loaded at the same address since the ID was computed.
+    const auto snapshot = hl::GetModuleRegistry().snapshot();
+    auto it = m_moduleIds.find(hModule);
+    if (it != m_moduleIds.end() && it->second.first == snapshot->generation())
+        return it->second.second;
+
+    uint64_t id = GetBuildId(hModule);
+    if (!id)
+    {
+        id = Hash({});
+        for (const auto& region : snapshot->codeRegions(hModule))
+            id = Hash({ (const uint8_t*)region.base, region.size }, id);
+    }
+    // Zero is reserved for empty slots.
+    id += !id;
+
+    m_moduleIds[hModule] = { snapshot->generation(), id };
+    return id;
+}
+
+std::optional<uintptr_t> hl::ScanCache::lookup(uint64_t moduleId, uint64_t queryHash)
+{
+    const std::lock_guard lock(m_mutex);
+
+    const Entry* entry = findSlot(moduleId, queryHash);
+    if (!entry->moduleId)
+        return {};
+    return (uintptr_t)entry->rva;
+}
+
+void hl::ScanCache::store(uint64_t moduleId, uint64_t queryHash, uintptr_t rva)
+{
+    const std::lock_guard lock(m_mutex);
+
+    // Keep the load factor below one half for short probe sequences.
+    if (2 * (header()->count + 1) > header()->capacity)
+        grow();
+
+    Entry* entry = findSlot(moduleId, queryHash);
+    if (!entry->moduleId)
+        header()->count++;
+    *entry = { moduleId, queryHash, rva };
+}
+
+size_t hl::ScanCache::size()
+{
+    const std::lock_guard lock(m_mutex);
+    return (size_t)header()->count;
+}
+
+uint64_t hl::ScanCache::Hash(std::span<const uint8_t> data, uint64_t seed)
+{
+    // FNV-1a
+    uint64_t hash = seed;
+    for (auto byte : data)
+    {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+hl::ScanCache::Header* hl::ScanCache::header()
+{
+    return (Header*)m_data;
+}
+
+hl::ScanCache::Entry* hl::ScanCache::entries()
+{
+    return (Entry*)(m_data + sizeof(Header));
+}
+
+hl::ScanCache::Entry* hl::ScanCache::findSlot(uint64_t moduleId, uint64_t queryHash)
+{
+    const auto capacity = (size_t)header()->capacity;
+    Entry* slots = entries();
+
+    // Linear probing. There is always an empty slot because of the load factor.
+    for (auto i = (size_t)((moduleId ^ queryHash) % capacity);; i = (i + 1) % capacity)
+    {
+        Entry* entry = &slots[i];
+        if (!entry->moduleId || (entry->moduleId == moduleId && entry->queryHash == queryHash))
+            return entry;
+    }
+}
+
+void hl::ScanCache::grow()
+{
+    std::vector<Entry> oldEntries;
+    oldEntries.reserve((size_t)header()->count);
+    for (size_t i = 0; i < header()->capacity; i++)
+    {
+        if (entries()[i].moduleId)
+            oldEntries.push_back(entries()[i]);
+    }
+
+    const size_t capacity = 2 * (size_t)header()->capacity;
+    unmap();
+    map(sizeof(Header) + capacity * sizeof(Entry));
+    memset(m_data, 0, m_size);
+    *header() = { CacheMagic, CacheVersion, capacity, oldEntries.size() };
+
+    for (const auto& entry : oldEntries)
+        *findSlot(entry.moduleId, entry.queryHash) = entry;
+}
@@ -0,0 +1,106 @@
+#include "hacklib/ScanCache.h"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#ifdef ARCH_64BIT
+using Elf_Ehdr = Elf64_Ehdr;
+using Elf_Phdr = Elf64_Phdr;
+using Elf_Nhdr = Elf64_Nhdr;
+#else
+using Elf_Ehdr = Elf32_Ehdr;
+using Elf_Phdr = Elf32_Phdr;
+using Elf_Nhdr = Elf32_Nhdr;
+#endif
+
+
+hl::ScanCache::~ScanCache()
+{
+    unmap();
+    if (m_file != -1)
+        close((int)m_file);
+}
+
+void hl::ScanCache::map(size_t size)
+{
+    if (m_file == -1)
+    {
+        const int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throw std::runtime_error("could not open scan cache file");
+        m_file = fd;
+    }
+
+    if (size)
+    {
+        if (ftruncate((int)m_file, (off_t)size) != 0)
+            throw std::runtime_error("could not resize scan cache file");
+    }
+    else
+    {
+        struct stat st = {};
+        if (fstat((int)m_file, &st) != 0)
+            throw std::runtime_error("could not query scan cache file");
+        size = (size_t)st.st_size;
+        if (!size)
+            return;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, (int)m_file, 0);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("could not map scan cache file");
+    m_data = (uint8_t*)data;
+    m_size = size;
+}
+
+void hl::ScanCache::unmap()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+uint64_t hl::ScanCache::GetBuildId(hl::ModuleHandle hModule)
+{
+    // The ELF header and program headers are part of the first loaded segment.
+    const auto* elfHeader = (const Elf_Ehdr*)hModule;
+    if (memcmp(elfHeader->e_ident, ELFMAG, SELFMAG) != 0)
+        return 0;
+    const auto* programHeaders = (const Elf_Phdr*)((uintptr_t)hModule + elfHeader->e_phoff);
+
+    // Non-PIE executables are loaded at their link address.
+    uintptr_t lowestVaddr = UINTPTR_MAX;
+    for (int i = 0; i < elfHeader->e_phnum; i++)
+    {
+        if (programHeaders[i].p_type == PT_LOAD)
+            lowestVaddr = std::min(lowestVaddr, (uintptr_t)programHeaders[i].p_vaddr);
+    }
+    const uintptr_t loadBias = (uintptr_t)hModule - lowestVaddr;
+
+    for (int i = 0; i < elfHeader->e_phnum; i++)
+    {
+        const auto& phdr = programHeaders[i];
+        if (phdr.p_type != PT_NOTE)
+            continue;
+
+        const uintptr_t notesEnd = loadBias + phdr.p_vaddr + phdr.p_memsz;
+        for (uintptr_t adr = loadBias + phdr.p_vaddr; adr + sizeof(Elf_Nhdr) <= notesEnd;)
+        {
+            const auto* note = (const Elf_Nhdr*)adr;
+            const uintptr_t name = adr + sizeof(Elf_Nhdr);
+            const uintptr_t desc = name + ((note->n_namesz + 3) & ~3u);
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp((const void*)name, "GNU", 4) == 0)
+                return Hash({ (const uint8_t*)desc, note->n_descsz });
+            adr = desc + ((note->n_descsz + 3) & ~3u);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "hacklib/ScanCache.h"
+#include <Windows.h>
+#include <stdexcept>
+
+
+hl::ScanCache::~ScanCache()
+{
+    unmap();
+    if (m_file != -1)
+        CloseHandle((HANDLE)m_file);
+}
+
+void hl::ScanCache::map(size_t size)
+{
+    if (m_file == -1)
+    {
+        HANDLE file = CreateFileA(m_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("could not open scan cache file");
+        m_file = (intptr_t)file;
+    }
+
+    if (!size)
+    {
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx((HANDLE)m_file, &fileSize))
+            throw std::runtime_error("could not query scan cache file");
+        size = (size_t)fileSize.QuadPart;
+        if (!size)
+            return;
+    }
+
+    // The mapping extends the file to the requested size.
+    HANDLE mapping = CreateFileMappingA((HANDLE)m_file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                        (DWORD)size, nullptr);
+    if (!mapping)
+        throw std::runtime_error("could not map scan cache file");
+    void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        throw std::runtime_error("could not map scan cache file");
+    }
+    m_mapping = (intptr_t)mapping;
+    m_data = (uint8_t*)data;
+    m_size = size;
+}
+
+void hl::ScanCache::unmap()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mapping);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = -1;
+}
+
+uint64_t hl::ScanCache::GetBuildId(hl::ModuleHandle hModule)
+{
+    const auto* dosHeader = (const IMAGE_DOS_HEADER*)hModule;
+    const auto* ntHeaders = (const IMAGE_NT_HEADERS*)((uintptr_t)hModule + dosHeader->e_lfanew);
+
+    // The link timestamp is a hash of the contents with deterministic builds.
+    const uint32_t values[] = { ntHeaders->FileHeader.TimeDateStamp, ntHeaders->OptionalHeader.SizeOfImage,
+                                ntHeaders->OptionalHeader.CheckSum };
+    return Hash({ (const uint8_t*)values, sizeof(values) });
+}
@@ -0,0 +1,126 @@
+#include "hacklib/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+
+hl::ThreadPool::ThreadPool(unsigned numThreads)
+{
+    if (!numThreads)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    m_threads.reserve(numThreads);
+    for (unsigned i = 0; i < numThreads; i++)
+        m_threads.emplace_back(&ThreadPool::workerThread, this);
+}
+
+hl::ThreadPool::~ThreadPool()
+{
+    {
+        const std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_condVar.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+
+void hl::ThreadPool::submit(std::function<void()> task)
+{
+    {
+        const std::lock_guard lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_condVar.notify_one();
+}
+
+void hl::ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    // The state is shared with the helper tasks, because they may only start after all work is done.
+    struct State
+    {
+        explicit State(size_t count, const std::function<void(size_t)>& body) : count(count), body(body) {}
+
+        const size_t count;
+        const std::function<void(size_t)>& body;
+        std::atomic<size_t> nextIndex = 0;
+        std::atomic<size_t> numDone = 0;
+        std::exception_ptr exception;
+        std::mutex mutex;
+        std::condition_variable condVar;
+
+        // Returns false when there is no work left.
+        bool runOne()
+        {
+            const size_t index = nextIndex++;
+            if (index >= count)
+                return false;
+
+            try
+            {
+                body(index);
+            }
+            catch (...)
+            {
+                const std::lock_guard lock(mutex);
+                if (!exception)
+                    exception = std::current_exception();
+            }
+
+            if (++numDone == count)
+            {
+                const std::lock_guard lock(mutex);
+                condVar.notify_all();
+            }
+            return true;
+        }
+    };
+
+    if (count == 0)
+        return;
+
+    auto state = std::make_shared<State>(count, body);
+
+    const size_t numHelpers = std::min<size_t>(size(), count - 1);
+    for (size_t i = 0; i < numHelpers; i++)
+    {
+        submit(
+            [state]
+            {
+                while (state->runOne())
+                {
+                }
+            });
+    }
+
+    while (state->runOne())
+    {
+    }
+
+    std::unique_lock lock(state->mutex);
+    state->condVar.wait(lock, [&] { return state->numDone == state->count; });
+
+    if (state->exception)
+        std::rethrow_exception(state->exception);
+}
+
+
+void hl::ThreadPool::workerThread()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_mutex);
+            m_condVar.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,109 @@
+#include "hacklib/TrampolineArena.h"
+#include "hacklib/BitManip.h"
+#include "hacklib/Memory.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+
+// The distance that hl::PageAllocNear uses by default, which keeps a block in reach of its location.
+static constexpr uintptr_t MaxDistance = 0x7fff0000;
+
+
+hl::TrampolineArena::TrampolineArena(size_t slotSize, size_t blockSize)
+    : m_slotSize(hl::Align(std::max(slotSize, sizeof(void*)), SlotAlignment))
+    , m_blockSize(hl::Align(std::max(blockSize, m_slotSize), (size_t)hl::GetPageSize()))
+{
+}
+
+hl::TrampolineArena::~TrampolineArena()
+{
+    for (const auto& block : m_blocks)
+    {
+        hl::PageFree((void*)block.base, m_blockSize);
+    }
+}
+
+
+unsigned char* hl::TrampolineArena::allocate(uintptr_t location)
+{
+    const std::lock_guard lock(m_mutex);
+
+    // Any slot is in reach without a location. Otherwise the whole block must be in reach.
+    const uintptr_t low = location > MaxDistance ? location - MaxDistance : 0;
+    const uintptr_t high = location < UINTPTR_MAX - MaxDistance ? location + MaxDistance : UINTPTR_MAX;
+    auto isInReach = [this, location, low, high](const Block& block)
+    { return !location || (block.base >= low && block.base + m_blockSize <= high); };
+
+    for (auto& block : m_blocks)
+    {
+        if (isInReach(block))
+        {
+            if (auto slot = take(block))
+                return slot;
+        }
+    }
+
+    void* base = location ? hl::PageAllocNear(location, m_blockSize, hl::PROTECTION_READ_WRITE_EXECUTE) : nullptr;
+    if (!base)
+    {
+        // There is no free memory in reach. Prefer a slot of an existing block over a new block.
+        for (auto& block : m_blocks)
+        {
+            if (auto slot = take(block))
+                return slot;
+        }
+        base = hl::PageAlloc(m_blockSize, hl::PROTECTION_READ_WRITE_EXECUTE);
+    }
+    if (!base)
+    {
+        throw std::bad_alloc();
+    }
+
+    auto& block = m_blocks.emplace_back();
+    block.base = (uintptr_t)base;
+    return take(block);
+}
+
+void hl::TrampolineArena::free(unsigned char* slot)
+{
+    const std::lock_guard lock(m_mutex);
+
+    const auto adr = (uintptr_t)slot;
+    auto it = std::ranges::find_if(m_blocks, [this, adr](const Block& block)
+                                   { return adr >= block.base && adr < block.base + m_blockSize; });
+    if (it == m_blocks.end())
+        return;
+
+    memcpy(slot, &it->freeList, sizeof(it->freeList));
+    it->freeList = slot;
+}
+
+size_t hl::TrampolineArena::numBlocks() const
+{
+    const std::lock_guard lock(m_mutex);
+    return m_blocks.size();
+}
+
+
+unsigned char* hl::TrampolineArena::take(Block& block)
+{
+    unsigned char* slot = nullptr;
+    if (block.freeList)
+    {
+        slot = block.freeList;
+        memcpy(&block.freeList, slot, sizeof(block.freeList));
+    }
+    else if (block.used + m_slotSize <= m_blockSize)
+    {
+        slot = (unsigned char*)(block.base + block.used);
+        block.used += m_slotSize;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    memset(slot, 0xcc, m_slotSize);
+    return slot;
+}
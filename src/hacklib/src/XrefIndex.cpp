@@ -0,0 +1,176 @@
+#include "hacklib/XrefIndex.h"
+#include "hacklib/ModuleRegistry.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HL_XREF_SSE2
+#include <emmintrin.h>
+#endif
+
+
+static int32_t ReadRel32(const uint8_t* adr)
+{
+    int32_t value;
+    memcpy(&value, adr, sizeof(value));
+    return value;
+}
+
+static bool IsMemoryOperand(uint8_t modrm)
+{
+    // mod = 00 and rm = 101 is RIP-relative on x64 and an absolute disp32 on x86.
+    return (modrm & 0xc7) == 0x05;
+}
+
+std::optional<hl::XrefInstruction> hl::DecodeXref(uintptr_t adr, size_t available)
+{
+    const auto* code = (const uint8_t*)adr;
+    if (available == 0)
+        return {};
+    switch (code[0])
+    {
+    case 0xe8:
+    case 0xe9:
+        if (available < 5)
+            return {};
+        return XrefInstruction{ code[0] == 0xe8 ? XrefType::Call : XrefType::Jump, adr + 5 + ReadRel32(code + 1), 1 };
+    case 0x0f:
+        if (available < 6 || (code[1] & 0xf0) != 0x80)
+            return {};
+        return XrefInstruction{ XrefType::CondJump, adr + 6 + ReadRel32(code + 2), 2 };
+#ifdef ARCH_64BIT
+    case 0x48:
+    case 0x4c:
+        if (available < 7 || (code[1] != 0x8d && code[1] != 0x8b) || !IsMemoryOperand(code[2]))
+            return {};
+        return XrefInstruction{ code[1] == 0x8d ? XrefType::Address : XrefType::Load, adr + 7 + ReadRel32(code + 3),
+                                3 };
+#else
+    case 0x8d:
+    case 0x8b:
+        if (available < 6 || !IsMemoryOperand(code[1]))
+            return {};
+        return XrefInstruction{ code[0] == 0x8d ? XrefType::Address : XrefType::Load, (uint32_t)ReadRel32(code + 2),
+                                2 };
+#endif
+    default:
+        return {};
+    }
+}
+
+
+hl::XrefIndex::XrefIndex(const std::string& moduleName)
+{
+    const auto hModule = hl::GetModuleByName(moduleName);
+    if (!hModule)
+        throw std::runtime_error("no such module");
+
+    const auto snapshot = hl::GetModuleRegistry().snapshot();
+    const auto [targetBegin, targetEnd] = snapshot->moduleExtent(hModule);
+    build(snapshot->codeRegions(hModule), targetBegin, targetEnd);
+}
+
+hl::XrefIndex::XrefIndex(std::span<const hl::MemoryRegion> codeRegions, uintptr_t targetBegin, uintptr_t targetEnd)
+{
+    build(codeRegions, targetBegin, targetEnd);
+}
+
+std::vector<uintptr_t> hl::XrefIndex::referencesTo(uintptr_t target) const
+{
+    std::vector<uintptr_t> results;
+    if (target < m_base || target - m_base > std::numeric_limits<uint32_t>::max())
+        return results;
+
+    const auto [first, last] = std::ranges::equal_range(m_edges, (uint32_t)(target - m_base), {}, &Edge::target);
+    for (auto it = first; it != last; ++it)
+        results.push_back(m_base + it->source);
+    // The sources are only sorted per type.
+    std::ranges::sort(results);
+    return results;
+}
+
+std::vector<uintptr_t> hl::XrefIndex::referencesTo(uintptr_t target, XrefType type) const
+{
+    std::vector<uintptr_t> results;
+    if (target < m_base || target - m_base > std::numeric_limits<uint32_t>::max())
+        return results;
+
+    const auto [first, last] = std::ranges::equal_range(m_edges, std::make_tuple((uint32_t)(target - m_base), type), {},
+                                                        [](const Edge& e) { return std::make_tuple(e.target, e.type); });
+    for (auto it = first; it != last; ++it)
+        results.push_back(m_base + it->source);
+    return results;
+}
+
+std::vector<uintptr_t> hl::XrefIndex::callersOf(uintptr_t function) const
+{
+    return referencesTo(function, XrefType::Call);
+}
+
+void hl::XrefIndex::build(std::span<const hl::MemoryRegion> codeRegions, uintptr_t targetBegin, uintptr_t targetEnd)
+{
+    m_base = targetBegin;
+    uintptr_t highest = targetEnd;
+    for (const auto& region : codeRegions)
+    {
+        m_base = std::min(m_base, region.base);
+        highest = std::max(highest, region.base + region.size);
+    }
+    if (highest - m_base > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("code and targets span more than 4 GiB");
+
+    for (const auto& region : codeRegions)
+    {
+        const auto begin = (const uint8_t*)region.base;
+        scanRegion(begin, begin + region.size, targetBegin, targetEnd);
+    }
+
+    std::ranges::sort(m_edges, {}, [](const Edge& e) { return std::make_tuple(e.target, e.type, e.source); });
+    m_edges.shrink_to_fit();
+}
+
+void hl::XrefIndex::scanRegion(const uint8_t* begin, const uint8_t* end, uintptr_t targetBegin, uintptr_t targetEnd)
+{
+    auto tryAdd = [&](const uint8_t* adr)
+    {
+        // Instructions must lie completely within the region.
+        const auto xref = DecodeXref((uintptr_t)adr, end - adr);
+        if (xref && xref->target >= targetBegin && xref->target < targetEnd)
+            m_edges.push_back({ (uint32_t)(xref->target - m_base), (uint32_t)((uintptr_t)adr - m_base), xref->type });
+    };
+
+    const uint8_t* cur = begin;
+#ifdef HL_XREF_SSE2
+    // Only a few opcode bytes can start a supported encoding. Find them 16 bytes at a time.
+    const __m128i call = _mm_set1_epi8((char)0xe8);
+    const __m128i jmp = _mm_set1_epi8((char)0xe9);
+    const __m128i escape = _mm_set1_epi8((char)0x0f);
+#ifdef ARCH_64BIT
+    const __m128i rexW = _mm_set1_epi8((char)0x48);
+    const __m128i rexWR = _mm_set1_epi8((char)0x4c);
+#else
+    const __m128i lea = _mm_set1_epi8((char)0x8d);
+    const __m128i mov = _mm_set1_epi8((char)0x8b);
+#endif
+    for (; cur + 16 <= end; cur += 16)
+    {
+        const __m128i block = _mm_loadu_si128((const __m128i*)cur);
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, call), _mm_cmpeq_epi8(block, jmp));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, escape));
+#ifdef ARCH_64BIT
+        hits = _mm_or_si128(hits, _mm_or_si128(_mm_cmpeq_epi8(block, rexW), _mm_cmpeq_epi8(block, rexWR)));
+#else
+        hits = _mm_or_si128(hits, _mm_or_si128(_mm_cmpeq_epi8(block, lea), _mm_cmpeq_epi8(block, mov)));
+#endif
+        for (auto mask = (uint32_t)_mm_movemask_epi8(hits); mask; mask &= mask - 1)
+            tryAdd(cur + std::countr_zero(mask));
+    }
+#endif
+
+    for (; cur < end; cur++)
+        tryAdd(cur);
+}
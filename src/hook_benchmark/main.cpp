@@ -0,0 +1,229 @@
+#include "hacklib/Hooker.h"
+#include "hacklib/PageAllocator.h"
+#include "hacklib/Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Measures the per-call overhead of the jumps that hooks are patched with and of complete hooks, and the time to
+// install many hooks.
+// The results are printed as JSON to track regressions between releases.
+// Usage: hl_bench_hook
+
+
+// Each measurement is repeated until it took at least this long in total. The fastest run is reported.
+static constexpr double MinMeasureTime = 0.2;
+static constexpr int CallsPerRun = 1000000;
+static constexpr int NumInstalledHooks = 500;
+static constexpr int NumIdleThreads = 8;
+
+struct Result
+{
+    std::string name;
+    std::string variant;
+    double nsPerCall = 0;
+    // Only set by the install benchmarks, which have no time per call.
+    double nsPerHook = 0;
+};
+
+static std::vector<Result> g_results;
+
+using Func = int (*)();
+
+// Calls func repeatedly and records the fastest run.
+static void Measure(const std::string& name, const std::string& variant, Func func)
+{
+    Result result{ name, variant, 1e100 };
+    double total = 0;
+    do
+    {
+        // Through a volatile pointer, so that the compiler can not inline or hoist the call.
+        Func volatile call = func;
+        int sum = 0;
+        hl::Timer timer;
+        for (int i = 0; i < CallsPerRun; i++)
+            sum += call();
+        const double seconds = timer.diff<double>();
+        if (sum != CallsPerRun)
+            fprintf(stderr, "%s %s returned wrong results\n", name.c_str(), variant.c_str());
+        result.nsPerCall = std::min(result.nsPerCall, seconds * 1e9 / CallsPerRun);
+        total += seconds;
+    } while (total < MinMeasureTime);
+
+    fprintf(stderr, "%-12s %-10s %8.3f ns/call\n", name.c_str(), variant.c_str(), result.nsPerCall);
+    g_results.push_back(std::move(result));
+}
+
+// Writes code to buffer at offset and returns its address.
+static Func Emit(hl::code_page_vector& buffer, size_t offset, const std::vector<unsigned char>& code)
+{
+    std::ranges::copy(code, buffer.begin() + static_cast<std::ptrdiff_t>(offset));
+    return (Func)(buffer.data() + offset);
+}
+
+// Calls a function through the jump forms that hooks may be patched with. The target is in the same page, so that
+// only the kind of jump differs.
+static void RunJumpBenchmarks()
+{
+    hl::code_page_vector code(0x1000, 0xcc);
+    // MOV EAX, 1; RET
+    const auto target = Emit(code, 0, { 0xb8, 0x01, 0x00, 0x00, 0x00, 0xc3 });
+    const auto targetAdr = (uintptr_t)target;
+
+    Measure("jump", "none", target);
+
+    std::vector<unsigned char> rel32 = { 0xe9, 0, 0, 0, 0 }; // JMP target
+    const auto rel32Adr = (uintptr_t)code.data() + 0x40;
+    const auto delta = (uint32_t)(targetAdr - rel32Adr - 5);
+    memcpy(&rel32[1], &delta, sizeof(delta));
+    Measure("jump", "rel32", Emit(code, 0x40, rel32));
+
+#ifdef ARCH_64BIT
+    std::vector<unsigned char> ripIndirect = { 0xff, 0x25, 0, 0, 0, 0 }; // JMP [RIP+0]
+    ripIndirect.resize(14);
+    memcpy(&ripIndirect[6], &targetAdr, sizeof(targetAdr));
+    Measure("jump", "rip", Emit(code, 0x80, ripIndirect));
+
+    // The patch that was used before, which unbalances the return stack buffer.
+    std::vector<unsigned char> pushRet = { 0x68, 0, 0, 0, 0, 0xc7, 0x44, 0x24, 0x04, 0, 0, 0, 0, 0xc3 };
+    const auto targetLo = (uint32_t)targetAdr;
+    const auto targetHi = (uint32_t)(targetAdr >> 32);
+    memcpy(&pushRet[1], &targetLo, sizeof(targetLo));
+    memcpy(&pushRet[9], &targetHi, sizeof(targetHi));
+    Measure("jump", "push_ret", Emit(code, 0xc0, pushRet));
+#endif
+}
+
+static int g_numCallbacks = 0;
+static void DetourCallback(hl::CpuContext*)
+{
+    g_numCallbacks++;
+}
+static int JmpHookTarget()
+{
+    return 1;
+}
+
+// A function whose prologue is just large enough for a relative jump.
+#ifdef ARCH_64BIT
+static const std::vector<unsigned char> g_hookableCode = {
+    0x55,             // PUSH RBP
+    0x48, 0x89, 0xe5, // MOV RBP, RSP
+    0x48, 0x31, 0xc0, // XOR RAX, RAX
+    0x48, 0xff, 0xc0, // INC RAX
+    0x5d,             // POP RBP
+    0xc3,             // RET
+};
+static const int g_hookableOffset = 7;
+#else
+static const std::vector<unsigned char> g_hookableCode = {
+    0x55,       // PUSH EBP
+    0x89, 0xe5, // MOV EBP, ESP
+    0x31, 0xc0, // XOR EAX, EAX
+    0x40,       // INC EAX
+    0x5d,       // POP EBP
+    0xc3,       // RET
+};
+static const int g_hookableOffset = 5;
+#endif
+
+// Calls a function through complete hooks.
+static void RunHookBenchmarks()
+{
+    hl::code_page_vector code(0x1000, 0xcc);
+    const auto func = Emit(code, 0, g_hookableCode);
+    const int offset = g_hookableOffset;
+
+    Measure("detour", "none", func);
+
+    hl::Hooker hooker;
+    auto hook = hooker.hookDetour(func, offset, &DetourCallback);
+    Measure("detour", code[0] == 0xe9 ? "rel32" : "rip", func);
+    hooker.unhook(hook);
+
+    hook = hooker.hookJMP(func, offset, &JmpHookTarget);
+    Measure("jmp_hook", code[0] == 0xe9 ? "rel32" : "rip", func);
+    hooker.unhook(hook);
+}
+
+// Installs many detours one by one and in a batch, while other threads are idle. The time per hook is reported.
+static void RunInstallBenchmarks()
+{
+    hl::code_page_vector code(NumInstalledHooks * 16, 0xcc);
+    std::vector<Func> funcs;
+    for (int i = 0; i < NumInstalledHooks; i++)
+        funcs.push_back(Emit(code, i * 16, g_hookableCode));
+
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NumIdleThreads; i++)
+    {
+        threads.emplace_back(
+            [&]
+            {
+                while (!stop)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+    }
+
+    for (const bool batch : { false, true })
+    {
+        Result result{ "install", batch ? "batch" : "single", 0, 1e100 };
+        double total = 0;
+        do
+        {
+            hl::Hooker hooker;
+            hl::Timer timer;
+            if (batch)
+                hooker.beginBatch();
+            for (auto func : funcs)
+                hooker.hookDetour(func, g_hookableOffset, &DetourCallback);
+            if (batch)
+                hooker.commit();
+            const double seconds = timer.diff<double>();
+            result.nsPerHook = std::min(result.nsPerHook, seconds * 1e9 / NumInstalledHooks);
+            total += seconds;
+        } while (total < MinMeasureTime);
+
+        fprintf(stderr, "%-12s %-10s %8.3f ms for %i hooks\n", result.name.c_str(), result.variant.c_str(),
+                result.nsPerHook * NumInstalledHooks / 1e6, NumInstalledHooks);
+        g_results.push_back(std::move(result));
+    }
+
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+}
+
+static void PrintJson()
+{
+    printf("{\n  \"benchmark\": \"hl_bench_hook\",\n  \"results\": [\n");
+    for (size_t i = 0; i < g_results.size(); i++)
+    {
+        const auto& result = g_results[i];
+        const bool perHook = result.nsPerHook > 0;
+        const char* unit = perHook ? "ns_per_hook" : "ns_per_call";
+        printf("    { \"name\": \"%s\", \"variant\": \"%s\", \"%s\": %.3f }%s\n", result.name.c_str(),
+               result.variant.c_str(), unit, perHook ? result.nsPerHook : result.nsPerCall,
+               i + 1 < g_results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main()
+{
+    RunJumpBenchmarks();
+    RunHookBenchmarks();
+    RunInstallBenchmarks();
+    PrintJson();
+
+    return 0;
+}
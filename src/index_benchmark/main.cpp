@@ -0,0 +1,87 @@
+#include "SyntheticCode.h"
+#include "hacklib/CodeIndex.h"
+#include "hacklib/PatternScanner.h"
+#include "hacklib/Timer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+// Compares hl::CodeIndex against linear scans on synthetic code.
+// Usage: hl_bench_index [size in MiB]...
+
+
+static BenchRandom g_random(12345);
+
+// Takes 16 bytes from the code with a wildcard displacement like in typical signatures.
+static std::string MakeQuery(const std::vector<uint8_t>& code)
+{
+    const size_t offset = g_random.next() % (code.size() - 16);
+    std::string pattern;
+    for (size_t i = 0; i < 16; i++)
+    {
+        char byteStr[4];
+        if (i >= 4 && i < 8)
+            snprintf(byteStr, sizeof(byteStr), "??");
+        else
+            snprintf(byteStr, sizeof(byteStr), "%02x", code[offset + i]);
+        pattern += (i ? " " : "") + std::string(byteStr);
+    }
+    return pattern;
+}
+
+static void RunBenchmark(size_t sizeMiB)
+{
+    constexpr int NumQueries = 1000;
+    constexpr int NumLinearQueries = 10;
+
+    const auto code = GenerateCode(sizeMiB << 20);
+    hl::MemoryRegion region;
+    region.status = hl::MemoryRegion::Status::Valid;
+    region.base = (uintptr_t)code.data();
+    region.size = code.size();
+
+    hl::Timer buildTimer;
+    const hl::CodeIndex index({ &region, 1 });
+    const double buildTime = buildTimer.diff<double>();
+
+    std::vector<hl::CompiledPattern> queries;
+    for (int i = 0; i < NumQueries; i++)
+        queries.emplace_back(MakeQuery(code));
+
+    size_t numMatches = 0;
+    hl::Timer queryTimer;
+    for (const auto& query : queries)
+        numMatches += index.find(query).size();
+    const double queryTime = queryTimer.diff<double>() / NumQueries;
+
+    hl::Timer linearTimer;
+    for (int i = 0; i < NumLinearQueries; i++)
+    {
+        for (auto adr : hl::FindAllPatterns(queries[i], region.base, region.size))
+            (void)adr;
+    }
+    const double linearTime = linearTimer.diff<double>() / NumLinearQueries;
+
+    printf("%5zu MiB: build %8.3f s | query %10.2f us | linear scan %10.2f us | %zu matches\n", sizeMiB, buildTime,
+           queryTime * 1e6, linearTime * 1e6, numMatches);
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<size_t> sizes = { 1, 16, 64 };
+    if (argc > 1)
+    {
+        sizes.clear();
+        for (int i = 1; i < argc; i++)
+            sizes.push_back((size_t)strtoul(argv[i], nullptr, 10));
+    }
+
+    for (auto size : sizes)
+        RunBenchmark(size);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef HL_BENCH_SYNTHETICCODE_H
+#define HL_BENCH_SYNTHETICCODE_H
+
+#include "hacklib/Pattern.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+// Synthetic code for the benchmarks. Shared by hl_bench_scan and hl_bench_index.
+
+// A linear congruential generator, so that every run uses the same numbers.
+class BenchRandom
+{
+public:
+    explicit BenchRandom(uint32_t seed) : m_seed(seed) {}
+
+    uint32_t next()
+    {
+        m_seed = m_seed * 1664525 + 1013904223;
+        return m_seed >> 8;
+    }
+
+private:
+    uint32_t m_seed;
+};
+
+// Generates bytes with the distribution of x86 code. The same size always results in the same bytes.
+inline std::vector<uint8_t> GenerateCode(size_t size)
+{
+    // Maps 16 random bits to a byte, which is much faster than a search per byte for large sizes.
+    std::array<uint32_t, 256> cumulative;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < 256; i++)
+        cumulative[i] = sum += hl::CodeByteFrequency[i] + 1;
+    std::vector<uint8_t> table(0x10000);
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        const auto value = (uint32_t)(i * sum / table.size());
+        table[i] = (uint8_t)(std::upper_bound(cumulative.begin(), cumulative.end(), value) - cumulative.begin());
+    }
+
+    BenchRandom random((uint32_t)size);
+    std::vector<uint8_t> code(size);
+    for (auto& byte : code)
+        byte = table[random.next() & 0xffff];
+    return code;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include "SyntheticCode.h"
+#include "hacklib/PatternScanner.h"
+#include "hacklib/Timer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Measures the pattern scanners on deterministic synthetic code and on the code of this executable.
+// The results are printed as JSON to track regressions between releases.
+// Usage: hl_bench_scan [size in MiB]...
+
+
+// Each measurement is repeated until it took at least this long in total. The fastest run is reported.
+static constexpr double MinMeasureTime = 0.2;
+
+struct Result
+{
+    std::string name;
+    std::string variant;
+    size_t bytes = 0;
+    double seconds = 0;
+    size_t matches = 0;
+};
+
+static std::vector<Result> g_results;
+
+// Runs func repeatedly and records the fastest run. func returns the number of matches.
+static void Measure(const std::string& name, const std::string& variant, size_t bytes,
+                    const std::function<size_t()>& func)
+{
+    Result result{ name, variant, bytes, 1e100, 0 };
+    double total = 0;
+    do
+    {
+        hl::Timer timer;
+        result.matches = func();
+        const double seconds = timer.diff<double>();
+        result.seconds = std::min(result.seconds, seconds);
+        total += seconds;
+    } while (total < MinMeasureTime);
+
+    fprintf(stderr, "%-20s %-10s %10zu bytes %10.3f ms %8.2f GB/s\n", name.c_str(), variant.c_str(), bytes,
+            result.seconds * 1e3, (double)bytes / result.seconds / 1e9);
+    g_results.push_back(std::move(result));
+}
+
+static const char* SimdLevelName(hl::SimdLevel level)
+{
+    switch (level)
+    {
+    case hl::SimdLevel::Scalar:
+        return "scalar";
+    case hl::SimdLevel::SSE2:
+        return "sse2";
+    case hl::SimdLevel::AVX2:
+        return "avx2";
+    case hl::SimdLevel::AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+static void RunSyntheticBenchmarks(size_t sizeMiB)
+{
+    auto code = GenerateCode(sizeMiB << 20);
+    const auto adr = (uintptr_t)code.data();
+    const size_t len = code.size();
+
+    // A signature with a wildcard displacement that only occurs at the end, so every scan covers all bytes.
+    const uint8_t needle[] = { 0x48, 0x8b, 0x05, 0x11, 0x22, 0x33, 0x44, 0x48, 0x85, 0xc0, 0x74, 0x1d, 0xcc, 0xcc };
+    std::copy(std::begin(needle), std::end(needle), code.end() - sizeof(needle));
+    const char* pattern = "48 8b 05 ?? ?? ?? ?? 48 85 c0 74 1d cc cc";
+    const hl::Pattern<"48 8b 05 ?? ?? ?? ?? 48 85 c0 74 1d cc cc"> compiledPattern;
+
+    Measure("FindPatternMask", "", len,
+            [&]
+            {
+                return (size_t)(hl::FindPatternMask("\x48\x8b\x05\x00\x00\x00\x00\x48\x85\xc0\x74\x1d\xcc\xcc",
+                                                    "xxx????xxxxxxx", adr, len) != 0);
+            });
+
+    const auto supported = hl::GetSupportedSimdLevel();
+    for (auto level : { hl::SimdLevel::Scalar, hl::SimdLevel::SSE2, hl::SimdLevel::AVX2, hl::SimdLevel::AVX512 })
+    {
+        if (level > supported)
+            break;
+        hl::SetMaxSimdLevel(level);
+        Measure("FindPattern", SimdLevelName(level), len,
+                [&] { return (size_t)(hl::FindPattern(pattern, adr, len) != 0); });
+    }
+    hl::SetMaxSimdLevel(supported);
+
+    Measure("FindPattern", "compiled", len, [&] { return (size_t)(hl::FindPattern(compiledPattern, adr, len) != 0); });
+
+    // Many matches, which measures the cost per match.
+    Measure("FindAllPatterns", "", len,
+            [&]
+            {
+                size_t numMatches = 0;
+                for (auto match : hl::FindAllPatterns(hl::Pattern<"e8 ?? ?? ?? ?? 48">(), adr, len))
+                    numMatches += match != 0;
+                return numMatches;
+            });
+
+    Measure("ScanRegions", "", len,
+            [&]
+            {
+                return hl::ScanRegions([&](const hl::MemoryRegion& region)
+                                       { return region.base < adr + len && adr < region.base + region.size; },
+                                       compiledPattern)
+                    .size();
+            });
+
+    hl::SetScanThreads(0);
+    Measure("FindPattern", "parallel", len, [&] { return (size_t)(hl::FindPattern(compiledPattern, adr, len) != 0); });
+    hl::SetScanThreads(1);
+}
+
+static const char* GetReferencedString()
+{
+    return "hl_bench_scan referenced string";
+}
+
+// String references and batches need a loaded module, so the code of this executable is used.
+static void RunModuleBenchmarks()
+{
+    size_t codeSize = 0;
+    for (const auto& region : hl::GetCodeRegions())
+        codeSize += region.size;
+
+    const std::vector<std::string> patterns = { "48 8b 05 ?? ?? ?? ?? 48 85 c0 74 1d cc cc", "de ad be ef 13 37",
+                                                "e8 ?? ?? ?? ?? 48 8b ?? 24", "0f 1f 44 00 00 c3" };
+    Measure("findPatterns", "batch", codeSize,
+            [&]
+            {
+                hl::PatternScanner scanner;
+                const auto results = scanner.findPatterns(patterns);
+                return (size_t)std::ranges::count_if(results, [](uintptr_t adr) { return adr != 0; });
+            });
+
+    try
+    {
+        const std::string str = GetReferencedString();
+        Measure("findString", "cold", codeSize,
+                [&]
+                {
+                    hl::PatternScanner scanner;
+                    return (size_t)(scanner.findString(str) != 0);
+                });
+        hl::PatternScanner scanner;
+        Measure("findString", "warm", codeSize, [&] { return (size_t)(scanner.findString(str) != 0); });
+    }
+    catch (const std::runtime_error&)
+    {
+        // The compiler may have dropped the reference.
+        fprintf(stderr, "findString skipped: the string is not referenced\n");
+    }
+}
+
+static void PrintJson()
+{
+    printf("{\n  \"benchmark\": \"hl_bench_scan\",\n  \"simd\": \"%s\",\n  \"results\": [\n",
+           SimdLevelName(hl::GetSupportedSimdLevel()));
+    for (size_t i = 0; i < g_results.size(); i++)
+    {
+        const auto& result = g_results[i];
+        const double nsPerMatch = result.matches ? result.seconds * 1e9 / (double)result.matches : 0;
+        printf("    { \"name\": \"%s\", \"variant\": \"%s\", \"bytes\": %zu, \"seconds\": %.9f, \"gbps\": %.3f, "
+               "\"matches\": %zu, \"ns_per_match\": %.3f }%s\n",
+               result.name.c_str(), result.variant.c_str(), result.bytes, result.seconds,
+               (double)result.bytes / result.seconds / 1e9, result.matches, nsPerMatch,
+               i + 1 < g_results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<size_t> sizes = { 1, 16, 128, 1024 };
+    if (argc > 1)
+    {
+        sizes.clear();
+        for (int i = 1; i < argc; i++)
+            sizes.push_back((size_t)strtoul(argv[i], nullptr, 10));
+    }
+
+    for (auto size : sizes)
+        RunSyntheticBenchmarks(size);
+    RunModuleBenchmarks();
+    PrintJson();
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
 #include <filesystem>
@@ -18,6 +19,23 @@ data with hl_test_lib. This would cause hacklib to misbehave.
 */
 
 
+// The test library unloads itself after the tests. Exiting while it does would run its static destructors while it
+// is unmapped.
+static bool IsTestLibraryLoaded()
+{
+#ifdef WIN32
+    return GetModuleHandle("hl_test_hostd.dll") != NULL;
+#else
+    auto handle = dlopen("./libhl_test_hostd.so", RTLD_NOW | RTLD_LOCAL | RTLD_NOLOAD);
+    if (handle)
+    {
+        dlclose(handle);
+    }
+    return handle != NULL;
+#endif
+}
+
+
 int main(int argc, char* argv[])
 {
     if (argc == 2 && std::string(argv[1]) == "--child")
@@ -60,13 +78,22 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    int elapsedTime = 0;
-    while (elapsedTime++ < 200)
+    // Well above the runtime of the tests on slow machines. Can be overridden in seconds by HL_TEST_TIMEOUT.
+    int timeout = 60;
+    if (const char* timeoutEnv = std::getenv("HL_TEST_TIMEOUT"))
+        timeout = std::atoi(timeoutEnv);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+    while (std::chrono::steady_clock::now() < deadline)
     {
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
         if (std::filesystem::exists("hl_test_success"))
         {
             std::remove("hl_test_success");
+            while (IsTestLibraryLoaded() && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
             return 0;
         }
     }
@@ -5,11 +5,22 @@
 #include "hacklib/Logging.h"
 #include "hacklib/Main.h"
 #include "hacklib/Memory.h"
+#include "hacklib/ModuleRegistry.h"
 #include "hacklib/PageAllocator.h"
 #include "hacklib/Patch.h"
 #include "hacklib/PatternScanner.h"
 #include "hacklib/Process.h"
+#include "hacklib/RemoteScanner.h"
 #include "hacklib/BitManip.h"
+#include "hacklib/CodeIndex.h"
+#include "hacklib/ExeFile.h"
+#include "hacklib/IncrementalScanner.h"
+#include "hacklib/InstructionDecoder.h"
+#include "hacklib/Rng.h"
+#include "hacklib/ScanCache.h"
+#include "hacklib/TrampolineArena.h"
+#include "hacklib/XrefIndex.h"
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <functional>
@@ -18,6 +29,17 @@
 #include <thread>
 #include <algorithm>
 #include <fstream>
+#include <cstring>
+#include <ranges>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 
 #define HL_ASSERT(cond, format, ...)                                                                                   \
@@ -115,6 +137,7 @@ static hl::code_page_vector g_dummyCode{
     0xc3,             // RET
 };
 static int g_dummyHookOffset = 16;
+static int g_dummyShortHookOffset = 7;
 #else
 static hl::code_page_vector g_dummyCode{
     0x55,       // PUSH EBP
@@ -129,6 +152,33 @@ static hl::code_page_vector g_dummyCode{
     0xc3,       // RET
 };
 static int g_dummyHookOffset = 6;
+static int g_dummyShortHookOffset = 5;
+#endif
+
+// Set up dummy code for hooking under load. The hooked bytes are a single NOP, so no thread is ever inside of them.
+#ifdef ARCH_64BIT
+static hl::code_page_vector g_stressCode{
+    0x66, 0x66, 0x66, 0x66, 0x66,                               // NOP WORD CS:[RAX+RAX+0]
+    0x2e, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,       //
+    0x48, 0x31, 0xc0,                                           // XOR RAX, RAX
+    0x48, 0xff, 0xc0,                                           // INC RAX
+    0xc3,                                                       // RET
+    0xb8, 0x07, 0x00, 0x00, 0x00,                               // MOV EAX, 7
+    0xc3,                                                       // RET
+};
+static int g_stressHookOffset = 14;
+static int g_stressAltOffset = 21;
+#else
+static hl::code_page_vector g_stressCode{
+    0x0f, 0x1f, 0x44, 0x00, 0x00, // NOP DWORD [EAX+EAX+0]
+    0x31, 0xc0,                   // XOR EAX, EAX
+    0x40,                         // INC EAX
+    0xc3,                         // RET
+    0xb8, 0x07, 0x00, 0x00, 0x00, // MOV EAX, 7
+    0xc3,                         // RET
+};
+static int g_stressHookOffset = 5;
+static int g_stressAltOffset = 9;
 #endif
 
 template <typename T, typename F>
@@ -295,6 +345,17 @@ static void TestMemory()
     hl::PageCommit((void*)((uintptr_t)base + hl::GetPageSize()), hl::GetPageSize(), hl::PROTECTION_READ_WRITE);
     *(volatile int*)((uintptr_t)base + hl::GetPageSize());
     hl::PageFree(base, 2 * hl::GetPageSize());
+
+    const auto nearTo = (uintptr_t)&TestMemory;
+    auto nearMem = hl::PageAllocNear(nearTo, hl::GetPageSize(), hl::PROTECTION_READ_WRITE_EXECUTE);
+    HL_ASSERT(nearMem, "PageAllocNear failed");
+    const auto nearBegin = (uintptr_t)nearMem;
+    const auto nearEnd = nearBegin + hl::GetPageSize();
+    HL_ASSERT(nearBegin >= nearTo - 0x7fff0000 && nearEnd <= nearTo + 0x7fff0000, "PageAllocNear out of range");
+    *(volatile int*)nearMem = 0;
+    hl::PageFree(nearMem, hl::GetPageSize());
+    HL_ASSERT(!hl::PageAllocNear(0x10000, hl::GetPageSize(), hl::PROTECTION_READ_WRITE, 0),
+              "PageAllocNear ignored the distance");
 }
 
 static void TestInject()
@@ -347,6 +408,53 @@ static void TestInject()
     HL_ASSERT(process.join() == 0, "");
 }
 
+static void TestRemoteScanner()
+{
+#ifdef WIN32
+    std::string procName = "hl_test";
+    const std::string libraryName = "ntdll.dll";
+#else
+    std::string procName = "./hl_test";
+    const std::string libraryName = "libc.so.6";
+#endif
+    auto process = hl::LaunchProcess(procName, { "--child" });
+    // Give the child time to load its modules.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const hl::RemoteScanner scanner(process.id());
+
+    // The child runs the same executable and library code, so matches must be at the same offsets.
+    for (const auto& moduleName : { std::string(), libraryName })
+    {
+        const auto localRegions = hl::GetCodeRegions(moduleName);
+        const auto remoteRegions = scanner.getCodeRegions(moduleName);
+        HL_ASSERT(localRegions.size() == remoteRegions.size(), "Different code regions");
+        const uintptr_t localBase = localRegions.front().base;
+        const uintptr_t remoteBase = remoteRegions.front().base;
+
+        const auto pattern = hl::Pattern<"e8 ?? ?? ?? ?? [0-4] 48 8b">();
+        std::vector<uintptr_t> expected;
+        for (uintptr_t adr : hl::FindAllPatterns(pattern, moduleName))
+            expected.push_back(adr - localBase);
+        std::vector<uintptr_t> results;
+        for (uintptr_t adr : scanner.findAllPatterns(pattern, moduleName))
+            results.push_back(adr - remoteBase);
+        HL_ASSERT(!expected.empty() && results == expected, "Remote matches differ");
+
+        const auto instance = (int)expected.size() / 2;
+        HL_ASSERT(scanner.findPattern("e8 ?? ?? ?? ??", moduleName, instance) - remoteBase ==
+                      hl::FindPattern("e8 ?? ?? ?? ??", moduleName, instance) - localBase,
+                  "Remote instance differs");
+        const auto& region = remoteRegions.back();
+        HL_ASSERT(scanner.findPattern(pattern, region.base, region.size, 1) - remoteBase ==
+                      hl::FindPattern(pattern, localRegions.back().base, localRegions.back().size, 1) - localBase,
+                  "Remote range differs");
+    }
+
+    ExpectException<std::runtime_error>([&] { (void)scanner.findPattern("e8", 0, hl::GetPageSize()); });
+
+    HL_ASSERT(process.join() == 0, "");
+}
+
 static void TestModules()
 {
     auto modPath = hl::GetCurrentModulePath();
@@ -354,7 +462,7 @@ static void TestModules()
 
     auto hModule = hl::GetCurrentModule();
     auto ownFuncAdr = (uintptr_t)&TestModules;
-    HL_ASSERT(ownFuncAdr > (uintptr_t)hModule && ownFuncAdr - (uintptr_t)hModule < 0x100000,
+    HL_ASSERT(ownFuncAdr > (uintptr_t)hModule && ownFuncAdr - (uintptr_t)hModule < 0x1000000,
               "Module base address is wrong");
 
     auto hModuleByName = hl::GetModuleByName(modPath);
@@ -424,8 +532,51 @@ static void TestPatternScan()
     HL_ASSERT(pattern4 == testAdr, "String with wildcard");
     HL_ASSERT(pattern5 == testAdr, "Uppercase");
 
+    auto pattern6 = hl::FindPattern(hl::Pattern<"12 34 56 ?? 9a bC dE f0">(), testAdr, 0x100);
+    auto pattern7 = hl::FindPattern(hl::Pattern<"?? ?? 56">(), testAdr, 0x100);
+    auto pattern8 = hl::FindPattern(hl::Pattern<"34 56 78 9a">(), testAdr, 0x100);
+    static_assert(hl::Pattern<"12 34 56 ?? 9a">::Size == 5);
+
+    HL_ASSERT(pattern6 == testAdr, "Compile-time pattern");
+    HL_ASSERT(pattern7 == testAdr, "Compile-time pattern with leading wildcards");
+    HL_ASSERT(pattern8 == testAdr + 1, "Compile-time pattern with offset");
+
+    const hl::CompiledPattern compiled("12 34 56 ?? 9a bc de f0");
+    HL_ASSERT(hl::FindPattern(compiled, testAdr, 0x100) == testAdr, "Compiled pattern");
+    HL_ASSERT(hl::FindPatternMask(compiled, testAdr, 0x100) == testAdr, "Compiled pattern mask");
+    HL_ASSERT(hl::FindPattern(compiled, testAdr + 1, 0x100) == 0, "Compiled pattern reuse");
+
+    // Common bytes of x86 code must not be used as anchors.
+    const hl::CompiledPattern common("48 8b 05 ?? ?? ?? ?? cc e8");
+    const hl::PatternView plan = common;
+    const uint8_t anchor1 = plan.bytes[plan.plan->anchor1];
+    const uint8_t anchor2 = plan.bytes[plan.plan->anchor2];
+    HL_ASSERT(anchor1 == 0x05 && anchor2 == 0xe8, "Bad anchors %02x %02x", anchor1, anchor2);
+
+    // Nibble wildcards, bit masks and gaps.
+    HL_ASSERT(hl::FindPattern("1? ?4 56 78", testAdr, 8) == testAdr, "Nibble wildcards");
+    HL_ASSERT(hl::FindPattern("ff/12 34/f0 56", testAdr, 8) == testAdr, "Bit masks");
+    HL_ASSERT(hl::FindPattern("34/0f", testAdr, 8) == testAdr + 1, "Bit mask with offset");
+    HL_ASSERT(hl::FindPattern("12 [2-4] 9a bc", testAdr, 8) == testAdr, "Gap");
+    HL_ASSERT(hl::FindPattern("12 [4-6] 9a", testAdr, 8) == 0, "Gap too long");
+    HL_ASSERT(hl::FindPattern("12 [1-1] 56", testAdr, 8) == testAdr, "Fixed gap");
+    HL_ASSERT(hl::FindPattern("12 [0-3] [2-3] f0", testAdr, 8) == testAdr, "Consecutive gaps");
+    HL_ASSERT(hl::FindPattern(hl::Pattern<"?2 [1-3] 9? [0-2] f0">(), testAdr, 8) == testAdr, "Compile-time gaps");
+    static_assert(hl::Pattern<"?2 [1-3] 9? [0-2] f0">::Size == 3);
+    HL_ASSERT(std::ranges::distance(hl::FindAllPatterns("?? [0-6] f0", testAdr, 8)) == 7, "All gapped matches");
+    const hl::CompiledPattern gapped("12 [0-3] [1-2] 9a");
+    HL_ASSERT(gapped.size() == 2 && gapped.gaps().size() == 1 && gapped.gaps()[0].min == 1 &&
+                  gapped.gaps()[0].max == 5,
+              "Merged gaps");
+
     ExpectException<std::runtime_error>([&] { hl::FindPattern("12 34 g0 78", testAdr, 0x100); });
-    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 34 ?0 78", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 34 ?g 78", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 34/3 78", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("[1-2] 12", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 [1-2]", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 [3-1] 34", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 [1] 34", testAdr, 0x100); });
+    ExpectException<std::runtime_error>([&] { hl::FindPattern("12 [1-99999] 34", testAdr, 0x100); });
 
     // Surround the search area with noaccess pages to check for out of bounds accesses.
     auto pageSize = hl::GetPageSize();
@@ -440,6 +591,790 @@ static void TestPatternScan()
 
     HL_ASSERT(patternGuard1 == 0, "Should not find this");
     HL_ASSERT(patternGuard2 == (uintptr_t)guardMem.data() + 2 * pageSize - 4, "Should find this");
+
+    auto allGuard = hl::FindAllPatterns("cc cc", (uintptr_t)guardMem.data() + pageSize, pageSize);
+    HL_ASSERT(std::ranges::distance(allGuard) == 3, "Overlapping matches");
+    HL_ASSERT(*allGuard.begin() == patternGuard2, "First match");
+    HL_ASSERT(hl::FindAllPatterns("cc cc cc cc cc", (uintptr_t)guardMem.data() + pageSize, pageSize).empty(),
+              "Should not find this");
+
+    // Compare with the instance search and stop early.
+    const auto moduleName = hl::GetCurrentModulePath();
+    auto allCalls = hl::FindAllPatterns(hl::Pattern<"e8 ?? ?? ?? ??">(), moduleName);
+    int instance = 0;
+    for (uintptr_t adr : allCalls | std::views::take(20))
+    {
+        HL_ASSERT(adr == hl::FindPattern("e8 ?? ?? ?? ??", moduleName, instance), "Differs from instance %i", instance);
+        instance++;
+    }
+    HL_ASSERT(instance == 20, "Too few matches");
+    auto firstCall = std::ranges::find_if(allCalls, [](uintptr_t adr) { return *(const uint8_t*)(adr + 4) == 0xff; });
+    HL_ASSERT(firstCall != allCalls.end(), "Backward call not found");
+}
+
+// Straightforward reference for checking the optimized scanning kernels.
+static uintptr_t ReferenceFindPatternMask(const char* byteMask, const char* checkMask, uintptr_t address, size_t len,
+                                          int instance)
+{
+    const size_t patternLen = strlen(checkMask);
+    for (size_t offset = 0; offset + patternLen <= len; offset++)
+    {
+        bool match = true;
+        for (size_t i = 0; i < patternLen && match; i++)
+            match = checkMask[i] != 'x' || *(const char*)(address + offset + i) == byteMask[i];
+        if (match && !instance--)
+            return address + offset;
+    }
+    return 0;
+}
+
+struct ReferenceToken
+{
+    uint8_t value;
+    uint8_t mask;
+    size_t gapMin;
+    size_t gapMax;
+};
+
+static bool ReferenceMatchTokens(const uint8_t* data, const uint8_t* end, std::span<const ReferenceToken> tokens)
+{
+    if (tokens.empty())
+        return true;
+    for (size_t gap = tokens[0].gapMin; gap <= tokens[0].gapMax && gap < (size_t)(end - data); gap++)
+    {
+        if ((data[gap] & tokens[0].mask) == tokens[0].value &&
+            ReferenceMatchTokens(data + gap + 1, end, tokens.subspan(1)))
+            return true;
+    }
+    return false;
+}
+
+static void TestPatternScanSimd()
+{
+    auto pageSize = hl::GetPageSize();
+    hl::code_page_vector guardMem(4 * pageSize);
+    hl::PageProtect(guardMem.data(), pageSize, hl::PROTECTION_NOACCESS);
+    hl::PageProtect((void*)((uintptr_t)guardMem.data() + 3 * pageSize), pageSize, hl::PROTECTION_NOACCESS);
+    auto data = (char*)guardMem.data() + pageSize;
+    const size_t dataLen = 2 * pageSize;
+
+    // A small alphabet produces many partial matches that must be rejected by the verification.
+    hl::Rng rng(1234);
+    for (size_t i = 0; i < dataLen; i++)
+        data[i] = (char)rng.nextInt(0, 3);
+
+    const auto supported = hl::GetSupportedSimdLevel();
+    for (auto level : { hl::SimdLevel::Scalar, hl::SimdLevel::SSE2, hl::SimdLevel::AVX2, hl::SimdLevel::AVX512 })
+    {
+        if (level > supported)
+            break;
+        hl::SetMaxSimdLevel(level);
+
+        for (int iteration = 0; iteration < 500; iteration++)
+        {
+            const auto patternLen = rng.nextInt<size_t>(1, 40);
+            const auto patternPos = rng.nextInt<size_t>(0, dataLen - patternLen);
+            std::string checkMask;
+            for (size_t i = 0; i < patternLen; i++)
+                checkMask += rng.nextBool(0.8) ? 'x' : '?';
+            const char* byteMask = data + patternPos;
+
+            // Windows that end at the guard page check for out of bounds reads.
+            const auto begin = rng.nextInt<size_t>(0, dataLen);
+            const auto len = rng.nextBool() ? dataLen - begin : rng.nextInt<size_t>(0, dataLen - begin);
+            const auto instance = rng.nextInt(0, 3);
+
+            auto expected =
+                ReferenceFindPatternMask(byteMask, checkMask.c_str(), (uintptr_t)data + begin, len, instance);
+            auto result = hl::FindPatternMask(byteMask, checkMask.c_str(), (uintptr_t)data + begin, len, instance);
+            HL_ASSERT(result == expected, "SIMD level %i: result differs from reference", (int)level);
+        }
+
+        // Partial masks and gaps.
+        for (int iteration = 0; iteration < 200; iteration++)
+        {
+            std::vector<ReferenceToken> tokens;
+            std::string pattern;
+            const auto numTokens = rng.nextInt<size_t>(1, 16);
+            for (size_t pos = rng.nextInt<size_t>(0, dataLen - 1); tokens.size() < numTokens && pos < dataLen; pos++)
+            {
+                ReferenceToken token = {};
+                if (!tokens.empty() && rng.nextBool(0.2))
+                {
+                    token.gapMin = rng.nextInt<size_t>(0, 2);
+                    token.gapMax = token.gapMin + rng.nextInt<size_t>(0, 3);
+                    pattern += " [" + std::to_string(token.gapMin) + "-" + std::to_string(token.gapMax) + "]";
+                    pos += rng.nextInt(token.gapMin, token.gapMax);
+                    if (pos >= dataLen)
+                        break;
+                }
+
+                const auto byte = (uint8_t)data[pos];
+                char tokenStr[8];
+                switch (rng.nextInt(0, 4))
+                {
+                case 0:
+                    token.mask = 0xff;
+                    snprintf(tokenStr, sizeof(tokenStr), "%02x", byte);
+                    break;
+                case 1:
+                    token.mask = 0x00;
+                    snprintf(tokenStr, sizeof(tokenStr), "??");
+                    break;
+                case 2:
+                    token.mask = 0xf0;
+                    snprintf(tokenStr, sizeof(tokenStr), "%x?", byte >> 4);
+                    break;
+                case 3:
+                    token.mask = 0x0f;
+                    snprintf(tokenStr, sizeof(tokenStr), "?%x", byte & 0xf);
+                    break;
+                default:
+                    token.mask = (uint8_t)rng.nextInt(0, 255);
+                    snprintf(tokenStr, sizeof(tokenStr), "%02x/%02x", byte, token.mask);
+                    break;
+                }
+                token.value = byte & token.mask;
+                pattern += (pattern.empty() ? "" : " ") + std::string(tokenStr);
+                tokens.push_back(token);
+            }
+
+            const auto begin = rng.nextInt<size_t>(0, dataLen);
+            const auto len = rng.nextBool() ? dataLen - begin : rng.nextInt<size_t>(0, dataLen - begin);
+            const auto instance = rng.nextInt(0, 3);
+
+            uintptr_t expected = 0;
+            auto remaining = instance;
+            for (size_t offset = 0; offset < len && !expected; offset++)
+            {
+                const auto* cur = (const uint8_t*)data + begin + offset;
+                if (ReferenceMatchTokens(cur, (const uint8_t*)data + begin + len, tokens) && !remaining--)
+                    expected = (uintptr_t)cur;
+            }
+            auto result = hl::FindPattern(pattern, (uintptr_t)data + begin, len, instance);
+            HL_ASSERT(result == expected, "SIMD level %i: result differs from reference for %s", (int)level,
+                      pattern.c_str());
+        }
+    }
+    hl::SetMaxSimdLevel(hl::SimdLevel::AVX512);
+}
+
+static void TestPatternScanParallel()
+{
+    const size_t dataLen = 0x900000;
+    hl::data_page_vector<char> data(dataLen);
+    uint32_t seed = 4321;
+    for (auto& c : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        c = (char)(seed >> 16);
+    }
+
+    // Place matches across the 1 MiB chunk boundaries.
+    const char bait[] = "\x12\x34\x56\x78\x9a\xbc\xde\xf0";
+    for (size_t chunk = 1; chunk < 8; chunk++)
+        std::copy(bait, bait + 8, data.begin() + (std::ptrdiff_t)(chunk * 0x100000 - chunk));
+
+    const auto adr = (uintptr_t)data.data();
+    std::vector<uintptr_t> expected;
+    for (int instance = 0; instance < 9; instance++)
+        expected.push_back(hl::FindPattern("12 34 ?? 78 9a bc de f0", adr, dataLen, instance));
+    const auto expectedShort = hl::FindPattern("12 34", adr, dataLen, 20);
+    HL_ASSERT(expected[6] == adr + 7 * 0x100000 - 7 && expected[7] == 0, "Sequential scan failed");
+
+    hl::SetScanThreads(4);
+    for (int instance = 0; instance < 9; instance++)
+    {
+        HL_ASSERT(hl::FindPattern("12 34 ?? 78 9a bc de f0", adr, dataLen, instance) == expected[instance],
+                  "Parallel scan differs for instance %i", instance);
+    }
+    HL_ASSERT(hl::FindPattern("12 34", adr, dataLen, 20) == expectedShort, "Parallel scan differs");
+    hl::SetScanThreads(1);
+}
+
+// Formats the code at adr as pattern string. Every wildcardEvery-th byte is a wildcard.
+static std::string MakePatternString(uintptr_t adr, size_t len, size_t wildcardEvery)
+{
+    std::string pattern;
+    for (size_t i = 0; i < len; i++)
+    {
+        char byteStr[4];
+        if (i % wildcardEvery == wildcardEvery - 1)
+            snprintf(byteStr, sizeof(byteStr), "??");
+        else
+            snprintf(byteStr, sizeof(byteStr), "%02x", *(const uint8_t*)(adr + i));
+        pattern += (i ? " " : "") + std::string(byteStr);
+    }
+    return pattern;
+}
+
+static const char* GetReferencedString1()
+{
+    return "hacklib referenced string one";
+}
+static const char* GetReferencedString2()
+{
+    return "hacklib referenced string two";
+}
+
+static void TestPatternScanMulti()
+{
+    const auto moduleName = hl::GetCurrentModulePath();
+    const std::vector<std::string> patterns = {
+        MakePatternString((uintptr_t)&TestModules, 16, 4),
+        MakePatternString((uintptr_t)&TestPatch, 12, 100),
+        "de ad be ef 13 37 c0 de 13 37 ?? ca fe ba be",
+        MakePatternString((uintptr_t)&TestPatternScanSimd + 3, 24, 5),
+        MakePatternString((uintptr_t)&TestModules, 16, 4),
+        "?? ??",
+        MakePatternString((uintptr_t)&TestMemory, 2, 100),
+    };
+
+    hl::PatternScanner scanner;
+    auto results = scanner.findPatterns(patterns, moduleName);
+
+    HL_ASSERT(results.size() == patterns.size(), "Wrong number of results");
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        HL_ASSERT(results[i] == hl::FindPattern(patterns[i], moduleName), "Differs from hl::FindPattern: %s",
+                  patterns[i].c_str());
+    }
+    HL_ASSERT(results[0] && results[0] <= (uintptr_t)&TestModules, "Pattern not found");
+    HL_ASSERT(results[1] && results[1] <= (uintptr_t)&TestPatch, "Pattern not found");
+    HL_ASSERT(results[4] == results[0], "Duplicate patterns must give the same result");
+
+    ExpectException<std::runtime_error>([&] { scanner.findPatterns(std::vector<std::string>{ "12 g4" }, moduleName); });
+
+    const std::vector<std::string> strings = { GetReferencedString2(), GetReferencedString1(), GetReferencedString2() };
+    auto refs = scanner.find(strings, moduleName);
+    HL_ASSERT(refs.size() == strings.size(), "Wrong number of results");
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        HL_ASSERT(refs[i] && refs[i] == scanner.findString(strings[i], moduleName), "Differs from findString: %s",
+                  strings[i].c_str());
+    }
+    HL_ASSERT(refs[1] > (uintptr_t)&GetReferencedString1 && refs[1] < (uintptr_t)&GetReferencedString2,
+              "Reference not in function");
+    HL_ASSERT(refs[0] == refs[2], "Duplicate strings must give the same result");
+    HL_ASSERT(scanner.findString(strings[1], moduleName, -1) == refs[1], "Negative instance must give the first");
+
+    // Alter the string so that it does not occur in the test binary itself.
+    std::string missing = "hacklib string that does not exist";
+    missing.back() = 'T';
+    ExpectException<std::runtime_error>([&] { scanner.find({ missing }, moduleName); });
+}
+
+static void TestPatternScanAsync()
+{
+    const auto moduleName = hl::GetCurrentModulePath();
+    const auto pattern = MakePatternString((uintptr_t)&TestModules, 16, 4);
+    const auto expected = hl::FindPattern(pattern, moduleName);
+
+    size_t lastDone = 0;
+    size_t lastTotal = 0;
+    bool monotonic = true;
+    hl::AsyncScanOptions options;
+    options.onProgress = [&](size_t done, size_t total)
+    {
+        monotonic = monotonic && done >= lastDone && done <= total;
+        lastDone = done;
+        lastTotal = total;
+    };
+    HL_ASSERT(hl::FindPatternAsync(pattern, moduleName, 0, options).get() == expected, "Async scan differs");
+    HL_ASSERT(monotonic && lastTotal > 0 && lastDone == lastTotal, "Wrong progress");
+
+    // Instances across chunks, also with parallel scanning where the scan runs on the scan pool.
+    for (unsigned numThreads : { 1, 4 })
+    {
+        hl::SetScanThreads(numThreads);
+        for (int instance : { 0, 3000, 30000 })
+        {
+            HL_ASSERT(hl::FindPatternAsync(hl::Pattern<"e8 ?? ?? ?? ??">(), moduleName, instance).get() ==
+                          hl::FindPattern("e8 ?? ?? ?? ??", moduleName, instance),
+                      "Async scan differs for instance %i", instance);
+        }
+    }
+    hl::SetScanThreads(1);
+
+    // The instance is counted within each code region. Split the code of the module by changing the protection of
+    // one page.
+    const auto splitPage = (uintptr_t)&TestModules & ~(uintptr_t)(hl::GetPageSize() - 1);
+    hl::PageProtect((void*)splitPage, 1, hl::PROTECTION_READ_WRITE_EXECUTE);
+    hl::GetModuleRegistry().invalidate();
+    HL_ASSERT(hl::GetCodeRegions(moduleName).size() >= 2, "Code regions were not split");
+    for (int instance : { 0, 3000, 30000 })
+    {
+        HL_ASSERT(hl::FindPatternAsync(hl::Pattern<"e8 ?? ?? ?? ??">(), moduleName, instance).get() ==
+                      hl::FindPattern("e8 ?? ?? ?? ??", moduleName, instance),
+                  "Async scan of split code differs for instance %i", instance);
+    }
+    hl::PageProtect((void*)splitPage, 1, hl::PROTECTION_READ_EXECUTE);
+    hl::GetModuleRegistry().invalidate();
+
+    ExpectException<std::runtime_error>([&] { (void)hl::FindPatternAsync("12 g4", moduleName); });
+    auto noModule = hl::FindPatternAsync(pattern, "hacklib module that does not exist");
+    ExpectException<std::runtime_error>([&] { noModule.get(); });
+
+    hl::AsyncScanOptions cancelled;
+    cancelled.cancellation.cancel();
+    auto cancelledScan = hl::FindPatternAsync(pattern, moduleName, 0, cancelled);
+    ExpectException<std::runtime_error>([&] { cancelledScan.get(); });
+
+    // Cancel while the scan is running.
+    hl::AsyncScanOptions cancelledLater;
+    cancelledLater.onProgress = [token = cancelledLater.cancellation](size_t, size_t) mutable { token.cancel(); };
+    auto cancelledLaterScan = hl::FindPatternAsync("de ad be ef 13 37 c0 de 13 37", moduleName, 0, cancelledLater);
+    ExpectException<std::runtime_error>([&] { cancelledLaterScan.get(); });
+
+    hl::PatternScanner scanner;
+    const std::vector<std::string> strings = { GetReferencedString1(), GetReferencedString2() };
+    lastDone = lastTotal = 0;
+    auto refs = scanner.findAsync(strings, moduleName, options).get();
+    HL_ASSERT(refs == scanner.find(strings, moduleName), "Async string scan differs");
+    HL_ASSERT(monotonic && lastTotal > 0 && lastDone == lastTotal, "Wrong progress");
+}
+
+static void TestScanRegions()
+{
+    const auto pageSize = hl::GetPageSize();
+    const size_t memSize = 0x300000;
+    auto mem = (uint8_t*)hl::PageAlloc(memSize, hl::PROTECTION_READ_WRITE);
+    const auto base = (uintptr_t)mem;
+    auto inMem = [&](const hl::MemoryRegion& region)
+    { return region.base < base + memSize && base < region.base + region.size; };
+
+    // Matches within a region, across the 1 MiB chunk boundary and at the very end.
+    const uint8_t match[] = { 0x4d, 0x3c, 0x2b, 0x1a, 0x00, 0x1a, 0x2b, 0x3c, 0x4d };
+    const std::vector<size_t> offsets = { 100, 0x100000 - 4, memSize - sizeof(match) };
+    for (size_t offset : offsets)
+        memcpy(mem + offset, match, sizeof(match));
+    std::vector<uintptr_t> expected;
+    for (size_t offset : offsets)
+        expected.push_back(base + offset);
+
+    auto inRange = [&](const std::vector<uintptr_t>& results)
+    {
+        std::vector<uintptr_t> filtered;
+        std::ranges::copy_if(results, std::back_inserter(filtered),
+                             [&](uintptr_t adr) { return adr >= base && adr < base + memSize; });
+        return filtered;
+    };
+    const char* pattern = "4d 3c 2b 1a ?? 1a 2b [0-2] 4d";
+    HL_ASSERT(inRange(hl::ScanRegions(inMem, pattern)) == expected, "Wrong matches");
+    hl::SetScanThreads(4);
+    HL_ASSERT(inRange(hl::ScanRegions(inMem, pattern)) == expected, "Parallel scan differs");
+    hl::SetScanThreads(1);
+
+    // Unreadable memory is skipped without faulting.
+    hl::PageProtect(mem, pageSize, hl::PROTECTION_NOACCESS);
+    HL_ASSERT(inRange(hl::ScanRegions([](const hl::MemoryRegion&) { return true; }, pattern)) ==
+                  std::vector<uintptr_t>(expected.begin() + 1, expected.end()),
+              "Wrong matches in all memory");
+    hl::PageFree(mem, memSize);
+
+#ifndef WIN32
+    // The pages of a file mapping beyond the end of the file fault.
+    const char* fileName = "hl_test_scan_regions.bin";
+    std::vector<uint8_t> fileData(pageSize + 16, 0);
+    memcpy(fileData.data() + 8, match, sizeof(match));
+    std::ofstream(fileName, std::ios::binary).write((const char*)fileData.data(), (std::streamsize)fileData.size());
+    const int fd = open(fileName, O_RDONLY);
+    HL_ASSERT(fd != -1, "Could not open file");
+    void* mapping = mmap(nullptr, 4 * pageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    HL_ASSERT(mapping != MAP_FAILED, "Could not map file");
+    const auto mappingAdr = (uintptr_t)mapping;
+    auto inMapping = [&](const hl::MemoryRegion& region) { return region.base == mappingAdr; };
+
+    const auto region = hl::GetMemoryByAddress(mappingAdr);
+    HL_ASSERT(region.size == 4 * pageSize && hl::GetReadableSize(region) == 2 * pageSize,
+              "Wrong readable size");
+    HL_ASSERT(hl::ScanRegions(inMapping, pattern) == std::vector<uintptr_t>{ mappingAdr + 8 }, "Wrong matches");
+
+    munmap(mapping, 4 * pageSize);
+    close(fd);
+    std::remove(fileName);
+#endif
+
+    // A large reservation where only two pages were written.
+    const size_t reserveSize = 0x4000000;
+    auto reserved = (uint8_t*)hl::PageReserve(reserveSize);
+    hl::PageCommit(reserved, reserveSize, hl::PROTECTION_READ_WRITE);
+    const auto reservedAdr = (uintptr_t)reserved;
+    memcpy(reserved + 5 * pageSize + 10, match, sizeof(match));
+    memcpy(reserved + reserveSize - pageSize, match, sizeof(match));
+    const std::vector<uintptr_t> reservedExpected = { reservedAdr + 5 * pageSize + 10,
+                                                      reservedAdr + reserveSize - pageSize };
+    auto inReserved = [&](const hl::MemoryRegion& region)
+    { return region.base < reservedAdr + reserveSize && reservedAdr < region.base + region.size; };
+    auto onlyReserved = [&](const std::vector<uintptr_t>& results)
+    {
+        std::vector<uintptr_t> filtered;
+        std::ranges::copy_if(results, std::back_inserter(filtered), [&](uintptr_t adr)
+                             { return adr >= reservedAdr && adr < reservedAdr + reserveSize; });
+        return filtered;
+    };
+
+    hl::SetSkipUnpopulatedPages(true);
+    HL_ASSERT(onlyReserved(hl::ScanRegions(inReserved, pattern)) == reservedExpected, "Wrong matches");
+    HL_ASSERT(onlyReserved(hl::ScanRegions(inReserved, "00 00 00 00")).size() < 2 * pageSize,
+              "Unpopulated pages were scanned");
+#ifndef WIN32
+    const auto populated = hl::GetPopulatedPages(reservedAdr, reserveSize);
+    HL_ASSERT(std::ranges::count(populated, 1) == 2, "Scan populated pages");
+#endif
+    hl::SetSkipUnpopulatedPages(false);
+    HL_ASSERT(onlyReserved(hl::ScanRegions(inReserved, pattern)) == reservedExpected, "Wrong matches");
+    hl::PageFree(reserved, reserveSize);
+}
+
+static void TestGenerateSignature()
+{
+    const auto moduleName = hl::GetCurrentModulePath();
+
+    for (auto adr : { (uintptr_t)&TestPatch, (uintptr_t)&TestModules + 5, (uintptr_t)&GetReferencedString2 })
+    {
+        const auto signature = hl::GenerateSignature(adr, moduleName);
+        HL_ASSERT(hl::FindPattern(signature, moduleName) == adr, "Wrong signature: %s", signature.c_str());
+        HL_ASSERT(std::ranges::distance(hl::FindAllPatterns(signature, moduleName)) == 1, "Not unique: %s",
+                  signature.c_str());
+        // It is the shortest one.
+        const auto shorter = signature.substr(0, signature.size() - 3);
+        HL_ASSERT(shorter.empty() || std::ranges::distance(hl::FindAllPatterns(shorter, moduleName)) > 1,
+                  "Not shortest: %s", signature.c_str());
+    }
+
+#ifdef ARCH_64BIT
+    // The displacement of RIP-relative operands is a wildcard.
+    const auto lea = hl::FindPattern("48 8d 05", (uintptr_t)&GetReferencedString1, 32);
+    if (lea)
+    {
+        const auto signature = hl::GenerateSignature(lea, moduleName);
+        HL_ASSERT(signature.starts_with("48 8d 05 ?? ?? ?? ??"), "Displacement not wildcarded: %s", signature.c_str());
+    }
+#endif
+
+    ExpectException<std::runtime_error>([&] { hl::GenerateSignature((uintptr_t)&g_dummyCode, moduleName); });
+}
+
+static void TestCodeIndex()
+{
+    // Two regions of code-like bytes with a shared sequence in both.
+    std::vector<uint8_t> code(0x3000);
+    uint32_t seed = 1;
+    for (auto& byte : code)
+    {
+        seed = seed * 1664525 + 1013904223;
+        byte = (uint8_t)(seed >> 24) & 0x1f;
+    }
+    const uint8_t shared[] = { 0x48, 0x8b, 0x05, 0x11, 0x22, 0x33, 0x44, 0xe8 };
+    memcpy(&code[0x100], shared, sizeof(shared));
+    memcpy(&code[0x2100], shared, sizeof(shared));
+
+    hl::MemoryRegion regions[2];
+    regions[0].base = (uintptr_t)code.data();
+    regions[0].size = 0x1000;
+    regions[1].base = (uintptr_t)code.data() + 0x2000;
+    regions[1].size = 0x1000;
+    const hl::CodeIndex index(regions);
+    HL_ASSERT(index.size() == 0x2000, "Wrong size");
+
+    auto expectSame = [&](const std::string& pattern)
+    {
+        std::vector<uintptr_t> expected;
+        for (const auto& region : regions)
+            std::ranges::copy(hl::FindAllPatterns(pattern, region.base, region.size), std::back_inserter(expected));
+        HL_ASSERT(index.find(pattern) == expected, "Differs from hl::FindAllPatterns: %s", pattern.c_str());
+        return expected.size();
+    };
+    HL_ASSERT(expectSame("48 8b 05 ?? ?? ?? ?? e8") == 2, "Shared sequence");
+    HL_ASSERT(expectSame("48 8b 05") == 2, "Shared sequence");
+    expectSame("01 02");
+    expectSame("1f ?? ?? 03 ?? 1e");
+    expectSame("?? ??");
+    // Crosses the end of the first region.
+    expectSame(MakePatternString((uintptr_t)&code[0xffe], 4, 100));
+
+    for (size_t offset : { 0x10, 0x100, 0x104, 0xffc })
+    {
+        const uintptr_t adr = regions[0].base + offset;
+        const size_t len = index.uniqueLength(adr);
+        HL_ASSERT(len && expectSame(MakePatternString(adr, len, 100)) == 1, "Not unique at %zx", offset);
+        HL_ASSERT(len == 1 || expectSame(MakePatternString(adr, len - 1, 100)) > 1, "Not shortest at %zx", offset);
+    }
+    HL_ASSERT(index.uniqueLength(regions[0].base + 0x1fff) == 0, "Not indexed");
+}
+
+static void TestPatternScanFile()
+{
+    const auto modulePath = hl::GetCurrentModulePath();
+    const auto hModule = (uintptr_t)hl::GetModuleByName(modulePath);
+    hl::ExeFile file;
+    HL_ASSERT(file.loadFromFile(modulePath), "ExeFile::loadFromFile failed");
+
+    // The code of the file is the same as the loaded code of the module.
+    const auto pattern = hl::Pattern<"e8 ?? ?? ?? ?? [0-4] 48 8b">();
+    std::vector<uintptr_t> expected;
+    for (uintptr_t adr : hl::FindAllPatterns(pattern, modulePath))
+        expected.push_back(adr - hModule);
+    const auto results = hl::FindAllPatterns(pattern, file);
+    HL_ASSERT(expected.size() > 10 && results == expected, "Offline matches differ");
+    HL_ASSERT(hl::FindPattern(pattern, file, 10) == expected[10], "Offline instance differs");
+    const auto signature = MakePatternString((uintptr_t)&TestModules, 16, 4);
+    HL_ASSERT(hl::FindPattern(signature, file) == hl::FindPattern(signature, modulePath) - hModule,
+              "Offline signature differs");
+
+    // A string literal of the test would be referenced itself.
+    std::string missing = GetReferencedString1();
+    missing.back() = 'X';
+    const std::vector<std::string> strings = { GetReferencedString1(), missing, GetReferencedString2() };
+    hl::PatternScanner scanner;
+    const auto refs = hl::FindStringReferences(strings, file);
+    HL_ASSERT(refs[0] == scanner.findString(strings[0], modulePath) - hModule, "Offline reference differs");
+    HL_ASSERT(refs[1] == 0, "Missing string");
+    HL_ASSERT(refs[2] == scanner.findString(strings[2], modulePath) - hModule, "Offline reference differs");
+
+    const std::string paths[] = { modulePath, modulePath };
+    const std::string patterns[] = { "e8 ?? ?? ?? ??", signature, "de ad be ef 13 37 c0 de 13 37 ?? ca fe ba be" };
+    const auto batch = hl::FindPatternsInFiles(paths, patterns, 2);
+    HL_ASSERT(batch.size() == 2 && batch[0] == batch[1], "Batch results differ");
+    HL_ASSERT(batch[0][0] == hl::FindPattern(patterns[0], file), "Batch result differs");
+    HL_ASSERT(batch[0][1] == (uintptr_t)&TestModules - hModule, "Batch result differs");
+    HL_ASSERT(batch[0][2] == 0, "Should not find this");
+
+    ExpectException<std::runtime_error>(
+        [&] { (void)hl::FindPatternsInFiles(std::vector<std::string>{ "does/not/exist" }, patterns); });
+}
+
+static void TestIncrementalScanner()
+{
+    const auto pageSize = hl::GetPageSize();
+    const size_t numPages = 16;
+    auto mem = (uint8_t*)hl::PageAlloc(numPages * pageSize, hl::PROTECTION_READ_WRITE_EXECUTE);
+    const auto base = (uintptr_t)mem;
+    auto filter = [&](const hl::MemoryRegion& region)
+    { return region.base < base + numPages * pageSize && base < region.base + region.size; };
+
+    std::vector<hl::IncrementalScanner::Tracking> trackings = { hl::IncrementalScanner::Tracking::PageHash };
+    if (hl::IncrementalScanner::IsSoftDirtySupported())
+        trackings.push_back(hl::IncrementalScanner::Tracking::SoftDirty);
+
+    for (auto tracking : trackings)
+    {
+        memset(mem, 0, numPages * pageSize);
+        hl::IncrementalScanner scanner("de ad [0-2] be ef", tracking, filter);
+        HL_ASSERT(scanner.tracking() == tracking, "Wrong tracking");
+        HL_ASSERT(scanner.update().empty(), "Should not find this");
+        HL_ASSERT(scanner.lastScannedBytes() >= numPages * pageSize, "First update must scan everything");
+
+        // One match within a page and one across a page boundary.
+        const uint8_t match[] = { 0xde, 0xad, 0x00, 0xbe, 0xef };
+        memcpy(mem + 3 * pageSize + 100, match, sizeof(match));
+        memcpy(mem + 9 * pageSize - 2, match, sizeof(match));
+        const std::vector<uintptr_t> expected = { base + 3 * pageSize + 100, base + 9 * pageSize - 2 };
+        HL_ASSERT(scanner.update() == expected, "New matches not found");
+        HL_ASSERT(scanner.lastScannedBytes() < 4 * pageSize, "Unchanged pages were scanned");
+
+        HL_ASSERT(scanner.update().empty() && scanner.lastScannedBytes() == 0, "Nothing changed");
+
+        // Remove one match and change the other one, which is not new.
+        mem[3 * pageSize + 100] = 0;
+        mem[9 * pageSize] = 0xbe;
+        mem[9 * pageSize + 1] = 0xef;
+        HL_ASSERT(scanner.update().empty(), "Changed match is not new");
+        HL_ASSERT(scanner.matches().size() == 1 && *scanner.matches().begin() == expected[1], "Wrong matches");
+    }
+
+    hl::PageFree(mem, numPages * pageSize);
+}
+
+static void TestModuleRegistry()
+{
+#ifdef WIN32
+    const std::string libName = "version.dll";
+    auto loadLib = [&] { return (void*)LoadLibraryA(libName.c_str()); };
+    auto unloadLib = [](void* handle) { FreeLibrary((HMODULE)handle); };
+#else
+    const std::string libName = "libresolv.so.2";
+    auto loadLib = [&] { return dlopen(libName.c_str(), RTLD_NOW | RTLD_LOCAL); };
+    auto unloadLib = [](void* handle) { dlclose(handle); };
+#endif
+
+    auto& registry = hl::GetModuleRegistry();
+    const auto first = registry.snapshot();
+    HL_ASSERT(registry.snapshot() == first, "Snapshot must be reused while no module was loaded");
+    HL_ASSERT(!first->codeRegions(hl::GetCurrentModule()).empty(), "No code regions of the own module");
+    const auto [moduleBegin, moduleEnd] = first->moduleExtent(hl::GetCurrentModule());
+    const auto ownFuncAdr = (uintptr_t)&TestModuleRegistry;
+    HL_ASSERT(moduleBegin <= ownFuncAdr && ownFuncAdr < moduleEnd,
+              "Wrong module extent");
+
+    registry.invalidate();
+    const auto invalidated = registry.snapshot();
+    HL_ASSERT(invalidated->generation() > first->generation(), "Invalidate must cause a refresh");
+
+    // Resolved module names are reused without copying the regions.
+    const auto ownName = hl::GetCurrentModulePath();
+    const auto ownRegions = registry.findCodeRegions(ownName);
+    const auto& ownCodeRegions = hl::GetCodeRegions(ownName);
+    HL_ASSERT(ownRegions.regions.size() == ownCodeRegions.size() &&
+                  ownRegions.regions.front().base == ownCodeRegions.front().base,
+              "Found code regions differ");
+    HL_ASSERT(registry.findCodeRegions(ownName).regions.data() == ownRegions.regions.data(),
+              "Resolved module name must be reused");
+
+    HL_ASSERT(!hl::GetModuleByName(libName), "Test library is already loaded");
+    void* handle = loadLib();
+    HL_ASSERT(handle, "Could not load test library");
+    HL_ASSERT(!hl::GetCodeRegions(libName).empty(), "Loaded module not detected");
+    HL_ASSERT(registry.snapshot()->generation() > invalidated->generation(), "Load must cause a refresh");
+    unloadLib(handle);
+    bool thrown = false;
+    try
+    {
+        (void)hl::GetCodeRegions(libName);
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    HL_ASSERT(thrown, "Unloaded module not detected");
+    HL_ASSERT(ownCodeRegions.front().base == hl::GetCodeRegions(ownName).front().base,
+              "Code regions must stay valid after a refresh");
+
+    // Scan concurrently while a module is loaded and unloaded.
+    const auto moduleName = hl::GetCurrentModulePath();
+    const auto pattern = MakePatternString((uintptr_t)&TestModules, 16, 4);
+    const auto expected = hl::FindPattern(pattern, moduleName);
+    std::atomic<bool> stop = false;
+    std::atomic<int> numErrors = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+    {
+        threads.emplace_back(
+            [&]
+            {
+                while (!stop)
+                {
+                    if (hl::FindPattern(pattern, moduleName) != expected)
+                        numErrors++;
+                    const auto snapshot = hl::GetModuleRegistry().snapshot();
+                    if (snapshot->codeRegions(hl::GetCurrentModule()).empty())
+                        numErrors++;
+                }
+            });
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        handle = loadLib();
+        HL_ASSERT(handle, "Could not load test library");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        unloadLib(handle);
+    }
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    HL_ASSERT(numErrors == 0, "Concurrent scans failed");
+}
+
+static void TestScanCache()
+{
+    const auto moduleName = hl::GetCurrentModulePath();
+    const std::string path = "hl_test_scan_cache.bin";
+    std::remove(path.c_str());
+
+    const auto pattern = MakePatternString((uintptr_t)&GetReferencedString1, 12, 4);
+    const auto expected = hl::FindPattern(pattern, moduleName);
+    const std::vector<std::string> strings = { GetReferencedString1(), GetReferencedString2() };
+    const auto expectedRefs = hl::PatternScanner().find(strings, moduleName);
+
+    auto cache = std::make_shared<hl::ScanCache>(path);
+    hl::SetScanCache(cache);
+    HL_ASSERT(hl::FindPattern(pattern, moduleName) == expected, "Miss");
+    HL_ASSERT(hl::PatternScanner().find(strings, moduleName) == expectedRefs, "Miss");
+    HL_ASSERT(cache->size() == 3, "Results not stored: %zu", cache->size());
+
+    // Results persist in the file.
+    hl::SetScanCache(nullptr);
+    cache.reset();
+    cache = std::make_shared<hl::ScanCache>(path);
+    hl::SetScanCache(cache);
+    HL_ASSERT(cache->size() == 3, "Results not loaded: %zu", cache->size());
+    HL_ASSERT(hl::FindPattern(pattern, moduleName) == expected, "Hit");
+    HL_ASSERT(hl::PatternScanner().find(strings, moduleName) == expectedRefs, "Hit");
+    HL_ASSERT(hl::PatternScanner().findString(strings[1], moduleName) == expectedRefs[1], "Hit");
+
+    {
+        // Outdated results must be detected.
+        hl::Patch patch;
+        patch.apply(expected, (uint8_t)~*(const uint8_t*)expected);
+        hl::SetScanCache(nullptr);
+        const auto expectedPatched = hl::FindPattern(pattern, moduleName);
+        hl::SetScanCache(cache);
+        HL_ASSERT(hl::FindPattern(pattern, moduleName) == expectedPatched, "Outdated result");
+    }
+
+    hl::SetScanCache(nullptr);
+    cache.reset();
+    std::remove(path.c_str());
+}
+
+static void TestXrefIndex()
+{
+    // Synthetic code with one reference of each type to the end of the buffer.
+    std::vector<uint8_t> code(0x100, 0x90);
+    const auto base = (uintptr_t)code.data();
+    const uintptr_t target = base + 0xf0;
+    auto emit = [&](size_t offset, std::initializer_list<uint8_t> opcode, bool relative = true)
+    {
+        std::ranges::copy(opcode, code.begin() + (ptrdiff_t)offset);
+        const uintptr_t next = base + offset + opcode.size() + 4;
+        const auto disp = (int32_t)(relative ? target - next : target);
+        memcpy(code.data() + offset + opcode.size(), &disp, 4);
+    };
+    emit(0x10, { 0xe8 });
+    emit(0x20, { 0xe9 });
+    emit(0x30, { 0x0f, 0x84 });
+    emit(0x41, { 0xe8 });
+#ifdef ARCH_64BIT
+    emit(0x50, { 0x48, 0x8d, 0x05 });
+    emit(0x60, { 0x4c, 0x8b, 0x15 });
+#else
+    emit(0x50, { 0x8d, 0x05 }, false);
+    emit(0x60, { 0x8b, 0x15 }, false);
+#endif
+    // A call out of the target range must not be recorded.
+    code[0x70] = 0xe8;
+    // Instructions that end with the region are recorded.
+    emit(0xfb, { 0xe8 });
+
+    hl::MemoryRegion region;
+    region.status = hl::MemoryRegion::Status::Valid;
+    region.base = base;
+    region.size = code.size();
+    const hl::XrefIndex index({ &region, 1 }, base, base + code.size());
+
+    HL_ASSERT(index.size() == 7, "Wrong number of references: %zu", index.size());
+    const auto refs = index.referencesTo(target);
+    const std::vector<uintptr_t> expected = { base + 0x10, base + 0x20, base + 0x30, base + 0x41,
+                                              base + 0x50, base + 0x60, base + 0xfb };
+    HL_ASSERT(refs == expected, "Wrong references");
+    const auto callers = index.callersOf(target);
+    HL_ASSERT(callers.size() == 3 && callers[0] == base + 0x10 && callers[1] == base + 0x41 &&
+                  callers[2] == base + 0xfb,
+              "Wrong callers");
+
+    // A region that only holds the call. A jump that would run past its end is not recorded.
+    region.base = base + 0xfb;
+    region.size = 5;
+    HL_ASSERT(hl::XrefIndex({ &region, 1 }, base, base + code.size()).size() == 1, "Call at region end not found");
+    region.base = base + 0x30;
+    region.size = 5;
+    HL_ASSERT(hl::XrefIndex({ &region, 1 }, base, base + code.size()).size() == 0, "Truncated jump recorded");
+    HL_ASSERT(index.referencesTo(target, hl::XrefType::Load).size() == 1, "Wrong loads");
+    HL_ASSERT(index.referencesTo(target + 1).empty(), "Should not find this");
+
+    const hl::XrefIndex moduleIndex(hl::GetCurrentModulePath());
+    HL_ASSERT(moduleIndex.size() > 0, "No references in module");
 }
 
 static int cbCounter = 0;
@@ -486,6 +1421,50 @@ static void TestHooks()
     HL_ASSERT(cbCounter == 0, "Hook not undone");
     HL_ASSERT(result == 5, "Detour unhook broke the function");
 
+    // Short offsets need the hook or the wrapper code within reach of a relative jump.
+    detourHook = hooker.hookDetour(g_dummyCode.data(), g_dummyShortHookOffset, &DetourFunc);
+    HL_ASSERT(detourHook, "Detour hook with relative jump failed");
+    HL_ASSERT(g_dummyCode[0] == 0xe9, "Detour hook did not use a relative jump");
+
+    cbCounter = 0;
+    result = dummyFunc();
+    HL_ASSERT(cbCounter == 1, "Detour hook with relative jump had no effect");
+    HL_ASSERT(result == 5, "Detour hook with relative jump broke the function");
+
+    hooker.unhook(detourHook);
+
+    jmpHook = hooker.hookJMP(g_dummyCode.data(), g_dummyShortHookOffset, &CallbackFunc);
+    HL_ASSERT(jmpHook, "JMP hook with relative jump failed");
+
+    cbCounter = 0;
+    dummyFunc();
+    HL_ASSERT(cbCounter == 1, "JMP hook with relative jump had no effect");
+
+    hooker.unhook(jmpHook);
+
+    cbCounter = 0;
+    result = dummyFunc();
+    HL_ASSERT(cbCounter == 0, "Hook not undone");
+    HL_ASSERT(result == 5, "JMP unhook broke the function");
+
+    // The jump to itself that makes arriving threads wait can not be written atomically across an 8-byte boundary, so
+    // the other threads are suspended instead.
+    hl::code_page_vector unalignedCode(64, 0xcc);
+    std::ranges::copy(g_dummyCode, unalignedCode.begin() + 7);
+    auto unalignedFunc = (int (*)()) & unalignedCode[7];
+    detourHook = hooker.hookDetour(&unalignedCode[7], g_dummyHookOffset, &DetourFunc);
+    HL_ASSERT(detourHook, "Detour hook across an 8-byte boundary failed");
+
+    cbCounter = 0;
+    result = unalignedFunc();
+    HL_ASSERT(cbCounter == 1 && result == 5, "Detour hook across an 8-byte boundary failed");
+
+    hooker.unhook(detourHook);
+
+    cbCounter = 0;
+    result = unalignedFunc();
+    HL_ASSERT(cbCounter == 0 && result == 5, "Unhook across an 8-byte boundary failed");
+
     auto memVt = hl::PageAlloc(1000, hl::PROTECTION_READ_WRITE_EXECUTE);
     auto memInstance = hl::PageAlloc(1000, hl::PROTECTION_READ_WRITE);
     *(uintptr_t*)memVt = (uintptr_t)g_dummyCode.data();
@@ -509,6 +1488,330 @@ static void TestHooks()
     HL_ASSERT(cbCounter == 0, "Hook not undone");
 }
 
+static std::atomic<int> g_stressCounter = 0;
+static void StressDetourFunc(hl::CpuContext* ctx)
+{
+    g_stressCounter++;
+}
+static void RedirectDetourFunc(hl::CpuContext* ctx)
+{
+#ifdef ARCH_64BIT
+    ctx->RIP = (uintptr_t)g_stressCode.data() + g_stressAltOffset;
+#else
+    ctx->EIP = (uintptr_t)g_stressCode.data() + g_stressAltOffset;
+#endif
+}
+static hl::Hooker* g_selfUnhookHooker = nullptr;
+static const hl::IHook* g_selfUnhookHook = nullptr;
+static void SelfUnhookDetourFunc(hl::CpuContext*)
+{
+    g_selfUnhookHooker->unhook(g_selfUnhookHook);
+    // Would take the slot of the wrapper code that this thread still returns to.
+    g_selfUnhookHook = g_selfUnhookHooker->hookDetour(g_dummyCode.data(), g_dummyHookOffset, &DetourFunc);
+}
+static void TestHooksConcurrent()
+{
+    auto stressFunc = (int (*)())g_stressCode.data();
+
+    hl::Hooker hooker;
+
+    auto redirectHook = hooker.hookDetour(g_stressCode.data(), g_stressHookOffset, &RedirectDetourFunc);
+    HL_ASSERT(stressFunc() == 7, "Detour hook did not apply the changed instruction pointer");
+    hooker.unhook(redirectHook);
+    HL_ASSERT(stressFunc() == 1, "Detour unhook broke the function");
+
+    std::atomic<bool> stop = false;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> callers;
+    for (int i = 0; i < 2; i++)
+    {
+        callers.emplace_back(
+            [&]
+            {
+                while (!stop)
+                {
+                    for (int j = 0; j < 100; j++)
+                    {
+                        if (stressFunc() != 1)
+                            failed = true;
+                    }
+                    // Do not hold a single core for a whole time slice.
+                    std::this_thread::yield();
+                }
+            });
+    }
+
+    for (int i = 0; i < 50; i++)
+    {
+        auto hook = hooker.hookDetour(g_stressCode.data(), g_stressHookOffset, &StressDetourFunc);
+        // Give the callers a chance to run into the hook.
+        const int counter = g_stressCounter;
+        for (int j = 0; j < 1000 && g_stressCounter == counter; j++)
+            std::this_thread::yield();
+        hooker.unhook(hook);
+    }
+    const int counter = g_stressCounter;
+
+    stop = true;
+    for (auto& caller : callers)
+        caller.join();
+
+    HL_ASSERT(!failed, "Detour hook broke the function under load");
+    HL_ASSERT(counter > 0, "Detour hook had no effect under load");
+    HL_ASSERT(g_stressCounter == counter, "Detour callback ran after unhook");
+
+    // The wrapper code of a hook that is removed from within its callback is kept until the thread left it.
+    g_selfUnhookHooker = &hooker;
+    g_selfUnhookHook = hooker.hookDetour(g_stressCode.data(), g_stressHookOffset, &SelfUnhookDetourFunc);
+    HL_ASSERT(stressFunc() == 1, "Unhook from within the callback broke the function");
+    HL_ASSERT(g_selfUnhookHook, "Hook from within the callback failed");
+    hooker.unhook(g_selfUnhookHook);
+
+    // The dispatch slots of exited threads are reused.
+    uint32_t exitedThreadId = 0;
+    std::thread([&] { exitedThreadId = hl::GetCallingThreadId(); }).join();
+    HL_ASSERT(hl::IsThreadAlive(hl::GetCallingThreadId()), "Calling thread not alive");
+    // The operating system may clean up the thread shortly after the join.
+    for (int i = 0; i < 1000 && hl::IsThreadAlive(exitedThreadId); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    HL_ASSERT(!hl::IsThreadAlive(exitedThreadId), "Exited thread still alive");
+}
+
+static void TestTrampolineArena()
+{
+    hl::TrampolineArena arena(100);
+    HL_ASSERT(arena.slotSize() == 128, "Slot size not rounded to cache lines");
+
+    const auto location = (uintptr_t)&TestTrampolineArena;
+    auto first = arena.allocate(location);
+    auto second = arena.allocate(location);
+    HL_ASSERT((uintptr_t)first % hl::TrampolineArena::SlotAlignment == 0, "Slot not aligned");
+    HL_ASSERT(second == first + arena.slotSize(), "Slots not taken from the same block");
+    HL_ASSERT((uintptr_t)first >= location - 0x7fff0000 && (uintptr_t)first <= location + 0x7fff0000,
+              "Slot out of reach");
+    HL_ASSERT(std::all_of(first, first + arena.slotSize(), [](unsigned char c) { return c == 0xcc; }),
+              "Slot not filled with INT3");
+
+    const unsigned char code[] = { 0xb8, 0x03, 0x00, 0x00, 0x00, 0xc3 }; // MOV EAX, 3; RET
+    memcpy(second, code, sizeof(code));
+    HL_ASSERT(((int (*)())second)() == 3, "Slot not executable");
+
+    arena.free(second);
+    HL_ASSERT(arena.allocate(location) == second, "Freed slot not reused");
+
+    const size_t slotsPerBlock = hl::TrampolineArena::DefaultBlockSize / arena.slotSize();
+    std::vector<unsigned char*> slots;
+    for (size_t i = 2; i < slotsPerBlock + 1; i++)
+        slots.push_back(arena.allocate(location));
+    HL_ASSERT(arena.numBlocks() == 2, "Slots not packed into blocks");
+
+    // Many hooks share the pages of the wrapper code.
+    hl::code_page_vector functions(100 * 32, 0xcc);
+    for (size_t i = 0; i < 100; i++)
+        std::ranges::copy(g_dummyCode, functions.begin() + static_cast<std::ptrdiff_t>(i * 32));
+    const auto numRegions = hl::GetMemoryMap().size();
+    hl::Hooker hooker;
+    for (size_t i = 0; i < 100; i++)
+        HL_ASSERT(hooker.hookDetour(&functions[i * 32], g_dummyHookOffset, &DetourFunc), "Detour hook failed");
+    HL_ASSERT(hl::GetMemoryMap().size() < numRegions + 5, "Wrapper code does not share pages");
+
+    cbCounter = 0;
+    HL_ASSERT(((int (*)()) & functions[99 * 32])() == 5, "Detour hook broke the function");
+    HL_ASSERT(cbCounter == 1, "Detour hook had no effect");
+}
+
+static void TestHooksBatch()
+{
+    // A function that waits in a loop until released. The loop is inside the code that is overwritten by the hook,
+    // so a waiting thread must be moved to the wrapper code.
+    static volatile uint8_t release = 0;
+    const auto releaseAdr = (uintptr_t)&release;
+    hl::code_page_vector spinCode(64, 0xcc);
+    size_t pos = 0;
+    spinCode[pos++] = 0x90; // NOP
+    spinCode[pos++] = 0xa0; // MOV AL, [release]
+    memcpy(&spinCode[pos], &releaseAdr, sizeof(releaseAdr));
+    pos += sizeof(releaseAdr);
+    spinCode[pos++] = 0x84; // TEST AL, AL
+    spinCode[pos++] = 0xc0;
+    spinCode[pos++] = 0x74; // JZ loop
+    spinCode[pos] = (uint8_t)(1 - (int)(pos + 1));
+    pos++;
+    const int spinHookOffset = (int)pos;
+    spinCode[pos++] = 0xb8; // MOV EAX, 5
+    spinCode[pos++] = 0x05;
+    spinCode[pos++] = 0x00;
+    spinCode[pos++] = 0x00;
+    spinCode[pos++] = 0x00;
+    spinCode[pos] = 0xc3; // RET
+
+    hl::code_page_vector functions(100 * 32, 0xcc);
+    for (size_t i = 0; i < 100; i++)
+        std::ranges::copy(g_dummyCode, functions.begin() + static_cast<std::ptrdiff_t>(i * 32));
+    auto function = [&](size_t i) { return (int (*)()) & functions[i * 32]; };
+
+    hl::Hooker hooker;
+    hooker.beginBatch();
+    std::vector<const hl::IHook*> hooks;
+    for (size_t i = 0; i < 100; i++)
+        hooks.push_back(hooker.hookDetour(&functions[i * 32], g_dummyHookOffset, &DetourFunc));
+    HL_ASSERT(std::ranges::all_of(hooks, [](const hl::IHook* pHook) { return pHook; }), "Batched hook failed");
+
+    cbCounter = 0;
+    HL_ASSERT(function(0)() == 5 && cbCounter == 0, "Batched hook was applied before commit");
+    hooker.unhook(hooks[1]);
+    // Discarding a deferred hook must not touch the code, which would also change the protection.
+    HL_ASSERT(hl::GetMemoryByAddress((uintptr_t)&functions[32]).protection == hl::PROTECTION_READ_WRITE_EXECUTE,
+              "Discarded hook changed the code");
+    hooker.commit();
+
+    cbCounter = 0;
+    for (size_t i = 0; i < 100; i++)
+        HL_ASSERT(function(i)() == 5, "Batched hook broke the function");
+    HL_ASSERT(cbCounter == 99, "Batched hooks had no effect or unhooked hook was applied");
+
+    auto spinFunc = (int (*)())spinCode.data();
+    std::atomic<bool> started = false;
+    std::atomic<int> result = 0;
+    std::thread waiter(
+        [&]
+        {
+            started = true;
+            result = spinFunc();
+        });
+    while (!started)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    hooker.beginBatch();
+    HL_ASSERT(hooker.hookDetour(spinCode.data(), spinHookOffset, &DetourFunc), "Batched hook failed");
+    hooker.commit();
+
+    // Without the move, the thread would execute the patched bytes and leave the loop or crash.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    HL_ASSERT(result == 0, "Waiting thread left the loop");
+    release = 1;
+    waiter.join();
+    HL_ASSERT(result == 5, "Waiting thread was not moved correctly");
+
+    cbCounter = 0;
+    HL_ASSERT(spinFunc() == 5 && cbCounter == 1, "Batched hook had no effect");
+}
+
+static void TestInstructionDecoder()
+{
+    struct Case
+    {
+        std::vector<unsigned char> bytes;
+        int length;
+        hl::RelativeType relative;
+    };
+    using RT = hl::RelativeType;
+    const std::vector<Case> cases = {
+        { { 0x55 }, 1, RT::None },                                     // PUSH RBP
+        { { 0x83, 0xec, 0x20 }, 3, RT::None },                         // SUB ESP, 0x20
+        { { 0xc7, 0x44, 0x24, 0x08, 0x01, 0x00, 0x00, 0x00 }, 8, RT::None }, // MOV DWORD [ESP+8], 1
+        { { 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 }, 6, RT::None },       // NOP WORD [EAX+EAX+0]
+        { { 0xf6, 0xc1, 0x01 }, 3, RT::None },                         // TEST CL, 1
+        { { 0xf6, 0xd1 }, 2, RT::None },                               // NOT CL
+        { { 0x66, 0xb8, 0x01, 0x00 }, 4, RT::None },                   // MOV AX, 1
+        { { 0xc8, 0x10, 0x00, 0x00 }, 4, RT::None },                   // ENTER 0x10, 0
+        { { 0x66, 0x0f, 0x3a, 0x0f, 0xc1, 0x08 }, 6, RT::None },       // PALIGNR XMM0, XMM1, 8
+        { { 0xc5, 0xf8, 0x77 }, 3, RT::None },                         // VZEROUPPER
+        { { 0xe8, 0x00, 0x00, 0x00, 0x00 }, 5, RT::Call },             // CALL rel32
+        { { 0x74, 0x05 }, 2, RT::ConditionalJump },                    // JZ rel8
+        { { 0x0f, 0x84, 0x00, 0x00, 0x00, 0x00 }, 6, RT::ConditionalJump }, // JZ rel32
+        { { 0xeb, 0xfe }, 2, RT::Jump },                               // JMP rel8
+        { { 0xe2, 0xfe }, 2, RT::Loop },                               // LOOP rel8
+#ifdef ARCH_64BIT
+        { { 0x48, 0x89, 0xe5 }, 3, RT::None },                         // MOV RBP, RSP
+        { { 0x48, 0xb8, 1, 2, 3, 4, 5, 6, 7, 8 }, 10, RT::None },      // MOV RAX, imm64
+        { { 0xa0, 1, 2, 3, 4, 5, 6, 7, 8 }, 9, RT::None },             // MOV AL, [moffs64]
+        { { 0x48, 0x8b, 0x05, 0x00, 0x00, 0x00, 0x00 }, 7, RT::Memory }, // MOV RAX, [RIP+0]
+        { { 0x81, 0x3d, 0, 0, 0, 0, 1, 0, 0, 0 }, 10, RT::Memory },    // CMP DWORD [RIP+0], 1
+        { { 0xc4, 0xe2, 0x79, 0x18, 0x05, 0, 0, 0, 0 }, 9, RT::Memory }, // VBROADCASTSS XMM0, [RIP+0]
+        { { 0x62, 0xf1, 0x7c, 0x48, 0x10, 0x05, 0, 0, 0, 0 }, 10, RT::Memory }, // VMOVUPS ZMM0, [RIP+0]
+        { { 0x06 }, 0, RT::None },                                     // PUSH ES is invalid
+#else
+        { { 0x89, 0xe5 }, 2, RT::None },                               // MOV EBP, ESP
+        { { 0xa0, 1, 2, 3, 4 }, 5, RT::None },                         // MOV AL, [moffs32]
+        { { 0x8b, 0x05, 0x00, 0x00, 0x00, 0x00 }, 6, RT::None },       // MOV EAX, [abs32]
+        { { 0xc5, 0x00 }, 2, RT::None },                               // LDS EAX, [EAX]
+        { { 0x06 }, 1, RT::None },                                     // PUSH ES
+#endif
+    };
+    for (const auto& testCase : cases)
+    {
+        std::vector<unsigned char> code(16, 0x90);
+        std::ranges::copy(testCase.bytes, code.begin());
+        const auto instruction = hl::DecodeInstruction((uintptr_t)code.data());
+        HL_ASSERT(instruction.length == testCase.length, "Wrong instruction length");
+        HL_ASSERT(instruction.relative == testCase.relative, "Wrong relative operand");
+    }
+    const unsigned char ret[] = { 0xc3, 0x90 };
+    HL_ASSERT(hl::DecodeInstruction((uintptr_t)ret).endsFlow, "RET does not end the flow");
+
+    HL_ASSERT(hl::GetPrologueSize((uintptr_t)g_dummyCode.data(), 5) == g_dummyShortHookOffset, "Wrong prologue size");
+
+    // A prologue with a call, a short conditional jump and a memory operand that is RIP-relative on 64-bit.
+    hl::code_page_vector code(0x100, 0xcc);
+    const auto base = (uintptr_t)code.data();
+    const unsigned char prologue[] = {
+        0xe8, 0x1b, 0x00, 0x00, 0x00, // CALL helper
+        0x85, 0xc0,                   // TEST EAX, EAX
+        0x74, 0x07,                   // JZ fail
+        0x03, 0x05, 0, 0, 0, 0,       // ADD EAX, [data]
+        0xc3,                         // RET
+        0xb8, 0xff, 0xff, 0xff, 0xff, // fail: MOV EAX, -1
+        0xc3,                         // RET
+    };
+    std::ranges::copy(prologue, code.begin());
+#ifdef ARCH_64BIT
+    const auto data = (uint32_t)(0x40 - 15);
+#else
+    const auto data = (uint32_t)(base + 0x40);
+#endif
+    memcpy(&code[11], &data, sizeof(data));
+    const unsigned char helper[] = { 0xb8, 0x28, 0x00, 0x00, 0x00, 0xc3 }; // MOV EAX, 40; RET
+    std::ranges::copy(helper, code.begin() + 0x20);
+    const uint32_t two = 2;
+    memcpy(&code[0x40], &two, sizeof(two));
+    auto func = (int (*)())base;
+    HL_ASSERT(func() == 42, "Test function broken");
+
+    HL_ASSERT(hl::GetPrologueSize(base, 5) == 5 && hl::GetPrologueSize(base, 6) == 7, "Wrong prologue size");
+    HL_ASSERT(hl::GetPrologueSize(base + 15, 5) == 0, "Prologue continues after RET");
+    HL_ASSERT(hl::GetPrologueSize(base, 17) == 0, "Prologue continues after RET");
+
+    hl::Hooker hooker;
+    auto hook = hooker.hookDetour(func, 15, &DetourFunc);
+    HL_ASSERT(hook, "Detour hook failed");
+    cbCounter = 0;
+    HL_ASSERT(func() == 42, "Relocated code is broken");
+    HL_ASSERT(cbCounter == 1, "Detour hook had no effect");
+    hooker.unhook(hook);
+    HL_ASSERT(memcmp(code.data(), prologue, 11) == 0, "Unhook did not restore the code");
+
+    hook = hooker.hookDetour(func, &DetourFunc);
+    HL_ASSERT(hook, "Detour hook without offset failed");
+    cbCounter = 0;
+    HL_ASSERT(func() == 42, "Relocated code is broken");
+    HL_ASSERT(cbCounter == 1, "Detour hook without offset had no effect");
+    hooker.unhook(hook);
+
+    uintptr_t jmpBack = 0;
+    hook = hooker.hookJMP(g_dummyCode.data(), &CallbackFunc, &jmpBack);
+    HL_ASSERT(hook && jmpBack, "JMP hook without offset failed");
+    cbCounter = 0;
+    ((int (*)())g_dummyCode.data())();
+    HL_ASSERT(cbCounter == 1, "JMP hook without offset had no effect");
+    HL_ASSERT(((int (*)())jmpBack)() == 5, "Jump back is broken");
+    hooker.unhook(hook);
+
+    // Code that ends before a jump fits can not be hooked.
+    HL_ASSERT(!hooker.hookDetour(base + 15, &DetourFunc), "Hooked code that is too short");
+}
+
 static void TestExeFile()
 {
 #ifdef WIN32
@@ -606,7 +1909,24 @@ public:
         HL_TEST(TestModules);
         HL_TEST(TestPatch);
         HL_TEST(TestPatternScan);
+        HL_TEST(TestPatternScanSimd);
+        HL_TEST(TestPatternScanMulti);
+        HL_TEST(TestPatternScanParallel);
+        HL_TEST(TestPatternScanAsync);
+        HL_TEST(TestScanRegions);
+        HL_TEST(TestGenerateSignature);
+        HL_TEST(TestCodeIndex);
+        HL_TEST(TestPatternScanFile);
+        HL_TEST(TestIncrementalScanner);
+        HL_TEST(TestModuleRegistry);
+        HL_TEST(TestScanCache);
+        HL_TEST(TestXrefIndex);
+        HL_TEST(TestRemoteScanner);
         HL_TEST(TestHooks);
+        HL_TEST(TestHooksConcurrent);
+        HL_TEST(TestTrampolineArena);
+        HL_TEST(TestHooksBatch);
+        HL_TEST(TestInstructionDecoder);
         HL_TEST(TestExeFile);
         HL_TEST(TestVEH);
 